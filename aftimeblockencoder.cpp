@@ -1,4 +1,5 @@
 #include "aftimeblockencoder.h"
+#include "cpudispatch.h"
 
 #include <random>
 
@@ -258,8 +259,10 @@ void AFTimeBlockEncoder::fitToMaximum(std::vector<DBufferRow>& data, float* meta
 }
 
 template<bool UseDithering>
+DYSCO_TARGET_CLONES
 void AFTimeBlockEncoder::encode(const dyscostman::StochasticEncoder<float>& gausEncoder, const TimeBlockBuffer<std::complex<float>>& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd)
 {
+	dyscostman::StageTimer timer(_stageCounters, dyscostman::NormalizationStage);
 	if(_rmsPerAntenna.size() < antennaCount)
 		_rmsPerAntenna.resize(antennaCount);
 	// Note that encoding is performed with doubles
@@ -307,22 +310,28 @@ void AFTimeBlockEncoder::encode(const dyscostman::StochasticEncoder<float>& gaus
 	
 	if(_fitToMaximum)
 	{
+		timer.Switch(dyscostman::FitToMaximumStage);
 		fitToMaximum(data, metaBuffer, gausEncoder, antennaCount);
 	}
-		
+	
+	timer.Switch(dyscostman::QuantizationStage);
 	symbol_t* symbolBufferPtr = symbolBuffer;
-	for(const DBufferRow& row : data)
+	ao::uvector<const dyscostman::StochasticEncoder<float>*> quantizers(_nPol);
+	for(size_t rowIndex=0; rowIndex!=data.size(); ++rowIndex)
 	{
+		const DBufferRow& row = data[rowIndex];
+		selectQuantizers(gausEncoder, rowIndex, quantizers);
 		for(size_t i=0; i!=visPerRow; ++i)
 		{
+			const dyscostman::StochasticEncoder<float>& symbolEncoder = *quantizers[i%_nPol];
 			if(UseDithering)
 			{
-				symbolBufferPtr[i*2]   = gausEncoder.EncodeWithDithering(row.visibilities[i].real(), _ditherDist(*rnd));
-				symbolBufferPtr[i*2+1] = gausEncoder.EncodeWithDithering(row.visibilities[i].imag(), _ditherDist(*rnd));
+				symbolBufferPtr[i*2]   = symbolEncoder.EncodeWithDithering(row.visibilities[i].real(), _ditherDist(*rnd));
+				symbolBufferPtr[i*2+1] = symbolEncoder.EncodeWithDithering(row.visibilities[i].imag(), _ditherDist(*rnd));
 			}
 			else {
-				symbolBufferPtr[i*2]   = gausEncoder.Encode(row.visibilities[i].real());
-				symbolBufferPtr[i*2+1] = gausEncoder.Encode(row.visibilities[i].imag());
+				symbolBufferPtr[i*2]   = symbolEncoder.Encode(row.visibilities[i].real());
+				symbolBufferPtr[i*2+1] = symbolEncoder.Encode(row.visibilities[i].imag());
 			}
 		}
 		symbolBufferPtr += visPerRow*2;
@@ -334,6 +343,7 @@ void AFTimeBlockEncoder::encode<true>(const dyscostman::StochasticEncoder<float>
 template
 void AFTimeBlockEncoder::encode<false>(const dyscostman::StochasticEncoder<float>& gausEncoder, const TimeBlockBuffer<std::complex<float>>& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd);
 
+DYSCO_TARGET_CLONES
 void AFTimeBlockEncoder::calculateAntennaeRMS(const std::vector<DBufferRow>& data, size_t polIndex, size_t antennaCount)
 {
 	std::vector<RMSMeasurement> matrixMeas(antennaCount * antennaCount);
@@ -419,10 +429,18 @@ void AFTimeBlockEncoder::InitializeDecode(const float* metaBuffer, size_t nRow,
 }
 
 void AFTimeBlockEncoder::Decode(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, const AFTimeBlockEncoder::symbol_t* symbolBuffer, size_t blockRow, size_t antenna1, size_t antenna2)
+{
+	decode(gausEncoder, buffer, symbolBuffer, blockRow, antenna1, antenna2);
+}
+
+DYSCO_TARGET_CLONES
+void AFTimeBlockEncoder::decode(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, const AFTimeBlockEncoder::symbol_t* symbolBuffer, size_t blockRow, size_t antenna1, size_t antenna2)
 {
 	ao::uvector<double> antFactors(_nPol);
 	for(size_t p=0; p!=_nPol; ++p)
 		antFactors[p] = _rmsPerAntenna[antenna1 * _nPol + p] * _rmsPerAntenna[antenna2 * _nPol + p];
+	ao::uvector<const dyscostman::StochasticEncoder<float>*> quantizers(_nPol);
+	selectQuantizers(gausEncoder, blockRow, quantizers);
 	
 	FBufferRow& row = buffer[blockRow];
 	row.antenna1 = antenna1;
@@ -436,9 +454,10 @@ void AFTimeBlockEncoder::Decode(const dyscostman::StochasticEncoder<float>& gaus
 		{
 			double chRMS = _rmsPerChannel[ch*_nPol + p];
 			double factor = chRMS * antFactors[p];
-			destination->real(double(gausEncoder.Decode(*srcRowPtr)) * factor);
+			const dyscostman::StochasticEncoder<float>& symbolEncoder = *quantizers[p];
+			destination->real(double(symbolEncoder.Decode(*srcRowPtr)) * factor);
 			++srcRowPtr;
-			destination->imag(double(gausEncoder.Decode(*srcRowPtr)) * factor);
+			destination->imag(double(symbolEncoder.Decode(*srcRowPtr)) * factor);
 			++srcRowPtr;
 			++destination;
 		}
@@ -60,6 +60,8 @@ private:
 	template<bool UseDithering>
 	void encode(const dyscostman::StochasticEncoder<float>& gausEncoder, const FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd);
 	
+	void decode(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, const symbol_t* symbolBuffer, size_t blockRow, size_t antenna1, size_t antenna2);
+	
 	void changeAntennaFactor(std::vector<DBufferRow>& data, float* metaBuffer, size_t antennaIndex, size_t antennaCount, size_t polIndex, double factor);
 	void changeChannelFactor(std::vector<DBufferRow>& data, float* metaBuffer, size_t visIndex, double factor);
 	
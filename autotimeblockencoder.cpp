@@ -0,0 +1,126 @@
+#include "autotimeblockencoder.h"
+#include "aftimeblockencoder.h"
+#include "rftimeblockencoder.h"
+#include "rowtimeblockencoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+using namespace dyscostman;
+
+AutoTimeBlockEncoder::AutoTimeBlockEncoder(size_t nPol, size_t nChannels) :
+	_nPol(nPol),
+	_nChannels(nChannels),
+	_selected(nullptr),
+	_selectedNormalization(AFNormalization),
+	_decodeBuffer(nPol, nChannels)
+{
+	_candidates[AFNormalization].reset(new AFTimeBlockEncoder(nPol, nChannels, true));
+	_candidates[RFNormalization].reset(new RFTimeBlockEncoder(nPol, nChannels));
+	_candidates[RowNormalization].reset(new RowTimeBlockEncoder(nPol, nChannels));
+	_selected = _candidates[AFNormalization].get();
+}
+
+size_t AutoTimeBlockEncoder::MetaDataCount(size_t nRow, size_t nPol, size_t nChannels, size_t nAntennae) const
+{
+	size_t count = 0;
+	for(const std::unique_ptr<TimeBlockEncoder>& candidate : _candidates)
+		count = std::max(count, candidate->MetaDataCount(nRow, nPol, nChannels, nAntennae));
+	return count + 1;
+}
+
+void AutoTimeBlockEncoder::SetStageCounters(StageCounters* stageCounters)
+{
+	TimeBlockEncoder::SetStageCounters(stageCounters);
+	for(std::unique_ptr<TimeBlockEncoder>& candidate : _candidates)
+		candidate->SetStageCounters(stageCounters);
+}
+
+void AutoTimeBlockEncoder::SetPolarizationQuantizers(const std::vector<const StochasticEncoder<float>*>& quantizers)
+{
+	TimeBlockEncoder::SetPolarizationQuantizers(quantizers);
+	for(std::unique_ptr<TimeBlockEncoder>& candidate : _candidates)
+		candidate->SetPolarizationQuantizers(quantizers);
+}
+
+void AutoTimeBlockEncoder::SetRowQuantizers(const std::vector<const StochasticEncoder<float>*>& quantizers)
+{
+	TimeBlockEncoder::SetRowQuantizers(quantizers);
+	for(std::unique_ptr<TimeBlockEncoder>& candidate : _candidates)
+		candidate->SetRowQuantizers(quantizers);
+}
+
+template<bool UseDithering>
+void AutoTimeBlockEncoder::encode(const StochasticEncoder<float>& gausEncoder, FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd)
+{
+	const size_t nRow = buffer.NRows();
+	const size_t metaDataCount = MetaDataCount(nRow, _nPol, _nChannels, antennaCount) - 1;
+	_trialMeta.resize(metaDataCount);
+	_bestMeta.resize(metaDataCount);
+	_trialSymbols.resize(SymbolCount(nRow));
+	_bestSymbols.resize(SymbolCount(nRow));
+
+	double bestError = 0.0;
+	for(size_t i=0; i!=CandidateCount; ++i)
+	{
+		TimeBlockEncoder& candidate = *_candidates[i];
+		if(UseDithering)
+			candidate.EncodeWithDithering(gausEncoder, buffer, _trialMeta.data(), _trialSymbols.data(), antennaCount, *rnd);
+		else
+			candidate.EncodeWithoutDithering(gausEncoder, buffer, _trialMeta.data(), _trialSymbols.data(), antennaCount);
+
+		const double error = squaredError(candidate, gausEncoder, buffer, _trialMeta.data(), _trialSymbols.data(), antennaCount);
+		if(i == 0 || error < bestError)
+		{
+			bestError = error;
+			_selectedNormalization = DyscoNormalization(i);
+			std::swap(_trialMeta, _bestMeta);
+			std::swap(_trialSymbols, _bestSymbols);
+		}
+	}
+
+	metaBuffer[0] = float(_selectedNormalization);
+	std::copy(_bestMeta.begin(), _bestMeta.end(), metaBuffer + 1);
+	std::copy(_bestSymbols.begin(), _bestSymbols.end(), symbolBuffer);
+}
+
+template
+void AutoTimeBlockEncoder::encode<true>(const StochasticEncoder<float>& gausEncoder, FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd);
+template
+void AutoTimeBlockEncoder::encode<false>(const StochasticEncoder<float>& gausEncoder, FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd);
+
+double AutoTimeBlockEncoder::squaredError(TimeBlockEncoder& candidate, const StochasticEncoder<float>& gausEncoder, const FBuffer& original, const float* metaBuffer, const symbol_t* symbolBuffer, size_t antennaCount)
+{
+	StageTimer timer(_stageCounters, DecodeStage);
+	const std::vector<FBufferRow>& rows = original.GetVector();
+	candidate.InitializeDecode(metaBuffer, rows.size(), antennaCount);
+	_decodeBuffer.resize(rows.size());
+	double error = 0.0;
+	for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
+	{
+		const FBufferRow& row = rows[rowIndex];
+		candidate.Decode(gausEncoder, _decodeBuffer, symbolBuffer, rowIndex, row.antenna1, row.antenna2);
+		const std::complex<float>* decoded = _decodeBuffer[rowIndex].visibilities.data();
+		for(size_t i=0; i!=row.visibilities.size(); ++i)
+		{
+			const std::complex<double> value = row.visibilities[i];
+			if(std::isfinite(value.real()) && std::isfinite(value.imag()))
+				error += std::norm(value - std::complex<double>(decoded[i]));
+		}
+	}
+	// A candidate that decodes finite values to non-finite values is never selected
+	return std::isfinite(error) ? error : std::numeric_limits<double>::infinity();
+}
+
+void AutoTimeBlockEncoder::InitializeDecode(const float* metaBuffer, size_t nRow, size_t nAntennae)
+{
+	const float tag = metaBuffer[0];
+	if(!(tag >= 0.0f && tag < float(CandidateCount)))
+		throw std::runtime_error("Invalid normalization tag in block that was encoded with automatic normalization");
+	const size_t normalization = size_t(tag);
+	_selectedNormalization = DyscoNormalization(normalization);
+	_selected = _candidates[normalization].get();
+	_selected->InitializeDecode(metaBuffer + 1, nRow, nAntennae);
+}
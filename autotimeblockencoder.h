@@ -0,0 +1,100 @@
+#ifndef AUTO_TIME_BLOCK_ENCODER_H
+#define AUTO_TIME_BLOCK_ENCODER_H
+
+#include "dysconormalization.h"
+#include "stochasticencoder.h"
+#include "timeblockbuffer.h"
+#include "uvector.h"
+
+#include <complex>
+#include <memory>
+#include <vector>
+#include <random>
+
+#include "timeblockencoder.h"
+
+/**
+ * Encoder that encodes every block with the AF, RF and row normalizations, and
+ * keeps the normalization that results in the smallest quantization error.
+ * The first metadata value of a block holds the selected normalization, the
+ * metadata of the selected encoder follows it.
+ */
+class AutoTimeBlockEncoder : public TimeBlockEncoder
+{
+public:
+	AutoTimeBlockEncoder(size_t nPol, size_t nChannels);
+
+	virtual ~AutoTimeBlockEncoder() override { }
+
+	virtual void EncodeWithDithering(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937& rnd) final override
+	{
+		encode<true>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount, &rnd);
+	}
+
+	virtual void EncodeWithoutDithering(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount) final override
+	{
+		encode<false>(gausEncoder, buffer, metaBuffer, symbolBuffer, antennaCount, 0);
+	}
+
+	virtual void InitializeDecode(const float* metaBuffer, size_t nRow, size_t nAntennae) final override;
+
+	virtual void Decode(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, const symbol_t* symbolBuffer, size_t blockRow, size_t antenna1, size_t antenna2) final override
+	{
+		_selected->Decode(gausEncoder, buffer, symbolBuffer, blockRow, antenna1, antenna2);
+	}
+
+	virtual size_t SymbolCount(size_t nRow, size_t nPol, size_t nChannels) const final override
+	{
+		return nRow * nChannels * nPol * 2 /*complex*/ ;
+	}
+
+	virtual size_t SymbolCount(size_t nRow) const final override
+	{
+		return nRow * _nChannels * _nPol * 2 /*complex*/ ;
+	}
+
+	virtual size_t SymbolsPerRow() const final override
+	{
+		return _nChannels * _nPol * 2 /*complex*/ ;
+	}
+
+	virtual size_t MetaDataCount(size_t nRow, size_t nPol, size_t nChannels, size_t nAntennae) const final override;
+
+	virtual void SetStageCounters(dyscostman::StageCounters* stageCounters) final override;
+
+	virtual void SetPolarizationQuantizers(const std::vector<const dyscostman::StochasticEncoder<float>*>& quantizers) final override;
+
+	virtual void SetRowQuantizers(const std::vector<const dyscostman::StochasticEncoder<float>*>& quantizers) final override;
+
+	/**
+	 * The normalization that was selected by the last call to InitializeDecode(), or
+	 * by the last encoding call when nothing was decoded afterwards.
+	 */
+	dyscostman::DyscoNormalization SelectedNormalization() const { return _selectedNormalization; }
+
+private:
+	template<bool UseDithering>
+	void encode(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd);
+
+	/**
+	 * Sum of squared differences between the decoded block and the original, over
+	 * all finite values of the original.
+	 */
+	double squaredError(TimeBlockEncoder& candidate, const dyscostman::StochasticEncoder<float>& gausEncoder, const FBuffer& original, const float* metaBuffer, const symbol_t* symbolBuffer, size_t antennaCount);
+
+	static const size_t CandidateCount = 3;
+
+	size_t _nPol, _nChannels;
+
+	// Indexed by DyscoNormalization
+	std::unique_ptr<TimeBlockEncoder> _candidates[CandidateCount];
+	TimeBlockEncoder* _selected;
+	dyscostman::DyscoNormalization _selectedNormalization;
+
+	// Buffers for the result of the candidate that is tried, and the best candidate so far
+	ao::uvector<float> _trialMeta, _bestMeta;
+	ao::uvector<symbol_t> _trialSymbols, _bestSymbols;
+	FBuffer _decodeBuffer;
+};
+
+#endif
@@ -3,6 +3,10 @@
 
 #include <stdexcept>
 
+#include <stdint.h>
+
+#include "cpudispatch.h"
+
 namespace dyscostman
 {
 	
@@ -26,6 +30,12 @@ namespace dyscostman
 class BytePacker
 {
 	public:
+		/**
+		 * Type of an unpacked symbol. Symbols are at most 16 bits, so 16-bit
+		 * integers keep the unpacked buffers small.
+		 */
+		typedef uint16_t symbol_t;
+		
 		/**
 		 * Call a pack..() function for a given bit count. Will forward the pack operation to
 		 * the one for the given bit count.
@@ -34,7 +44,7 @@ class BytePacker
 		 * @param symbolBuffer the input buffer
 		 * @param symbolCount number of symbols in @p symbolBuffer.
 		 */
-		static void pack(unsigned bitCount, unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack(unsigned bitCount, unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		
 		/**
 		 * Call an unpack..() function for a given bit count. Will forward the unpack operation to
@@ -44,91 +54,116 @@ class BytePacker
 		 * @param packedBuffer the input buffer with the packed symbols
 		 * @param symbolCount number of symbols that will be unpacked into @p symbolBuffer.
 		 */
-		static void unpack(unsigned bitCount, unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack(unsigned bitCount, symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		
+		/**
+		 * Pack the symbols from symbolBuffer into the destination array using bitCount=1. 
+		 */
+		static void pack1(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
+		/**
+		 * Reverse of pack1(). Will write symbolCount items into the symbolBuffer.
+		 */
+		static void unpack1(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 		
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=2. 
 		 */
-		static void pack2(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack2(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		/**
 		 * Reverse of pack2(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack2(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack2(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 		
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=3. 
 		 */
-		static void pack3(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack3(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		/**
 		 * Reverse of pack3(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack3(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack3(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 		
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=4. 
 		 */
-		static void pack4(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack4(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		/**
 		 * Reverse of pack4(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack4(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack4(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 		
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=6. 
 		 */
-		static void pack6(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack6(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		
 		/**
 		 * Reverse of pack6(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack6(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack6(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=8. 
 		 */
-		static void pack8(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack8(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		/**
 		 * Reverse of pack8(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack8(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack8(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 	
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=10. 
 		 */
-		static void pack10(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack10(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		/**
 		 * Reverse of pack10(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack10(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack10(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 		
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=12. 
 		 */
-		static void pack12(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack12(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		/**
 		 * Reverse of pack12(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack12(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack12(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 		
 		/**
 		 * Pack the symbols from symbolBuffer into the destination array using bitCount=16. 
 		 */
-		static void pack16(unsigned char* dest, const unsigned* symbolBuffer, size_t symbolCount);
+		static void pack16(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount);
 		/**
 		 * Reverse of pack16(). Will write symbolCount items into the symbolBuffer.
 		 */
-		static void unpack16(unsigned* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
+		static void unpack16(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount);
 		
 		static size_t bufferSize(size_t nSymbols, size_t nBits)
 		{
 			return (nSymbols*nBits + 7) / 8;
 		}
+		
+		/**
+		 * Whether pack() and unpack() support the given number of bits per symbol.
+		 */
+		static bool isSupported(unsigned nBits)
+		{
+			switch(nBits)
+			{
+				case 1: case 2: case 3: case 4: case 6: case 8: case 10: case 12: case 16:
+					return true;
+				default:
+					return false;
+			}
+		}
 };
 
-inline void BytePacker::pack(unsigned int bitCount, unsigned char* dest, const unsigned int* symbolBuffer, size_t symbolCount)
+DYSCO_TARGET_CLONES
+inline void BytePacker::pack(unsigned int bitCount, unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	switch(bitCount)
 	{
+		case 1: pack1(dest, symbolBuffer, symbolCount); break;
 		case 2: pack2(dest, symbolBuffer, symbolCount); break;
 		case 3: pack3(dest, symbolBuffer, symbolCount); break;
 		case 4: pack4(dest, symbolBuffer, symbolCount); break;
@@ -141,10 +176,12 @@ inline void BytePacker::pack(unsigned int bitCount, unsigned char* dest, const u
 	}
 }
 
-inline void BytePacker::unpack(unsigned int bitCount, unsigned int* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount)
+DYSCO_TARGET_CLONES
+inline void BytePacker::unpack(unsigned int bitCount, symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount)
 {
 	switch(bitCount)
 	{
+		case 1: unpack1(symbolBuffer, packedBuffer, symbolCount); break;
 		case 2: unpack2(symbolBuffer, packedBuffer, symbolCount); break;
 		case 3: unpack3(symbolBuffer, packedBuffer, symbolCount); break;
 		case 4: unpack4(symbolBuffer, packedBuffer, symbolCount); break;
@@ -157,7 +194,45 @@ inline void BytePacker::unpack(unsigned int bitCount, unsigned int* symbolBuffer
 	}
 }
 
-inline void BytePacker::pack2(unsigned char* dest, const unsigned int* symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack1(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount)
+{
+	const size_t limit = symbolCount/8;
+	for(size_t i=0; i!=limit; i++)
+	{
+		unsigned char byte = 0;
+		for(size_t bit=0; bit!=8; ++bit)
+			byte |= symbolBuffer[bit] << bit; // bit 1 into bit+1
+		*dest = byte;
+		symbolBuffer += 8;
+		++dest;
+	}
+	const size_t remainder = symbolCount - limit*8;
+	if(remainder != 0)
+	{
+		unsigned char byte = 0;
+		for(size_t bit=0; bit!=remainder; ++bit)
+			byte |= symbolBuffer[bit] << bit;
+		*dest = byte;
+	}
+}
+
+inline void BytePacker::unpack1(symbol_t* symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
+{
+	const size_t limit = symbolCount/8;
+	for(size_t i=0; i!=limit; i++)
+	{
+		const unsigned char byte = *packedBuffer;
+		for(size_t bit=0; bit!=8; ++bit)
+			symbolBuffer[bit] = (byte >> bit) & 0x01; // bit+1 into bit 1
+		symbolBuffer += 8;
+		++packedBuffer;
+	}
+	const size_t remainder = symbolCount - limit*8;
+	for(size_t bit=0; bit!=remainder; ++bit)
+		symbolBuffer[bit] = ((*packedBuffer) >> bit) & 0x01;
+}
+
+inline void BytePacker::pack2(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/4;
 	for(size_t i=0; i!=limit; i++)
@@ -193,7 +268,7 @@ inline void BytePacker::pack2(unsigned char* dest, const unsigned int* symbolBuf
 	}
 }
 
-inline void BytePacker::unpack2(unsigned *symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack2(symbol_t* symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/4;
 	for(size_t i=0; i!=limit; i++)
@@ -229,7 +304,7 @@ inline void BytePacker::unpack2(unsigned *symbolBuffer, unsigned char *packedBuf
 	}
 }
 
-inline void BytePacker::pack3(unsigned char *dest, const unsigned *symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack3(unsigned char *dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/8;
 	for(size_t i=0; i!=limit; i ++)
@@ -306,7 +381,7 @@ inline void BytePacker::pack3(unsigned char *dest, const unsigned *symbolBuffer,
 	}
 }
 
-inline void BytePacker::unpack3(unsigned *symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack3(symbol_t* symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/8;
 	for(size_t i=0; i!=limit; i ++)
@@ -388,7 +463,7 @@ inline void BytePacker::unpack3(unsigned *symbolBuffer, unsigned char *packedBuf
 	}
 }
 
-inline void BytePacker::pack4(unsigned char* dest, const unsigned int* symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack4(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/2;
 	for(size_t i=0; i!=limit; i++)
@@ -403,7 +478,7 @@ inline void BytePacker::pack4(unsigned char* dest, const unsigned int* symbolBuf
 		*dest = (*symbolBuffer); // bits 1-4 into 1-4
 }
 
-inline void BytePacker::unpack4(unsigned *symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack4(symbol_t* symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/2;
 	for(size_t i=0; i!=limit; i++)
@@ -418,7 +493,7 @@ inline void BytePacker::unpack4(unsigned *symbolBuffer, unsigned char *packedBuf
 		*symbolBuffer = *packedBuffer &0x0F; // bits 1-4 into 1-4
 }
 
-inline void BytePacker::pack6(unsigned char *dest, const unsigned *symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack6(unsigned char *dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/4;
 	for(size_t i=0; i!=limit; i ++)
@@ -470,7 +545,7 @@ inline void BytePacker::pack6(unsigned char *dest, const unsigned *symbolBuffer,
 	}
 }
 
-inline void BytePacker::unpack6(unsigned *symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack6(symbol_t* symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/4;
 	for(size_t i=0; i!=limit; i ++)
@@ -519,19 +594,19 @@ inline void BytePacker::unpack6(unsigned *symbolBuffer, unsigned char *packedBuf
 	}
 }
 
-inline void BytePacker::pack8(unsigned char *dest, const unsigned *symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack8(unsigned char *dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	for(size_t i=0; i!=symbolCount; ++i)
 		dest[i] = symbolBuffer[i];
 }
 
-inline void BytePacker::unpack8(unsigned *symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack8(symbol_t* symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
 {
 	for(size_t i=0; i!=symbolCount; ++i)
 		symbolBuffer[i] = packedBuffer[i];
 }
 
-inline void BytePacker::pack10(unsigned char* dest, const unsigned int* symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack10(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/4;
 	for(size_t i=0; i!=limit; i ++)
@@ -586,7 +661,7 @@ inline void BytePacker::pack10(unsigned char* dest, const unsigned int* symbolBu
 	}
 }
 
-inline void BytePacker::unpack10(unsigned int* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack10(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/4;
 	for(size_t i=0; i!=limit; i ++)
@@ -640,7 +715,7 @@ inline void BytePacker::unpack10(unsigned int* symbolBuffer, unsigned char* pack
 	}
 }
 
-inline void BytePacker::pack12(unsigned char* dest, const unsigned int* symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack12(unsigned char* dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/2;
 	for(size_t i=0; i!=limit; i++)
@@ -666,7 +741,7 @@ inline void BytePacker::pack12(unsigned char* dest, const unsigned int* symbolBu
 	}
 }
 
-inline void BytePacker::unpack12(unsigned int* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack12(symbol_t* symbolBuffer, unsigned char* packedBuffer, size_t symbolCount)
 {
 	const size_t limit = symbolCount/2;
 	for(size_t i=0; i!=limit; i++)
@@ -690,13 +765,13 @@ inline void BytePacker::unpack12(unsigned int* symbolBuffer, unsigned char* pack
 	}
 }
 
-inline void BytePacker::pack16(unsigned char *dest, const unsigned *symbolBuffer, size_t symbolCount)
+inline void BytePacker::pack16(unsigned char *dest, const symbol_t* symbolBuffer, size_t symbolCount)
 {
 	for(size_t i=0; i!=symbolCount; ++i)
 		reinterpret_cast<uint16_t*>(dest)[i] = symbolBuffer[i];
 }
 
-inline void BytePacker::unpack16(unsigned *symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
+inline void BytePacker::unpack16(symbol_t* symbolBuffer, unsigned char *packedBuffer, size_t symbolCount)
 {
 	for(size_t i=0; i!=symbolCount; ++i)
 		symbolBuffer[i] = reinterpret_cast<uint16_t*>(packedBuffer)[i];
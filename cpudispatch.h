@@ -0,0 +1,25 @@
+#ifndef DYSCO_CPU_DISPATCH_H
+#define DYSCO_CPU_DISPATCH_H
+
+/**
+ * @file
+ * Support for compiling hot loops for several instruction sets.
+ *
+ * When the library is built with PORTABLE, it can not assume that the
+ * machine supports more than the base instruction set. Functions marked
+ * with DYSCO_TARGET_CLONES are then compiled once for each of the instruction
+ * sets below, and the dynamic loader selects the best version for the machine
+ * when the library is loaded (using an ifunc resolver). Functions that are
+ * inlined into a marked function are compiled for each instruction set as well.
+ * Virtual functions can not be marked; these forward to a marked non-virtual function.
+ *
+ * DYSCO_CPU_DISPATCH is defined by the build when the compiler supports this.
+ * Otherwise, and in non-portable builds that use -march=native, the macro is empty.
+ */
+#ifdef DYSCO_CPU_DISPATCH
+#define DYSCO_TARGET_CLONES __attribute__((target_clones("avx512f", "avx2", "sse4.2", "default")))
+#else
+#define DYSCO_TARGET_CLONES
+#endif
+
+#endif
@@ -12,10 +12,13 @@
 #include <casacore/tables/Tables/ArrayColumn.h>
 #include <casacore/tables/Tables/ScalarColumn.h>
 
+#include <algorithm>
+#include <map>
+
 using namespace dyscostman;
 
 template<typename T>
-void createDyscoStManColumn(casacore::MeasurementSet& ms, const std::string& name, const casacore::IPosition& shape, unsigned bitsPerComplex, unsigned bitsPerWeight, DyscoNormalization normalization, DyscoDistribution distribution, double studentsTNu, double distributionTruncation, bool staticSeed)
+void createDyscoStManColumn(casacore::MeasurementSet& ms, const std::string& name, const casacore::IPosition& shape, unsigned bitsPerComplex, unsigned bitsPerWeight, DyscoNormalization normalization, DyscoDistribution distribution, double studentsTNu, double distributionTruncation, bool staticSeed, bool variableRowsPerBlock, size_t rowsPerBlock, size_t antennaCount, const std::map<std::string, casacore::DataType>& columnTypes)
 {
 	std::cout << "Constructing new column '" << name << "'...\n";
 	casacore::ArrayColumnDesc<T> columnDesc(name, "", "DyscoStMan", "DyscoStMan", shape);
@@ -49,6 +52,17 @@ void createDyscoStManColumn(casacore::MeasurementSet& ms, const std::string& nam
 			std::cout << "Setting static seed...\n";
 			dataManager.SetStaticSeed(true);
 		}
+		if(variableRowsPerBlock) {
+			std::cout << "Setting variable rows per block...\n";
+			dataManager.SetVariableRowsPerBlock(true);
+			dataManager.SetBlockLayout(rowsPerBlock, antennaCount);
+		}
+		// Float columns other than WEIGHT_SPECTRUM are stored with the weight bit rate as well
+		for(const std::pair<const std::string, casacore::DataType>& column : columnTypes)
+		{
+			if(column.second == casacore::TpFloat && column.first != "WEIGHT_SPECTRUM")
+				dataManager.SetFloatColumnBitCount(column.first, bitsPerWeight);
+		}
 		std::cout << "Adding column...\n";
 		ms.addColumn(columnDesc, dataManager);
 		isAlreadyUsed = false;
@@ -84,16 +98,22 @@ int main(int argc, char *argv[])
 			"The Dysco compression technique is explained in http://arxiv.org/abs/1609.02019.\n"
 			"\n"
 			"Options:\n"
-			"-rfnormalization / -afnormalization / -rownormalization\n"
+			"-rfnormalization / -afnormalization / -rownormalization / -autonormalization\n"
 			"\tSelect normalization method. Default is AF normalization. For high bitrates, RF normalization\n"
 			"\tis recommended. The use of row normalization is discouraged because it can be unstable.\n"
+			"\tAuto normalization selects the normalization with the smallest error for every block, which\n"
+			"\tmakes encoding about three times slower.\n"
 			"-data-bit-rate <n>\n"
 			"\tSets the number of bits per float for visibility data. Because a visibility is a complex number,\n"
 			"\tthe total nr bits per visibility will be twice this number. The compression rate is n/32.\n"
 			"-weight-bit-rate <n>\n"
 			"\tSets the number of bits per float for the data weights. The storage manager will use a single\n"
 			"\tweight for all polarizations, hence with four polarizations the compression of weight is\n"
-			"\t1/4 * n/32.\n"
+			"\t1/4 * n/32. This bit rate is also used for other float columns, such as SIGMA_SPECTRUM.\n"
+			"-column <name>\n"
+			"\tCompress the given column. Complex columns are lossily compressed, Float columns are stored\n"
+			"\twith the weight bit rate and Bool columns, such as FLAG, are stored without loss. Can be\n"
+			"\tgiven multiple times. The default is DATA.\n"
 			"-reorder\n"
 			"\tWill rewrite the measurement set after replacing the column. This makes sure that the space\n"
 			"\tof the old column is freed. It is for testing only, because the compression error is applied\n"
@@ -177,6 +197,10 @@ int main(int argc, char *argv[])
 		{
 			normalization = RowNormalization;
 		}
+		else if(p == "autonormalization")
+		{
+			normalization = AutoNormalization;
+		}
 		else if(p == "static-seed")
 		{
 			staticSeed = true;
@@ -225,6 +249,9 @@ int main(int argc, char *argv[])
 		case RowNormalization:
 			std::cout << "Row";
 			break;
+		case AutoNormalization:
+			std::cout << "Auto";
+			break;
 		default:
 			std::cout << "?";
 			break;
@@ -234,11 +261,18 @@ int main(int argc, char *argv[])
 	std::cout << "Opening ms...\n";
 	std::unique_ptr<casacore::MeasurementSet> ms(new casacore::MeasurementSet(msPath, casacore::Table::Update));
 	
+	// Float columns, such as WEIGHT_SPECTRUM and SIGMA_SPECTRUM, are stored with the
+	// weight encoder and Bool columns, such as FLAG, with the flag encoder. The types are
+	// determined before the columns are renamed.
+	std::map<std::string, casacore::DataType> columnTypes;
+	for(const std::string& columnName : columnNames)
+		columnTypes[columnName] = ms->tableDesc().columnDesc(columnName).dataType();
+	
 	Stopwatch watch(true);
 	std::cout << "Replacing flagged values by NaNs...\n";
 	for(std::string columnName : columnNames)
 	{
-		if(columnName != "WEIGHT_SPECTRUM")
+		if(columnTypes[columnName] == casacore::TpComplex)
 		{
 			casacore::ArrayColumn<std::complex<float>> dataCol(*ms, columnName);
 			casacore::ArrayColumn<bool> flagCol(*ms, casacore::MeasurementSet::columnName(casacore::MSMainEnums::FLAG));
@@ -265,6 +299,10 @@ int main(int argc, char *argv[])
 	}
 	std::cout << "Time taken: " << watch.ToString() << '\n';
 	
+	// Measurement sets in which not all timesteps have the same baselines are
+	// stored with a variable number of rows per block
+	bool variableRowsPerBlock = false;
+	size_t maxRowsPerBlock = 0, antennaCount = 0;
 	if(doCheckMSFormat)
 	{
 		std::cout << "Validating MS ordering...\n";
@@ -292,11 +330,8 @@ int main(int argc, char *argv[])
 			if(time != lastTime || fieldId != lastFieldId || dataDescId != lastDataDescId)
 			{
 				if(blockOffset != antennasInBlock.size())
-				{
-					std::ostringstream msg;
-					msg << "This measurement set is not 'regular'; at table row " << row << ", timeblock index " << blockNumber << ", timeblock offset " << blockOffset << " the number of baselines in the timeblock (" << blockOffset << ") is not equal to the number of baselines in previous timeblocks (" << antennasInBlock.size() << "). In other words, not all timesteps had the same baselines. This is required to be able to compress with Dysco.";
-					throw std::runtime_error(msg.str());
-				}
+					variableRowsPerBlock = true;
+				maxRowsPerBlock = std::max(maxRowsPerBlock, blockOffset);
 				blockOffset = 0;
 				++blockNumber;
 			}
@@ -304,26 +339,21 @@ int main(int argc, char *argv[])
 			{
 				antennasInBlock.push_back(std::make_pair(antenna1, antenna2));
 			}
-			else {
-				if(antennasInBlock[blockOffset].first != antenna1 || antennasInBlock[blockOffset].second != antenna2)
-				{
-					std::string antstr;
-					if(antennasInBlock[blockOffset].first != antenna1)
-						antstr="antenna1";
-					else
-						antstr="antenna2";
-					std::ostringstream msg;
-					msg << "This measurement set is not 'regular'; at table row " << row << ", timeblock index " << blockNumber << ", timeblock offset " << blockOffset << " the index for " << antstr << " is not the same as for previous timesteps. In other words, not all timesteps had the same baselines. This is required to be able to compress with Dysco.";
-					throw std::runtime_error(msg.str());
-				}
+			else if(blockOffset >= antennasInBlock.size() || antennasInBlock[blockOffset].first != antenna1 || antennasInBlock[blockOffset].second != antenna2)
+			{
+				variableRowsPerBlock = true;
 			}
+			antennaCount = std::max<size_t>(antennaCount, std::max(antenna1, antenna2) + 1);
 			++blockOffset;
 			lastTime = time;
 			lastDataDescId = dataDescId;
 			lastFieldId = fieldId;
 		}
 		if(blockOffset != antennasInBlock.size())
-			throw std::runtime_error("The final timeblock did not have the same number of timesteps as the previous timeblocks. In other words, not all timesteps had the same baselines. This is required to be able to compress with Dysco.");
+			variableRowsPerBlock = true;
+		maxRowsPerBlock = std::max(maxRowsPerBlock, blockOffset);
+		if(variableRowsPerBlock)
+			std::cout << "This measurement set is not 'regular': not all timesteps have the same baselines. It is stored with a variable number of rows per block, of at most " << maxRowsPerBlock << " rows.\n";
 		std::cout << "Time taken: " << watch.ToString() << '\n';
 	}
 	
@@ -337,8 +367,10 @@ int main(int argc, char *argv[])
 	for(std::string columnName : columnNames)
 	{
 		bool replaced;
-		if(columnName == "WEIGHT_SPECTRUM")
+		if(columnTypes[columnName] == casacore::TpFloat)
 			replaced = modifier.PrepareReplacingColumn<float>(columnName, "DyscoStMan", bitsPerFloat, bitsPerWeight, shape);
+		else if(columnTypes[columnName] == casacore::TpBool)
+			replaced = modifier.PrepareReplacingColumn<bool>(columnName, "DyscoStMan", bitsPerFloat, bitsPerWeight, shape);
 		else
 			replaced = modifier.PrepareReplacingColumn<casacore::Complex>(columnName, "DyscoStMan", bitsPerFloat, bitsPerWeight, shape);
 		isDataReplaced = replaced || isDataReplaced;
@@ -347,15 +379,19 @@ int main(int argc, char *argv[])
 	if(isDataReplaced) {
 		for(std::string columnName : columnNames)
 		{
-			if(columnName == "WEIGHT_SPECTRUM")
-				createDyscoStManColumn<float>(*ms, columnName, shape, bitsPerFloat, bitsPerWeight, normalization, distribution, 1.0, distributionTruncation, staticSeed);
+			if(columnTypes[columnName] == casacore::TpFloat)
+				createDyscoStManColumn<float>(*ms, columnName, shape, bitsPerFloat, bitsPerWeight, normalization, distribution, 1.0, distributionTruncation, staticSeed, variableRowsPerBlock, maxRowsPerBlock, antennaCount, columnTypes);
+			else if(columnTypes[columnName] == casacore::TpBool)
+				createDyscoStManColumn<bool>(*ms, columnName, shape, bitsPerFloat, bitsPerWeight, normalization, distribution, 1.0, distributionTruncation, staticSeed, variableRowsPerBlock, maxRowsPerBlock, antennaCount, columnTypes);
 			else
-				createDyscoStManColumn<casacore::Complex>(*ms, columnName, shape, bitsPerFloat, bitsPerWeight, normalization, distribution, 1.0, distributionTruncation, staticSeed);
+				createDyscoStManColumn<casacore::Complex>(*ms, columnName, shape, bitsPerFloat, bitsPerWeight, normalization, distribution, 1.0, distributionTruncation, staticSeed, variableRowsPerBlock, maxRowsPerBlock, antennaCount, columnTypes);
 		}
 		for(std::string columnName : columnNames)
 		{
-			if(columnName == "WEIGHT_SPECTRUM")
+			if(columnTypes[columnName] == casacore::TpFloat)
 				modifier.MoveColumnData<float>(columnName);
+			else if(columnTypes[columnName] == casacore::TpBool)
+				modifier.MoveColumnData<bool>(columnName);
 			else
 				modifier.MoveColumnData<casacore::Complex>(columnName);
 		}
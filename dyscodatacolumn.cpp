@@ -1,14 +1,22 @@
 #include "dyscodatacolumn.h"
 #include "aftimeblockencoder.h"
+#include "autotimeblockencoder.h"
+#include "bytepacker.h"
+#include "dyscostmanerror.h"
 #include "rftimeblockencoder.h"
 #include "rowtimeblockencoder.h"
 
+#include <cstring>
+#include <limits>
+#include <sstream>
+
 namespace dyscostman {
 
 void DyscoDataColumn::Prepare(DyscoDistribution distribution, DyscoNormalization normalization, double studentsTNu, double distributionTruncation)
 {
 	_distribution = distribution;
 	_studentsTNu = studentsTNu;
+	_distributionTruncation = distributionTruncation;
 	_normalization = normalization;
 	ThreadedDyscoColumn::Prepare(distribution, normalization, studentsTNu, distributionTruncation);
 	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
@@ -23,35 +31,326 @@ void DyscoDataColumn::Prepare(DyscoDistribution distribution, DyscoNormalization
 		case RowNormalization:
 			_decoder.reset(new RowTimeBlockEncoder(nPolarizations, nChannels));
 			break;
+		case AutoNormalization:
+			_decoder.reset(new AutoTimeBlockEncoder(nPolarizations, nChannels));
+			break;
+	}
+	
+	if(_stokesTransform && nPolarizations != 4)
+	{
+		std::ostringstream s;
+		s << "Column " << Name() << " has " << nPolarizations << " polarizations, but the Stokes transform requires four";
+		throw DyscoStManError(s.str());
 	}
+	if(_skipFlaggedData && !_bitsPerPolarization.empty())
+		throw DyscoStManError("Skipping flagged data can not be combined with bit counts per polarization");
 	
-	switch(distribution) {
+	_gausEncoder.reset(createQuantizer(getBitsPerSymbol(), 1.0));
+	_scaledQuantizers.clear();
+	preparePolarizationQuantizers();
+	prepareRowQuantizers();
+}
+
+void DyscoDataColumn::SetBitsPerBlockRow(const std::vector<unsigned>& bitsPerBlockRow)
+{
+	_bitsPerBlockRow = bitsPerBlockRow;
+	prepareRowQuantizers();
+}
+
+StochasticEncoder<float>* DyscoDataColumn::createQuantizer(unsigned bitCount, double rms) const
+{
+	switch(_distribution) {
 		case GaussianDistribution:
-			_gausEncoder.reset(new StochasticEncoder<float>(1 << getBitsPerSymbol(), 1.0, true));
-			break;
+			return new StochasticEncoder<float>(1 << bitCount, rms, true);
 		case UniformDistribution:
-			_gausEncoder.reset(new StochasticEncoder<float>(1 << getBitsPerSymbol(), 1.0, false));
-			break;
+			return new StochasticEncoder<float>(1 << bitCount, rms, false);
 		case StudentsTDistribution:
-			_gausEncoder.reset(new StochasticEncoder<float>(StochasticEncoder<float>::StudentTEncoder(1 << getBitsPerSymbol(), studentsTNu, 1.0)));
-			break;
+			return new StochasticEncoder<float>(StochasticEncoder<float>::StudentTEncoder(1 << bitCount, _studentsTNu, rms));
 		case TruncatedGaussianDistribution:
-			_gausEncoder.reset(new StochasticEncoder<float>(StochasticEncoder<float>::TruncatedGausEncoder(1 << getBitsPerSymbol(), distributionTruncation, 1.0)));
-			break;
+			return new StochasticEncoder<float>(StochasticEncoder<float>::TruncatedGausEncoder(1 << bitCount, _distributionTruncation, rms));
+	}
+	throw DyscoStManError("Unsupported distribution in DyscoDataColumn");
+}
+
+const StochasticEncoder<float>* DyscoDataColumn::scaledQuantizer(unsigned bitCount)
+{
+	if(!BytePacker::isSupported(bitCount))
+	{
+		std::ostringstream s;
+		s << "Unsupported data bit count: " << bitCount;
+		throw DyscoStManError(s.str());
+	}
+	std::unique_ptr<StochasticEncoder<float>>& quantizer = _scaledQuantizers[bitCount];
+	if(!quantizer)
+	{
+		std::unique_ptr<StochasticEncoder<float>> unitQuantizer(createQuantizer(bitCount, 1.0));
+		const double rms = _gausEncoder->MaxQuantity() / unitQuantizer->MaxQuantity();
+		quantizer.reset(createQuantizer(bitCount, rms));
+	}
+	return quantizer.get();
+}
+
+void DyscoDataColumn::preparePolarizationQuantizers()
+{
+	_polarizationQuantizers.clear();
+	if(!_bitsPerPolarization.empty())
+	{
+		const size_t nPolarizations = shape()[0];
+		if(_bitsPerPolarization.size() != nPolarizations)
+		{
+			std::ostringstream s;
+			s << "Column " << Name() << " has " << nPolarizations << " polarizations, but " << _bitsPerPolarization.size() << " data bit counts per polarization were specified";
+			throw DyscoStManError(s.str());
+		}
+		for(unsigned bitCount : _bitsPerPolarization)
+			_polarizationQuantizers.push_back(scaledQuantizer(bitCount));
+	}
+	_decoder->SetPolarizationQuantizers(_polarizationQuantizers);
+}
+
+void DyscoDataColumn::prepareRowQuantizers()
+{
+	_rowQuantizers.clear();
+	if(!_bitsPerBlockRow.empty())
+	{
+		if(!_bitsPerPolarization.empty())
+			throw DyscoStManError("Bit counts per polarization can not be combined with bit counts per baseline");
+		if(_skipFlaggedData)
+			throw DyscoStManError("Skipping flagged data can not be combined with bit counts per baseline");
+		for(unsigned bitCount : _bitsPerBlockRow)
+			_rowQuantizers.push_back(scaledQuantizer(bitCount));
 	}
+	_decoder->SetRowQuantizers(_rowQuantizers);
 }
 
 void DyscoDataColumn::initializeDecode(TimeBlockBuffer<data_t>* buffer, const float* metaBuffer, size_t nRow, size_t nAntennae)
 {
 	_decoder->InitializeDecode(metaBuffer, nRow, nAntennae);
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	_losslessDecodeValues = metaBuffer + _decoder->MetaDataCount(nRow, nPolarizations, nChannels, nAntennae);
+	if(_skipFlaggedData)
+	{
+		_decodePresence.resize(presenceWordCount(nRow, nChannels));
+		memcpy(_decodePresence.data(), metaBuffer + presenceOffset(nRow), _decodePresence.size() * sizeof(uint32_t));
+	}
+}
+
+void DyscoDataColumn::decode(TimeBlockBuffer<data_t>* buffer, const symbol_t* data, size_t blockRow, size_t a1, size_t a2)
+{
+	std::vector<uint32_t>::const_iterator lossless = std::lower_bound(_losslessBlockRows.begin(), _losslessBlockRows.end(), blockRow);
+	if(lossless != _losslessBlockRows.end() && *lossless == blockRow)
+	{
+		const size_t valuesPerRow = shape()[0] * shape()[1];
+		TimeBlockBuffer<data_t>::DataRow& row = (*buffer)[blockRow];
+		row.antenna1 = a1;
+		row.antenna2 = a2;
+		row.visibilities.resize(valuesPerRow);
+		const float* values = _losslessDecodeValues + (lossless - _losslessBlockRows.begin()) * valuesPerRow * 2;
+		std::copy_n(reinterpret_cast<const data_t*>(values), valuesPerRow, row.visibilities.data());
+	}
+	else if(_skipFlaggedData && !isPresent(_decodePresence.data(), blockRow))
+	{
+		TimeBlockBuffer<data_t>::DataRow& row = (*buffer)[blockRow];
+		row.antenna1 = a1;
+		row.antenna2 = a2;
+		row.visibilities.assign(shape()[0] * shape()[1], data_t(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()));
+	}
+	else {
+		_decoder->Decode(*_gausEncoder, *buffer, data, blockRow, a1, a2);
+		reconstructRow((*buffer)[blockRow].visibilities, blockRow, _decodeKeyFrame ? &_decodeKeyFrame->buffer : nullptr);
+	}
 }
 
-void DyscoDataColumn::decode(TimeBlockBuffer<data_t>* buffer, const unsigned int* data, size_t blockRow, size_t a1, size_t a2)
+void DyscoDataColumn::reconstructRow(std::vector<data_t>& values, size_t blockRow, const TimeBlockBuffer<data_t>* prediction) const
 {
-	_decoder->Decode(*_gausEncoder, *buffer, data, blockRow, a1, a2);
+	if(_stokesTransform)
+		inverseStokesTransform(values.data(), shape()[1]);
+	if(prediction && blockRow < prediction->NRows())
+	{
+		const std::vector<data_t>& predicted = prediction->GetVector()[blockRow].visibilities;
+		if(predicted.size() == values.size())
+		{
+			for(size_t i=0; i!=values.size(); ++i)
+				values[i] += predictedValue(predicted[i]);
+		}
+	}
 }
 
-void DyscoDataColumn::initializeEncodeThread(void** threadData)
+void DyscoDataColumn::stokesTransform(TimeBlockBuffer<data_t>& buffer) const
+{
+	const size_t nChannels = shape()[1];
+	for(size_t blockRow=0; blockRow!=buffer.NRows(); ++blockRow)
+	{
+		std::vector<data_t>& values = buffer[blockRow].visibilities;
+		if(isLosslessRow(blockRow) || values.size() != nChannels*4)
+			continue;
+		for(size_t ch=0; ch!=nChannels; ++ch)
+		{
+			data_t* correlations = &values[ch*4];
+			const data_t xx = correlations[0], xy = correlations[1], yx = correlations[2], yy = correlations[3];
+			correlations[0] = (xx + yy) * 0.5f;
+			correlations[1] = (xx - yy) * 0.5f;
+			correlations[2] = (xy + yx) * 0.5f;
+			correlations[3] = (xy - yx) * 0.5f;
+		}
+	}
+}
+
+void DyscoDataColumn::subtractPrediction(TimeBlockBuffer<data_t>& buffer, const TimeBlockBuffer<data_t>& prediction) const
+{
+	const std::vector<TimeBlockBuffer<data_t>::DataRow>& predictionRows = prediction.GetVector();
+	for(size_t blockRow=0; blockRow!=std::min(buffer.NRows(), predictionRows.size()); ++blockRow)
+	{
+		std::vector<data_t>& values = buffer[blockRow].visibilities;
+		const std::vector<data_t>& predicted = predictionRows[blockRow].visibilities;
+		if(!isLosslessRow(blockRow) && predicted.size() == values.size())
+		{
+			for(size_t i=0; i!=values.size(); ++i)
+				values[i] -= predictedValue(predicted[i]);
+		}
+	}
+}
+
+std::shared_ptr<DyscoDataColumn::KeyFrame> DyscoDataColumn::keyFrame(size_t blockIndex)
+{
+	std::map<size_t, std::shared_ptr<KeyFrame>>::const_iterator i = _keyFrames.find(blockIndex);
+	if(i != _keyFrames.end())
+		return i->second;
+	
+	// A keyframe that is in the write cache is written before it is read
+	waitUntilWritten(blockIndex);
+	if(blockIndex >= nBlocksInFile())
+	{
+		std::ostringstream s;
+		s << "Block " << blockIndex << " of column " << Name() << " is a keyframe that predicts the blocks after it, but it was not written before them.\nWith predictive encoding, the blocks should be written in order";
+		throw DyscoStManError(s.str());
+	}
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	std::shared_ptr<KeyFrame> keyFrame(new KeyFrame(nPolarizations, nChannels));
+	_decodeKeyFrame.reset();
+	readBlock(blockIndex, keyFrame->buffer);
+	keyFrame->isReady = true;
+	// Only the keyframes of the last two groups are kept
+	_keyFrames.insert(std::make_pair(blockIndex, keyFrame));
+	if(_keyFrames.size() > 2)
+		_keyFrames.erase(_keyFrames.begin());
+	return keyFrame;
+}
+
+void DyscoDataColumn::waitForKeyFrame(const KeyFrame& keyFrame)
+{
+	altthread::mutex::scoped_lock lock(_keyFrameMutex);
+	while(!keyFrame.isReady)
+		_keyFrameCondition.wait(lock);
+}
+
+void DyscoDataColumn::prepareLoadBlock(size_t blockIndex)
+{
+	if(isKeyFrame(blockIndex))
+	{
+		_decodeKeyFrame.reset();
+	}
+	else {
+		std::shared_ptr<KeyFrame> blockKeyFrame = keyFrame(blockIndex - blockIndex % _predictionInterval);
+		waitForKeyFrame(*blockKeyFrame);
+		_decodeKeyFrame = blockKeyFrame;
+	}
+}
+
+void DyscoDataColumn::prepareStoreBlock(size_t blockIndex)
+{
+	if(_predictionInterval <= 1)
+		return;
+	std::shared_ptr<KeyFrame> blockKeyFrame;
+	if(isKeyFrame(blockIndex))
+	{
+		// Replaces the keyframe when it is rewritten. The blocks that were predicted
+		// from the stored keyframe are encoded again after it.
+		if(blockIndex < nBlocksInFile())
+			decodeDependentBlocks(blockIndex);
+		const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+		blockKeyFrame.reset(new KeyFrame(nPolarizations, nChannels));
+		_keyFrames[blockIndex] = blockKeyFrame;
+		if(_keyFrames.size() > 2)
+			_keyFrames.erase(_keyFrames.begin());
+		if(!_dependentBlocks.empty())
+			_dependentKeyFrame = blockKeyFrame;
+	}
+	else {
+		blockKeyFrame = keyFrame(blockIndex - blockIndex % _predictionInterval);
+	}
+	altthread::mutex::scoped_lock lock(_keyFrameMutex);
+	_storedKeyFrames[blockIndex] = blockKeyFrame;
+}
+
+void DyscoDataColumn::afterStoreBlock(size_t blockIndex)
+{
+	for(std::pair<size_t, std::unique_ptr<TimeBlockBuffer<data_t>>>& dependent : _dependentBlocks)
+	{
+		{
+			altthread::mutex::scoped_lock lock(_keyFrameMutex);
+			_storedKeyFrames[dependent.first] = _dependentKeyFrame;
+		}
+		submitBlock(dependent.first, std::move(dependent.second));
+	}
+	_dependentBlocks.clear();
+	_dependentKeyFrame.reset();
+}
+
+void DyscoDataColumn::decodeDependentBlocks(size_t keyFrameIndex)
+{
+	const std::shared_ptr<KeyFrame> storedKeyFrame = keyFrame(keyFrameIndex);
+	waitForKeyFrame(*storedKeyFrame);
+	const std::shared_ptr<const KeyFrame> decodeKeyFrame = _decodeKeyFrame;
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	for(size_t blockIndex=keyFrameIndex+1; blockIndex!=keyFrameIndex+_predictionInterval; ++blockIndex)
+	{
+		waitUntilWritten(blockIndex);
+		if(blockIndex < nBlocksInFile())
+		{
+			std::unique_ptr<TimeBlockBuffer<data_t>> block(new TimeBlockBuffer<data_t>(nPolarizations, nChannels));
+			_decodeKeyFrame = storedKeyFrame;
+			readBlock(blockIndex, *block);
+			padBlock(blockIndex, *block);
+			_dependentBlocks.push_back(std::make_pair(blockIndex, std::move(block)));
+		}
+	}
+	_decodeKeyFrame = decodeKeyFrame;
+}
+
+void DyscoDataColumn::extractLosslessRows(TimeBlockBuffer<data_t>& buffer, float* values) const
+{
+	const size_t valuesPerRow = shape()[0] * shape()[1];
+	data_t* destination = reinterpret_cast<data_t*>(values);
+	for(uint32_t blockRow : _losslessBlockRows)
+	{
+		// Rows that are missing in an incomplete block are stored as zeros
+		if(blockRow < buffer.NRows() && buffer[blockRow].visibilities.size() == valuesPerRow)
+		{
+			data_t* visibilities = buffer[blockRow].visibilities.data();
+			std::copy_n(visibilities, valuesPerRow, destination);
+			std::fill_n(visibilities, valuesPerRow, data_t(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN()));
+		}
+		else {
+			std::fill_n(destination, valuesPerRow, data_t(0.0, 0.0));
+		}
+		destination += valuesPerRow;
+	}
+}
+
+void DyscoDataColumn::restoreLosslessRows(TimeBlockBuffer<data_t>& buffer, const float* values) const
+{
+	const size_t valuesPerRow = shape()[0] * shape()[1];
+	const data_t* source = reinterpret_cast<const data_t*>(values);
+	for(uint32_t blockRow : _losslessBlockRows)
+	{
+		if(blockRow < buffer.NRows() && buffer[blockRow].visibilities.size() == valuesPerRow)
+			std::copy_n(source, valuesPerRow, buffer[blockRow].visibilities.data());
+		source += valuesPerRow;
+	}
+}
+
+void DyscoDataColumn::initializeEncodeThread(void** threadData, StageCounters* stageCounters)
 {
 	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
 	TimeBlockEncoder* encoder = 0;
@@ -65,8 +364,14 @@ void DyscoDataColumn::initializeEncodeThread(void** threadData)
 		case RowNormalization:
 			encoder = new RowTimeBlockEncoder(nPolarizations, nChannels);
 			break;
+		case AutoNormalization:
+			encoder = new AutoTimeBlockEncoder(nPolarizations, nChannels);
+			break;
 	}
-	ThreadData* newThreadData = new ThreadData(encoder);
+	encoder->SetStageCounters(stageCounters);
+	encoder->SetPolarizationQuantizers(_polarizationQuantizers);
+	encoder->SetRowQuantizers(_rowQuantizers);
+	ThreadData* newThreadData = new ThreadData(encoder, stageCounters, nPolarizations, nChannels);
 	// Seed every thread from a random number
 	if(_randomize)
 		newThreadData->rnd.seed(_rnd());
@@ -81,15 +386,222 @@ void DyscoDataColumn::destructEncodeThread(void* threadData)
 	delete data;
 }
 
-void DyscoDataColumn::encode(void* threadData, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae)
+void DyscoDataColumn::encode(void* threadData, size_t blockIndex, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae)
 {
 	ThreadData& data = *reinterpret_cast<ThreadData*>(threadData);
-	data.encoder->EncodeWithDithering(*_gausEncoder, *buffer, metaBuffer, symbolBuffer, nAntennae, data.rnd);
+	std::shared_ptr<KeyFrame> blockKeyFrame;
+	if(_predictionInterval > 1)
+	{
+		altthread::mutex::scoped_lock lock(_keyFrameMutex);
+		std::map<size_t, std::shared_ptr<KeyFrame>>::iterator i = _storedKeyFrames.find(blockIndex);
+		blockKeyFrame = i->second;
+		_storedKeyFrames.erase(i);
+	}
+	
+	// A block that is predicted waits for its keyframe, which has a lower index and is
+	// therefore taken from the write cache before it.
+	TimeBlockBuffer<data_t>* encodedBuffer = buffer;
+	const bool isPredicted = blockKeyFrame && !isKeyFrame(blockIndex);
+	if(isPredicted || _stokesTransform)
+	{
+		data.preparedBuffer = *buffer;
+		encodedBuffer = &data.preparedBuffer;
+	}
+	if(isPredicted)
+	{
+		waitForKeyFrame(*blockKeyFrame);
+		subtractPrediction(data.preparedBuffer, blockKeyFrame->buffer);
+	}
+	if(_stokesTransform)
+		stokesTransform(data.preparedBuffer);
+	
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	float* losslessValues = metaBuffer + data.encoder->MetaDataCount(nRowsInBlock(), nPolarizations, nChannels, nAntennae);
+	extractLosslessRows(*encodedBuffer, losslessValues);
+	data.encoder->EncodeWithDithering(*_gausEncoder, *encodedBuffer, metaBuffer, symbolBuffer, nAntennae, data.rnd);
+	restoreLosslessRows(*encodedBuffer, losslessValues);
+	if(_skipFlaggedData)
+		storePresence(metaBuffer, symbolBuffer, nRowsInBlock());
+	
+	// The decoded keyframe and the error statistics are determined from the
+	// reconstructed visibilities, as the reader will decode them.
+	const bool isStoredKeyFrame = blockKeyFrame && isKeyFrame(blockIndex);
+	if(isStoredKeyFrame || isErrorStatisticsEnabled())
+	{
+		decodeBlock(data, *encodedBuffer, metaBuffer, symbolBuffer, nAntennae);
+		DyscoErrorStatistics errors;
+		if(isErrorStatisticsEnabled())
+		{
+			StageTimer timer(data.stageCounters, ErrorStatisticsStage);
+			errors.clippedCount = countClippedValues(data, *encodedBuffer, symbolBuffer);
+		}
+		const TimeBlockBuffer<data_t>* prediction = isPredicted ? &blockKeyFrame->buffer : nullptr;
+		for(size_t rowIndex=0; rowIndex!=data.decodeBuffer.NRows(); ++rowIndex)
+		{
+			if(!isLosslessRow(rowIndex))
+				reconstructRow(data.decodeBuffer[rowIndex].visibilities, rowIndex, prediction);
+		}
+		if(isStoredKeyFrame)
+		{
+			altthread::mutex::scoped_lock lock(_keyFrameMutex);
+			blockKeyFrame->buffer = data.decodeBuffer;
+			blockKeyFrame->isReady = true;
+			_keyFrameCondition.notify_all();
+		}
+		if(isErrorStatisticsEnabled())
+		{
+			StageTimer timer(data.stageCounters, ErrorStatisticsStage);
+			errors.blockCount = 1;
+			addErrors(errors, *buffer, data.decodeBuffer);
+			errors.maxBlockRMSError = errors.RMSError();
+			statistics().AddErrors(errors);
+		}
+	}
+}
+
+namespace {
+	/**
+	 * A value is clipped when it lies beyond the outermost quantization level.
+	 * A small tolerance prevents counting values that were scaled exactly onto that level.
+	 */
+	bool isClipped(float value, float decoded, TimeBlockEncoder::symbol_t symbol, TimeBlockEncoder::symbol_t maxSymbol)
+	{
+		const bool isOutside =
+			(symbol == 0 && value < decoded) ||
+			(symbol == maxSymbol && value > decoded);
+		return std::isfinite(value) && isOutside && std::fabs(value - decoded) > 1e-5 * std::fabs(decoded);
+	}
+	
+	void addError(DyscoErrorStatistics& errors, float original, float decoded)
+	{
+		if(std::isfinite(original) && std::isfinite(decoded))
+		{
+			const double error = double(original) - double(decoded);
+			++errors.valueCount;
+			errors.squaredErrorSum += error * error;
+			errors.squaredValueSum += double(original) * double(original);
+		}
+		else {
+			++errors.nonFiniteCount;
+		}
+	}
+}
+
+void DyscoDataColumn::decodeBlock(ThreadData& threadData, const TimeBlockBuffer<data_t>& original, const float* metaBuffer, const symbol_t* symbolBuffer, size_t nAntennae) const
+{
+	// The encoder of the thread is reused for decoding: encoding
+	// a block does not depend on the state that decoding leaves behind.
+	TimeBlockEncoder& encoder = *threadData.encoder;
+	const std::vector<TimeBlockBuffer<data_t>::DataRow>& rows = original.GetVector();
+	encoder.InitializeDecode(metaBuffer, rows.size(), nAntennae);
+	threadData.decodeBuffer.resize(rows.size());
+	for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
+	{
+		const TimeBlockBuffer<data_t>::DataRow& row = rows[rowIndex];
+		if(isLosslessRow(rowIndex))
+			threadData.decodeBuffer[rowIndex] = row;
+		else
+			encoder.Decode(*_gausEncoder, threadData.decodeBuffer, symbolBuffer, rowIndex, row.antenna1, row.antenna2);
+	}
+}
+
+uint64_t DyscoDataColumn::countClippedValues(const ThreadData& threadData, const TimeBlockBuffer<data_t>& encoded, const symbol_t* symbolBuffer) const
+{
+	const TimeBlockEncoder& encoder = *threadData.encoder;
+	const std::vector<TimeBlockBuffer<data_t>::DataRow>& rows = encoded.GetVector();
+	const size_t nPolarizations = shape()[0];
+	ao::uvector<symbol_t> maxSymbols(nPolarizations);
+	
+	uint64_t clippedCount = 0;
+	for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
+	{
+		const TimeBlockBuffer<data_t>::DataRow& row = rows[rowIndex];
+		const data_t* decoded = threadData.decodeBuffer.GetVector()[rowIndex].visibilities.data();
+		// All encoders store the real and imaginary symbols of a row in visibility order
+		const symbol_t* symbols = symbolBuffer + rowIndex * encoder.SymbolsPerRow();
+		for(size_t p=0; p!=nPolarizations; ++p)
+			maxSymbols[p] = symbolQuantizer(rowIndex, p).QuantizationCount() - 2;
+		for(size_t i=0; i!=row.visibilities.size(); ++i)
+		{
+			const symbol_t maxSymbol = maxSymbols[i % nPolarizations];
+			clippedCount += isClipped(row.visibilities[i].real(), decoded[i].real(), symbols[i*2], maxSymbol);
+			clippedCount += isClipped(row.visibilities[i].imag(), decoded[i].imag(), symbols[i*2+1], maxSymbol);
+		}
+	}
+	return clippedCount;
+}
+
+void DyscoDataColumn::addErrors(DyscoErrorStatistics& errors, const TimeBlockBuffer<data_t>& original, const TimeBlockBuffer<data_t>& reconstructed)
+{
+	const std::vector<TimeBlockBuffer<data_t>::DataRow>& rows = original.GetVector();
+	for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
+	{
+		const std::vector<data_t>& values = rows[rowIndex].visibilities;
+		const data_t* decoded = reconstructed.GetVector()[rowIndex].visibilities.data();
+		for(size_t i=0; i!=values.size(); ++i)
+		{
+			addError(errors, values[i].real(), decoded[i].real());
+			addError(errors, values[i].imag(), decoded[i].imag());
+		}
+	}
 }
 
 size_t DyscoDataColumn::metaDataFloatCount(size_t nRows, size_t nPolarizations, size_t nChannels, size_t nAntennae) const
 {
-	return _decoder->MetaDataCount(nRows, nPolarizations, nChannels, nAntennae);
+	return _decoder->MetaDataCount(nRows, nPolarizations, nChannels, nAntennae) +
+		_losslessBlockRows.size() * nPolarizations * nChannels * 2 /*complex*/ +
+		(_skipFlaggedData ? presenceWordCount(nRows, nChannels) : 0);
+}
+
+size_t DyscoDataColumn::presenceOffset(size_t nRowsInBlock) const
+{
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	return metaDataFloatCount(nRowsInBlock, nPolarizations, nChannels, nAntennae()) - presenceWordCount(nRowsInBlock, nChannels);
+}
+
+void DyscoDataColumn::storePresence(float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const
+{
+	const size_t nChannels = shape()[1], symbolsPerChannel = shape()[0] * 2;
+	// Non-finite values are encoded with the last symbol of the quantizer
+	const symbol_t nonFiniteSymbol = _gausEncoder->QuantizationCount() - 1;
+	ao::uvector<uint32_t> presence(presenceWordCount(nRowsInBlock, nChannels), 0);
+	for(size_t row=0; row!=nRowsInBlock; ++row)
+	{
+		for(size_t ch=0; ch!=nChannels; ++ch)
+		{
+			const symbol_t* channelSymbols = symbols + (row*nChannels + ch) * symbolsPerChannel;
+			for(size_t i=0; i!=symbolsPerChannel; ++i)
+			{
+				if(channelSymbols[i] != nonFiniteSymbol)
+				{
+					presence[row / 32] |= uint32_t(1) << (row % 32);
+					presence[(nRowsInBlock + ch) / 32] |= uint32_t(1) << ((nRowsInBlock + ch) % 32);
+					break;
+				}
+			}
+		}
+	}
+	// The bitmap is stored as integers, because not every bit pattern survives as a float value
+	memcpy(metaBuffer + presenceOffset(nRowsInBlock), presence.data(), presence.size() * sizeof(uint32_t));
+}
+
+void DyscoDataColumn::presentIndices(const float* metaBuffer, size_t nRowsInBlock, std::vector<size_t>& rows, std::vector<size_t>& channels) const
+{
+	const size_t nChannels = shape()[1];
+	ao::uvector<uint32_t> presence(presenceWordCount(nRowsInBlock, nChannels));
+	memcpy(presence.data(), metaBuffer + presenceOffset(nRowsInBlock), presence.size() * sizeof(uint32_t));
+	rows.clear();
+	for(size_t row=0; row!=nRowsInBlock; ++row)
+	{
+		if(isPresent(presence.data(), row))
+			rows.push_back(row);
+	}
+	channels.clear();
+	for(size_t ch=0; ch!=nChannels; ++ch)
+	{
+		if(isPresent(presence.data(), nRowsInBlock + ch))
+			channels.push_back(ch);
+	}
 }
 
 size_t DyscoDataColumn::symbolCount(size_t nRowsInBlock, size_t nPolarizations, size_t nChannels) const
@@ -97,6 +609,165 @@ size_t DyscoDataColumn::symbolCount(size_t nRowsInBlock, size_t nPolarizations,
 	return _decoder->SymbolCount(nRowsInBlock, nPolarizations, nChannels);
 }
 
+size_t DyscoDataColumn::packedRowSize() const
+{
+	const size_t nChannels = shape()[1];
+	size_t size = 0;
+	for(unsigned bitCount : _bitsPerPolarization)
+		size += BytePacker::bufferSize(nChannels*2, bitCount);
+	return size;
+}
+
+size_t DyscoDataColumn::packedSymbolSize(size_t nRowsInBlock) const
+{
+	if(!_bitsPerBlockRow.empty())
+	{
+		const size_t symbolsPerRow = _decoder->SymbolsPerRow();
+		size_t size = 0;
+		for(size_t row=0; row!=nRowsInBlock; ++row)
+			size += BytePacker::bufferSize(symbolsPerRow, _bitsPerBlockRow[row]);
+		return size;
+	}
+	else if(!_bitsPerPolarization.empty())
+		return nRowsInBlock * packedRowSize();
+	else
+		return ThreadedDyscoColumn::packedSymbolSize(nRowsInBlock);
+}
+
+size_t DyscoDataColumn::storedPackedSize(const float* metaBuffer, size_t nRowsInBlock) const
+{
+	if(!_skipFlaggedData)
+		return packedSymbolSize(nRowsInBlock);
+	std::vector<size_t> rows, channels;
+	presentIndices(metaBuffer, nRowsInBlock, rows, channels);
+	return BytePacker::bufferSize(rows.size() * channels.size() * shape()[0] * 2, getBitsPerSymbol());
+}
+
+void DyscoDataColumn::packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const
+{
+	if(!_bitsPerBlockRow.empty())
+	{
+		// Every row is a byte-aligned segment packed with the bit count of its row
+		const size_t symbolsPerRow = _decoder->SymbolsPerRow();
+		for(size_t row=0; row!=nRowsInBlock; ++row)
+		{
+			BytePacker::pack(_bitsPerBlockRow[row], dest, symbols + row*symbolsPerRow, symbolsPerRow);
+			dest += BytePacker::bufferSize(symbolsPerRow, _bitsPerBlockRow[row]);
+		}
+		return;
+	}
+	else if(_skipFlaggedData)
+	{
+		// The symbols of the present channels of the present rows are packed consecutively
+		const size_t nChannels = shape()[1], symbolsPerChannel = shape()[0] * 2;
+		std::vector<size_t> rows, channels;
+		presentIndices(metaBuffer, nRowsInBlock, rows, channels);
+		ao::uvector<symbol_t> presentSymbols(rows.size() * channels.size() * symbolsPerChannel);
+		symbol_t* presentSymbol = presentSymbols.data();
+		for(size_t row : rows)
+		{
+			for(size_t ch : channels)
+				presentSymbol = std::copy_n(symbols + (row*nChannels + ch) * symbolsPerChannel, symbolsPerChannel, presentSymbol);
+		}
+		BytePacker::pack(getBitsPerSymbol(), dest, presentSymbols.data(), presentSymbols.size());
+		return;
+	}
+	else if(_bitsPerPolarization.empty())
+	{
+		ThreadedDyscoColumn::packSymbols(dest, metaBuffer, symbols, nRowsInBlock);
+		return;
+	}
+	// Each row is stored as one byte-aligned segment per polarization, such that
+	// every segment can be packed with the bit count of its polarization and
+	// all rows have the same packed size.
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	ao::uvector<symbol_t> polarizationSymbols(nChannels*2);
+	for(size_t row=0; row!=nRowsInBlock; ++row)
+	{
+		for(size_t p=0; p!=nPolarizations; ++p)
+		{
+			for(size_t ch=0; ch!=nChannels; ++ch)
+			{
+				polarizationSymbols[ch*2] = symbols[(ch*nPolarizations + p)*2];
+				polarizationSymbols[ch*2+1] = symbols[(ch*nPolarizations + p)*2+1];
+			}
+			BytePacker::pack(_bitsPerPolarization[p], dest, polarizationSymbols.data(), nChannels*2);
+			dest += BytePacker::bufferSize(nChannels*2, _bitsPerPolarization[p]);
+		}
+		symbols += nChannels*nPolarizations*2;
+	}
+}
+
+void DyscoDataColumn::unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const
+{
+	if(!_bitsPerBlockRow.empty())
+	{
+		const size_t symbolsPerRow = _decoder->SymbolsPerRow();
+		for(size_t row=0; row!=nRowsInBlock; ++row)
+		{
+			BytePacker::unpack(_bitsPerBlockRow[row], symbols + row*symbolsPerRow, packed, symbolsPerRow);
+			packed += BytePacker::bufferSize(symbolsPerRow, _bitsPerBlockRow[row]);
+		}
+		return;
+	}
+	else if(_skipFlaggedData)
+	{
+		const size_t nChannels = shape()[1], symbolsPerChannel = shape()[0] * 2;
+		const symbol_t nonFiniteSymbol = _gausEncoder->QuantizationCount() - 1;
+		std::vector<size_t> rows, channels;
+		presentIndices(metaBuffer, nRowsInBlock, rows, channels);
+		std::vector<bool> isChannelPresent(nChannels, false);
+		for(size_t ch : channels)
+			isChannelPresent[ch] = true;
+		size_t presentEnd = rows.size() * channels.size() * symbolsPerChannel;
+		BytePacker::unpack(getBitsPerSymbol(), symbols, packed, presentEnd);
+		// The present symbols are moved to their place from the back, such that no symbol is
+		// overwritten before it is moved. Missing rows are left alone, because they are not decoded.
+		std::vector<size_t>::const_reverse_iterator row = rows.rbegin();
+		for(size_t ch=nChannels; row!=rows.rend(); )
+		{
+			--ch;
+			symbol_t* channelSymbols = symbols + (*row*nChannels + ch) * symbolsPerChannel;
+			if(isChannelPresent[ch])
+			{
+				presentEnd -= symbolsPerChannel;
+				if(symbols + presentEnd != channelSymbols)
+					std::copy_backward(symbols + presentEnd, symbols + presentEnd + symbolsPerChannel, channelSymbols + symbolsPerChannel);
+			}
+			else {
+				std::fill_n(channelSymbols, symbolsPerChannel, nonFiniteSymbol);
+			}
+			if(ch == 0)
+			{
+				ch = nChannels;
+				++row;
+			}
+		}
+		return;
+	}
+	else if(_bitsPerPolarization.empty())
+	{
+		ThreadedDyscoColumn::unpackSymbols(symbols, metaBuffer, packed, nRowsInBlock);
+		return;
+	}
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	ao::uvector<symbol_t> polarizationSymbols(nChannels*2);
+	for(size_t row=0; row!=nRowsInBlock; ++row)
+	{
+		for(size_t p=0; p!=nPolarizations; ++p)
+		{
+			BytePacker::unpack(_bitsPerPolarization[p], polarizationSymbols.data(), packed, nChannels*2);
+			packed += BytePacker::bufferSize(nChannels*2, _bitsPerPolarization[p]);
+			for(size_t ch=0; ch!=nChannels; ++ch)
+			{
+				symbols[(ch*nPolarizations + p)*2] = polarizationSymbols[ch*2];
+				symbols[(ch*nPolarizations + p)*2+1] = polarizationSymbols[ch*2+1];
+			}
+		}
+		symbols += nChannels*nPolarizations*2;
+	}
+}
+
 size_t DyscoDataColumn::defaultThreadCount() const
 {
 	if(!_randomize)
@@ -4,8 +4,15 @@
 #include "threadeddyscocolumn.h"
 
 #include "stochasticencoder.h"
+#include "thread.h"
 #include "timeblockencoder.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+
 namespace dyscostman {
 
 class DyscoStMan;
@@ -21,10 +28,14 @@ public:
 	 * Create a new column. Internally called by DyscoStMan when creating a
 	 * new column.
 	 */
-  DyscoDataColumn(DyscoStMan* parent, int dtype) :
-		ThreadedDyscoColumn(parent, dtype),
+  DyscoDataColumn(DyscoStMan* parent, const std::string& name, int dtype) :
+		ThreadedDyscoColumn(parent, name, dtype),
 		_rnd(std::random_device{}()),
 		_gausEncoder(),
+		_losslessDecodeValues(nullptr),
+		_predictionInterval(0),
+		_stokesTransform(false),
+		_skipFlaggedData(false),
 		_distribution(GaussianDistribution),
 		_normalization(RFNormalization),
 		_randomize(true)
@@ -39,6 +50,78 @@ public:
 	
 	virtual void Prepare(DyscoDistribution distribution, DyscoNormalization normalization, double studentsTNu, double distributionTruncation) override;
 	
+	/**
+	 * Quantize every polarization with its own number of bits. Should only
+	 * be called by DyscoStMan, before Prepare().
+	 * @param bitsPerPolarization The bit count of each polarization index, or
+	 * an empty vector to use the bits per symbol for all polarizations.
+	 */
+	void SetBitsPerPolarization(const std::vector<unsigned>& bitsPerPolarization)
+	{
+		_bitsPerPolarization = bitsPerPolarization;
+	}
+	
+	/**
+	 * Quantize every row of a block with its own number of bits. Should only be
+	 * called by DyscoStMan, after Prepare() and once the number of rows per block
+	 * is known.
+	 * @param bitsPerBlockRow The bit count of each row index within a block, or
+	 * an empty vector to use the same bit count for all rows.
+	 */
+	void SetBitsPerBlockRow(const std::vector<unsigned>& bitsPerBlockRow);
+	
+	/**
+	 * Store the given rows of every block without loss. Their values are stored as floats
+	 * after the metadata of the encoder, and are excluded from the quantization of the other
+	 * rows. Should only be called by DyscoStMan, before the block size is calculated.
+	 * @param blockRows Sorted row indices within a block, e.g. of the autocorrelations.
+	 */
+	void SetLosslessBlockRows(const std::vector<uint32_t>& blockRows)
+	{
+		_losslessBlockRows = blockRows;
+	}
+	
+	/**
+	 * Encode blocks as the difference with a keyframe. Every interval'th block is a
+	 * keyframe that is encoded as usual; the blocks that follow it are predicted by the
+	 * decoded keyframe, and only the residual is quantized. Blocks of a group are
+	 * encoded in parallel once their keyframe is encoded, and reading a block requires
+	 * at most reading its keyframe as well. A keyframe should not be rewritten
+	 * without rewriting the blocks that follow it. Should only be called by DyscoStMan,
+	 * before Prepare().
+	 * @param interval Number of blocks per keyframe, or 0 or 1 to encode every block by itself.
+	 */
+	void SetPredictionInterval(size_t interval)
+	{
+		_predictionInterval = interval;
+	}
+	
+	/**
+	 * Quantize the half sums and differences of the four correlations, i.e. (XX+YY)/2,
+	 * (XX-YY)/2, (XY+YX)/2 and (XY-YX)/2, instead of the correlations themselves. For
+	 * linear feeds, these are I, Q, U and iV; for circular feeds I, V, Q and iU. Polarized
+	 * emission is usually weak, so the last three need fewer bits. The bit counts per polarization
+	 * apply to these products in this order. When one of the correlations of a product is not
+	 * finite, both correlations of the product become non-finite. Requires four polarizations.
+	 * Should only be called by DyscoStMan, before Prepare().
+	 */
+	void SetStokesTransform(bool stokesTransform)
+	{
+		_stokesTransform = stokesTransform;
+	}
+	
+	/**
+	 * Only store the symbols of the rows and channels of a block that have a finite
+	 * value. A bitmap of the present rows and channels is stored after the other
+	 * metadata, and the symbols of the present rows and channels are packed
+	 * consecutively. Requires the same bit count for all symbols. Should only be
+	 * called by DyscoStMan, before Prepare().
+	 */
+	void SetSkipFlaggedData(bool skipFlaggedData)
+	{
+		_skipFlaggedData = skipFlaggedData;
+	}
+	
 	void SetStaticRandomizationSeed()
 	{
 		std::cout << "Warning: Initializing random number generator with static seed!\n";
@@ -51,33 +134,225 @@ protected:
 	
 	virtual void decode(TimeBlockBuffer<data_t>* buffer, const symbol_t* data, size_t blockRow, size_t a1, size_t a2) final override;
 	
-	virtual void initializeEncodeThread(void** threadData) final override;
+	virtual void initializeEncodeThread(void** threadData, StageCounters* stageCounters) final override;
 	
 	virtual void destructEncodeThread(void* threadData) final override;
 	
-	virtual void encode(void* threadData, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae) final override;
+	virtual void encode(void* threadData, size_t blockIndex, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae) final override;
+	
+	virtual void prepareLoadBlock(size_t blockIndex) final override;
+	
+	virtual void prepareStoreBlock(size_t blockIndex) final override;
+	
+	virtual void afterStoreBlock(size_t blockIndex) final override;
 	
 	virtual size_t metaDataFloatCount(size_t nRow, size_t nPolarizations, size_t nChannels, size_t nAntennae) const final override;
 	
 	virtual size_t symbolCount(size_t nRowsInBlock, size_t nPolarizations, size_t nChannels) const final override;
 	
+	virtual size_t packedSymbolSize(size_t nRowsInBlock) const final override;
+	
+	virtual size_t storedPackedSize(const float* metaBuffer, size_t nRowsInBlock) const final override;
+	
+	virtual bool isStoredSizeVariable() const final override { return _skipFlaggedData; }
+	
+	virtual void packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const final override;
+	
+	virtual void unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const final override;
+	
 	virtual size_t defaultThreadCount() const final override;
+	
+	/** Channels that a row does not have are NaN, such that they are not stored when flagged data is skipped. */
+	virtual data_t paddingValue() const final override
+	{
+		return data_t(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN());
+	}
 private:
 	struct ThreadData
 	{
-		ThreadData(TimeBlockEncoder* encoder_) :
-			encoder(encoder_)
+		ThreadData(TimeBlockEncoder* encoder_, StageCounters* stageCounters_, size_t nPolarizations, size_t nChannels) :
+			encoder(encoder_),
+			stageCounters(stageCounters_),
+			decodeBuffer(nPolarizations, nChannels),
+			preparedBuffer(nPolarizations, nChannels)
 			{ }
 		std::unique_ptr<TimeBlockEncoder> encoder;
 		std::mt19937 rnd;
+		StageCounters* stageCounters;
+		// Used to decode the encoded block again when measuring the error
+		TimeBlockBuffer<data_t> decodeBuffer;
+		// The block after subtracting its keyframe and the Stokes transform
+		TimeBlockBuffer<data_t> preparedBuffer;
+	};
+	
+	/** Decoded values of a keyframe, which are filled in by the encoding thread of the keyframe. */
+	struct KeyFrame
+	{
+		KeyFrame(size_t nPolarizations, size_t nChannels) :
+			buffer(nPolarizations, nChannels), isReady(false)
+			{ }
+		TimeBlockBuffer<data_t> buffer;
+		bool isReady;
 	};
 	
+	/**
+	 * Decode an encoded block into the decode buffer of the thread. The lossless rows
+	 * are taken from the original.
+	 */
+	void decodeBlock(ThreadData& threadData, const TimeBlockBuffer<data_t>& original, const float* metaBuffer, const symbol_t* symbolBuffer, size_t nAntennae) const;
+	
+	/**
+	 * Count the values of an encoded block that lie outside the range of the quantizer,
+	 * using the decode buffer of the thread before the block is reconstructed.
+	 */
+	uint64_t countClippedValues(const ThreadData& threadData, const TimeBlockBuffer<data_t>& encoded, const symbol_t* symbolBuffer) const;
+	
+	/**
+	 * Add the errors of the reconstructed values of a block relative to the values
+	 * that were written.
+	 */
+	static void addErrors(DyscoErrorStatistics& errors, const TimeBlockBuffer<data_t>& original, const TimeBlockBuffer<data_t>& reconstructed);
+	
+	StochasticEncoder<float>* createQuantizer(unsigned bitCount, double rms) const;
+	
+	/**
+	 * Get a quantizer with the given bit count that has the same maximum as
+	 * _gausEncoder, such that it can be used with the normalization of the encoders.
+	 */
+	const StochasticEncoder<float>* scaledQuantizer(unsigned bitCount);
+	
+	void preparePolarizationQuantizers();
+	
+	void prepareRowQuantizers();
+	
+	const StochasticEncoder<float>& symbolQuantizer(size_t blockRow, size_t polarization) const
+	{
+		if(!_rowQuantizers.empty())
+			return *_rowQuantizers[blockRow];
+		else if(!_polarizationQuantizers.empty())
+			return *_polarizationQuantizers[polarization];
+		else
+			return *_gausEncoder;
+	}
+	
+	bool isKeyFrame(size_t blockIndex) const
+	{
+		return _predictionInterval <= 1 || blockIndex % _predictionInterval == 0;
+	}
+	
+	/**
+	 * Get the keyframe with the given block index. When it was not stored since the
+	 * column was opened, it is read from the file. Should only be called by the reading
+	 * or writing thread.
+	 */
+	std::shared_ptr<KeyFrame> keyFrame(size_t blockIndex);
+	
+	void waitForKeyFrame(const KeyFrame& keyFrame);
+	
+	/**
+	 * Decode the blocks that were predicted from the stored version of a keyframe that
+	 * is rewritten, such that afterStoreBlock() encodes them again with the new keyframe.
+	 */
+	void decodeDependentBlocks(size_t keyFrameIndex);
+	
+	/** Subtract the predicted values of the lossy rows. */
+	void subtractPrediction(TimeBlockBuffer<data_t>& buffer, const TimeBlockBuffer<data_t>& prediction) const;
+	
+	/**
+	 * Turn the decoded values of a lossy row back into visibilities, by undoing the
+	 * Stokes transform and adding the prediction, if any.
+	 */
+	void reconstructRow(std::vector<data_t>& values, size_t blockRow, const TimeBlockBuffer<data_t>* prediction) const;
+	
+	/** Apply the Stokes transform to the lossy rows. */
+	void stokesTransform(TimeBlockBuffer<data_t>& buffer) const;
+	
+	static void inverseStokesTransform(data_t* values, size_t nChannels)
+	{
+		for(size_t ch=0; ch!=nChannels; ++ch)
+		{
+			data_t* products = values + ch*4;
+			const data_t sumXXYY = products[0], diffXXYY = products[1], sumXYYX = products[2], diffXYYX = products[3];
+			products[0] = sumXXYY + diffXXYY;
+			products[1] = sumXYYX + diffXYYX;
+			products[2] = sumXYYX - diffXYYX;
+			products[3] = sumXXYY - diffXXYY;
+		}
+	}
+	
+	/** A non-finite value in a keyframe predicts zero. */
+	static data_t predictedValue(const data_t& keyFrameValue)
+	{
+		return (std::isfinite(keyFrameValue.real()) && std::isfinite(keyFrameValue.imag())) ? keyFrameValue : data_t(0.0, 0.0);
+	}
+	
+	bool isLosslessRow(size_t blockRow) const
+	{
+		return std::binary_search(_losslessBlockRows.begin(), _losslessBlockRows.end(), blockRow);
+	}
+	
+	/**
+	 * Copy the lossless rows of the buffer to the given values and replace them by NaNs,
+	 * such that the encoder does not take them into account.
+	 */
+	void extractLosslessRows(TimeBlockBuffer<data_t>& buffer, float* values) const;
+	
+	/** Put the values that were extracted by extractLosslessRows() back into the buffer. */
+	void restoreLosslessRows(TimeBlockBuffer<data_t>& buffer, const float* values) const;
+	
+	static size_t presenceWordCount(size_t nRowsInBlock, size_t nChannels)
+	{
+		return (nRowsInBlock + nChannels + 31) / 32;
+	}
+	
+	/** Index of the first presence word within the metadata of a block. */
+	size_t presenceOffset(size_t nRowsInBlock) const;
+	
+	static bool isPresent(const uint32_t* presence, size_t index)
+	{
+		return (presence[index / 32] >> (index % 32)) & 1;
+	}
+	
+	/**
+	 * Store the bitmap of rows and channels that have at least one finite value in
+	 * the metadata. The bits of the rows are followed by the bits of the channels.
+	 */
+	void storePresence(float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const;
+	
+	/** Get the indices of the rows and channels that are present in a block. */
+	void presentIndices(const float* metaBuffer, size_t nRowsInBlock, std::vector<size_t>& rows, std::vector<size_t>& channels) const;
+	
+	/** Size of the packed symbols of one row when using bit counts per polarization. */
+	size_t packedRowSize() const;
+	
 	std::mt19937 _rnd;
 	std::unique_ptr<StochasticEncoder<float>> _gausEncoder;
+	std::vector<unsigned> _bitsPerPolarization, _bitsPerBlockRow;
+	std::map<unsigned, std::unique_ptr<StochasticEncoder<float>>> _scaledQuantizers;
+	std::vector<const StochasticEncoder<float>*> _polarizationQuantizers, _rowQuantizers;
+	std::vector<uint32_t> _losslessBlockRows;
+	// Lossless values of the block that is decoded, pointing into its metadata
+	const float* _losslessDecodeValues;
+	size_t _predictionInterval;
+	bool _stokesTransform;
+	bool _skipFlaggedData;
+	// Presence bitmap of the block that is decoded
+	ao::uvector<uint32_t> _decodePresence;
+	// Recently used keyframes by block index; only used by the reading and writing thread
+	std::map<size_t, std::shared_ptr<KeyFrame>> _keyFrames;
+	// The keyframe of every block in the write cache, by block index
+	std::map<size_t, std::shared_ptr<KeyFrame>> _storedKeyFrames;
+	// Keyframe of the block that is decoded, or nullptr for a keyframe
+	std::shared_ptr<const KeyFrame> _decodeKeyFrame;
+	// Blocks that are encoded again after their keyframe is rewritten, and the new keyframe
+	std::vector<std::pair<size_t, std::unique_ptr<TimeBlockBuffer<data_t>>>> _dependentBlocks;
+	std::shared_ptr<KeyFrame> _dependentKeyFrame;
+	altthread::mutex _keyFrameMutex;
+	altthread::condition _keyFrameCondition;
 	std::unique_ptr<TimeBlockEncoder> _decoder;
 	DyscoDistribution _distribution;
 	DyscoNormalization _normalization;
-	double _studentsTNu;
+	double _studentsTNu, _distributionTruncation;
 	bool _randomize;
 };
 
@@ -0,0 +1,77 @@
+#include "dyscoflagcolumn.h"
+#include "dyscostmanerror.h"
+
+#include <cmath>
+
+namespace dyscostman {
+
+void DyscoFlagColumn::Prepare(DyscoDistribution distribution, DyscoNormalization normalization, double studentsTNu, double distributionTruncation)
+{
+	ThreadedDyscoColumn::Prepare(distribution, normalization, studentsTNu, distributionTruncation);
+	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
+	_encoder.reset(new FlagBlockEncoder(nPolarizations, nChannels));
+	if(IsDerived())
+	{
+		// Columns without a fixed shape all have the maximum shape of the manager
+		const bool isShapeEqual = IsVariableShape() ? _dataColumn->IsVariableShape() :
+			(!_dataColumn->IsVariableShape() && _dataColumn->shape(0).isEqual(shape()));
+		if(!isShapeEqual)
+			throw DyscoStManError("Column " + Name() + " can not be derived from column " + _dataColumn->Name() + ", because their shapes differ");
+	}
+}
+
+void DyscoFlagColumn::InitializeAfterNRowsPerBlockIsKnown()
+{
+	// Derived flags take no space in the blocks and need no encoding threads
+	if(!IsDerived())
+		ThreadedDyscoColumn::InitializeAfterNRowsPerBlockIsKnown();
+}
+
+void DyscoFlagColumn::getArrayBoolV(casacore::uInt rowNr, casacore::Array<casacore::Bool>* dataPtr)
+{
+	if(!IsDerived())
+	{
+		ThreadedDyscoColumn::getArrayBoolV(rowNr, dataPtr);
+		return;
+	}
+	// When the data of this row was just read, its block is still decoded in the
+	// data column, and the flags are derived without reading or decoding again.
+	if(!_derivedDataBuffer.shape().isEqual(dataPtr->shape()))
+		_derivedDataBuffer.resize(dataPtr->shape());
+	_dataColumn->getArrayComplexV(rowNr, &_derivedDataBuffer);
+	const casacore::Complex* data = _derivedDataBuffer.data();
+	casacore::Bool* flags = dataPtr->data();
+	const size_t n = dataPtr->nelements();
+	for(size_t i=0; i!=n; ++i)
+		flags[i] = !(std::isfinite(data[i].real()) && std::isfinite(data[i].imag()));
+}
+
+void DyscoFlagColumn::putArrayBoolV(casacore::uInt rowNr, const casacore::Array<casacore::Bool>* dataPtr)
+{
+	if(IsDerived())
+		throw DyscoStManError("Column " + Name() + " is derived from the non-finite values of column " + _dataColumn->Name() + " and can not be written");
+	ThreadedDyscoColumn::putArrayBoolV(rowNr, dataPtr);
+}
+
+void DyscoFlagColumn::decode(TimeBlockBuffer<data_t>* buffer, const symbol_t* data, size_t blockRow, size_t a1, size_t a2)
+{
+	_encoder->Decode(*buffer, data, blockRow);
+}
+
+void DyscoFlagColumn::encode(void* threadData, size_t blockIndex, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae)
+{
+	StageTimer timer(static_cast<StageCounters*>(threadData), QuantizationStage);
+	_encoder->Encode(*buffer, metaBuffer, symbolBuffer);
+}
+
+void DyscoFlagColumn::packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const
+{
+	_encoder->Pack(dest, metaBuffer, symbols, nRowsInBlock);
+}
+
+void DyscoFlagColumn::unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const
+{
+	_encoder->Unpack(symbols, metaBuffer, packed, nRowsInBlock);
+}
+
+}
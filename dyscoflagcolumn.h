@@ -0,0 +1,112 @@
+#ifndef DYSCO_FLAG_COLUMN_H
+#define DYSCO_FLAG_COLUMN_H
+
+#include "threadeddyscocolumn.h"
+#include "flagblockencoder.h"
+
+namespace dyscostman {
+
+class DyscoStMan;
+
+/**
+ * A column for storing boolean values, such as the FLAG column, without loss.
+ * Flags are stored as a bitmap or as run lengths, and blocks without any
+ * or with only flagged values take no space besides their metadata.
+ * 
+ * Alternatively, the flags can be derived from a data column of the same
+ * manager, in which case a value is flagged when the corresponding visibility
+ * is not finite. Nothing is stored in that case, and the column is read only.
+ */
+class DyscoFlagColumn : public ThreadedDyscoColumn<bool>
+{
+public:
+	/**
+	 * Create a new column. Internally called by DyscoStMan when creating a
+	 * new column.
+	 */
+  DyscoFlagColumn(DyscoStMan* parent, const std::string& name, int dtype) :
+		ThreadedDyscoColumn(parent, name, dtype),
+		_dataColumn(nullptr)
+	{
+		// The bitmap stores one bit per flag
+		SetBitsPerSymbol(1);
+	}
+  
+	DyscoFlagColumn(const DyscoFlagColumn &source) = delete;
+	
+	void operator=(const DyscoFlagColumn &source) = delete;
+	
+  /** Destructor. */
+  virtual ~DyscoFlagColumn() { shutdown(); }
+	
+	virtual void Prepare(DyscoDistribution distribution, DyscoNormalization normalization, double studentsTNu, double distributionTruncation) override;
+	
+	virtual void InitializeAfterNRowsPerBlockIsKnown() final override;
+	
+	/**
+	 * Derive the flags from the given data column instead of storing them.
+	 * Should only be called by DyscoStMan, before Prepare().
+	 * @param dataColumn Column with the same shape, or nullptr to store the flags.
+	 */
+	void SetDerivedFrom(DyscoStManColumn* dataColumn) { _dataColumn = dataColumn; }
+	
+	/** Whether the flags are derived from a data column. */
+	bool IsDerived() const { return _dataColumn != nullptr; }
+	
+	virtual casacore::Bool isWritable() const final override { return !IsDerived(); }
+	
+	virtual void getArrayBoolV(casacore::uInt rowNr, casacore::Array<casacore::Bool>* dataPtr) final override;
+	
+	virtual void putArrayBoolV(casacore::uInt rowNr, const casacore::Array<casacore::Bool>* dataPtr) final override;
+	
+protected:
+	virtual void initializeDecode(TimeBlockBuffer<data_t>* buffer, const float* metaBuffer, size_t nRow, size_t nAntennae) final override
+	{ }
+	
+	virtual void decode(TimeBlockBuffer<data_t>* buffer, const symbol_t* data, size_t blockRow, size_t a1, size_t a2) final override;
+	
+	virtual void initializeEncodeThread(void** threadData, StageCounters* stageCounters) final override
+	{
+		*threadData = stageCounters;
+	}
+	
+	virtual void destructEncodeThread(void* threadData) final override
+	{ }
+	
+	virtual void encode(void* threadData, size_t blockIndex, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae) final override;
+	
+	virtual size_t metaDataFloatCount(size_t nRows, size_t nPolarizations, size_t nChannels, size_t nAntennae) const final override
+	{
+		return IsDerived() ? 0 : _encoder->MetaDataFloatCount();
+	}
+	
+	virtual size_t symbolCount(size_t nRowsInBlock, size_t nPolarizations, size_t nChannels) const final override
+	{
+		return _encoder->SymbolCount(nRowsInBlock);
+	}
+	
+	virtual size_t packedSymbolSize(size_t nRowsInBlock) const final override
+	{
+		return IsDerived() ? 0 : _encoder->PackedSize(nRowsInBlock);
+	}
+	
+	virtual size_t storedPackedSize(const float* metaBuffer, size_t nRowsInBlock) const final override
+	{
+		return _encoder->StoredPackedSize(metaBuffer);
+	}
+	
+	virtual bool isStoredSizeVariable() const final override { return true; }
+	
+	virtual void packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const final override;
+	
+	virtual void unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const final override;
+	
+private:
+	std::unique_ptr<FlagBlockEncoder> _encoder;
+	DyscoStManColumn* _dataColumn;
+	casacore::Array<casacore::Complex> _derivedDataBuffer;
+};
+
+} // end of namespace
+
+#endif
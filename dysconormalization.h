@@ -3,7 +3,9 @@
 
 namespace dyscostman {
 	enum DyscoNormalization {
-		AFNormalization, RFNormalization, RowNormalization
+		AFNormalization, RFNormalization, RowNormalization,
+		/** Select the normalization with the smallest error for every block */
+		AutoNormalization
 	};
 }
 
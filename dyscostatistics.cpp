@@ -0,0 +1,111 @@
+#include "dyscostatistics.h"
+
+#include <iomanip>
+
+namespace dyscostman {
+
+const char* DyscoTimings::StageName(DyscoStage stage)
+{
+	switch(stage)
+	{
+		case CacheWaitStage: return "writer waiting for cache";
+		case NormalizationStage: return "normalization";
+		case FitToMaximumStage: return "fit to maximum";
+		case QuantizationStage: return "quantization";
+		case PackingStage: return "packing";
+		case WriteIOStage: return "write I/O";
+		case ReadIOStage: return "read I/O";
+		case UnpackingStage: return "unpacking";
+		case DecodeStage: return "decoding";
+		case ErrorStatisticsStage: return "error statistics";
+		case ReaderWaitStage: return "reader waiting for block";
+		case EncoderIdleStage: return "encoder idle";
+		case StageCount: break;
+	}
+	return "?";
+}
+
+void DyscoTimings::Print(std::ostream& stream) const
+{
+	std::ios_base::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+	for(size_t i=0; i!=StageCount; ++i)
+	{
+		stream << "  " << std::left << std::setw(24) << StageName(DyscoStage(i)) << std::right
+			<< std::fixed << std::setprecision(3) << std::setw(10) << seconds[i] << " s"
+			<< " (" << counts[i] << " times)\n";
+	}
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+const char* DyscoMemoryUsage::CategoryName(DyscoMemoryCategory category)
+{
+	switch(category)
+	{
+		case WriteCacheMemory: return "write cache";
+		case DecodedBlockMemory: return "decoded block";
+		case PackedReadBufferMemory: return "packed read buffer";
+		case UnpackedReadBufferMemory: return "unpacked read buffer";
+		case EncodeBufferMemory: return "encode buffers";
+		case MemoryCategoryCount: break;
+	}
+	return "?";
+}
+
+void DyscoMemoryUsage::Print(std::ostream& stream) const
+{
+	std::ios_base::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+	stream << std::fixed << std::setprecision(1);
+	for(size_t i=0; i!=MemoryCategoryCount; ++i)
+	{
+		stream << "  " << std::left << std::setw(24) << CategoryName(DyscoMemoryCategory(i)) << std::right
+			<< std::setw(10) << current[i] / (1024.0*1024.0) << " MB (peak "
+			<< peak[i] / (1024.0*1024.0) << " MB)\n";
+	}
+	stream << "  " << std::left << std::setw(24) << "total" << std::right
+		<< std::setw(10) << totalCurrent / (1024.0*1024.0) << " MB (peak "
+		<< totalPeak / (1024.0*1024.0) << " MB)\n";
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+void DyscoErrorStatistics::Print(std::ostream& stream) const
+{
+	stream
+		<< "  blocks                  " << blockCount << '\n'
+		<< "  RMS error               " << RMSError() << " (" << RelativeRMSError() << " relative)\n"
+		<< "  worst block RMS error   " << maxBlockRMSError << '\n'
+		<< "  clipped values          " << clippedCount << " (" << ClippedFraction()*100.0 << "%)\n"
+		<< "  non-finite values       " << nonFiniteCount << '\n';
+}
+
+void DyscoStatistics::PrintCacheOccupancy(std::ostream& stream, const std::vector<uint64_t>& histogram)
+{
+	uint64_t total = 0;
+	for(uint64_t count : histogram)
+		total += count;
+	for(size_t i=0; i!=histogram.size(); ++i)
+	{
+		if(histogram[i] != 0)
+			stream << "  " << i << " block(s) in cache: " << histogram[i] << " times (" << (100.0*histogram[i]/total) << "%)\n";
+	}
+}
+
+DyscoTimings DyscoStatistics::Timings() const
+{
+	altthread::mutex::scoped_lock lock(_mutex);
+	DyscoTimings timings;
+	for(const std::unique_ptr<StageCounters>& counters : _threadCounters)
+	{
+		for(size_t i=0; i!=StageCount; ++i)
+		{
+			timings.seconds[i] += double(counters->Nanoseconds(DyscoStage(i))) * 1e-9;
+			timings.counts[i] += counters->Count(DyscoStage(i));
+		}
+	}
+	return timings;
+}
+
+} // end of namespace
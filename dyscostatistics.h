@@ -0,0 +1,411 @@
+#ifndef DYSCO_STATISTICS_H
+#define DYSCO_STATISTICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <stdint.h>
+
+#include "thread.h"
+
+namespace dyscostman {
+
+/**
+ * Stages of the encoding and decoding pipelines that are timed. The waiting
+ * stages (CacheWaitStage, ReaderWaitStage and EncoderIdleStage) are only
+ * counted when the thread actually blocks, so their count is the number
+ * of times that the thread had to wait.
+ */
+enum DyscoStage {
+	CacheWaitStage, NormalizationStage, FitToMaximumStage, QuantizationStage,
+	PackingStage, WriteIOStage, ReadIOStage, UnpackingStage, DecodeStage,
+	ErrorStatisticsStage, ReaderWaitStage, EncoderIdleStage, StageCount
+};
+
+/**
+ * Accumulates the time spent in each stage by a single thread. Every thread
+ * gets its own instance, so the counters are never written concurrently and
+ * updating them costs no more than a relaxed load and store. They are atomic
+ * only so that they can be read safely while the thread is still running.
+ */
+class StageCounters
+{
+public:
+	StageCounters()
+	{
+		for(size_t i=0; i!=StageCount; ++i)
+		{
+			_nanoseconds[i].store(0, std::memory_order_relaxed);
+			_counts[i].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	StageCounters(const StageCounters&) = delete;
+	void operator=(const StageCounters&) = delete;
+
+	/**
+	 * Add a measurement. May only be called by the thread that owns these counters.
+	 */
+	void Add(DyscoStage stage, uint64_t nanoseconds)
+	{
+		_nanoseconds[stage].store(_nanoseconds[stage].load(std::memory_order_relaxed) + nanoseconds, std::memory_order_relaxed);
+		_counts[stage].store(_counts[stage].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	uint64_t Nanoseconds(DyscoStage stage) const { return _nanoseconds[stage].load(std::memory_order_relaxed); }
+
+	uint64_t Count(DyscoStage stage) const { return _counts[stage].load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> _nanoseconds[StageCount];
+	std::atomic<uint64_t> _counts[StageCount];
+};
+
+/**
+ * Measures the time until it is destructed (or until the next stage is
+ * started) and adds it to a StageCounters object. When constructed with
+ * a null pointer, nothing is measured.
+ */
+class StageTimer
+{
+public:
+	StageTimer(StageCounters* counters, DyscoStage stage) :
+		_counters(counters), _stage(stage)
+	{
+		if(_counters)
+			_start = std::chrono::steady_clock::now();
+	}
+
+	~StageTimer() { Stop(); }
+
+	StageTimer(const StageTimer&) = delete;
+	void operator=(const StageTimer&) = delete;
+
+	/** Finish the current stage and start timing the given stage. */
+	void Switch(DyscoStage stage)
+	{
+		if(_counters)
+		{
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			_counters->Add(_stage, std::chrono::duration_cast<std::chrono::nanoseconds>(now - _start).count());
+			_start = now;
+		}
+		_stage = stage;
+	}
+
+	/** Finish the current stage; further calls to Stop() do nothing. */
+	void Stop()
+	{
+		if(_counters)
+		{
+			_counters->Add(_stage, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count());
+			_counters = nullptr;
+		}
+	}
+
+private:
+	StageCounters* _counters;
+	DyscoStage _stage;
+	std::chrono::steady_clock::time_point _start;
+};
+
+/**
+ * Total time spent per stage, merged over threads and possibly over
+ * columns.
+ */
+struct DyscoTimings
+{
+	DyscoTimings()
+	{
+		for(size_t i=0; i!=StageCount; ++i)
+		{
+			seconds[i] = 0.0;
+			counts[i] = 0;
+		}
+	}
+
+	double seconds[StageCount];
+	uint64_t counts[StageCount];
+
+	DyscoTimings& operator+=(const DyscoTimings& rhs)
+	{
+		for(size_t i=0; i!=StageCount; ++i)
+		{
+			seconds[i] += rhs.seconds[i];
+			counts[i] += rhs.counts[i];
+		}
+		return *this;
+	}
+
+	static const char* StageName(DyscoStage stage);
+
+	/** Write a human readable table of the timings to the stream. */
+	void Print(std::ostream& stream) const;
+};
+
+/**
+ * Categories of memory that are allocated by a column.
+ */
+enum DyscoMemoryCategory {
+	WriteCacheMemory, DecodedBlockMemory, PackedReadBufferMemory,
+	UnpackedReadBufferMemory, EncodeBufferMemory, MemoryCategoryCount
+};
+
+/**
+ * Number of bytes that are allocated per category, currently and at the peak.
+ */
+struct DyscoMemoryUsage
+{
+	DyscoMemoryUsage() : totalCurrent(0), totalPeak(0)
+	{
+		for(size_t i=0; i!=MemoryCategoryCount; ++i)
+		{
+			current[i] = 0;
+			peak[i] = 0;
+		}
+	}
+
+	uint64_t current[MemoryCategoryCount];
+	uint64_t peak[MemoryCategoryCount];
+	uint64_t totalCurrent, totalPeak;
+
+	/**
+	 * Add the usage of another column. The peaks of different columns
+	 * are not necessarily reached at the same time, so the added peaks
+	 * are an upper bound of the combined peak.
+	 */
+	DyscoMemoryUsage& operator+=(const DyscoMemoryUsage& rhs)
+	{
+		for(size_t i=0; i!=MemoryCategoryCount; ++i)
+		{
+			current[i] += rhs.current[i];
+			peak[i] += rhs.peak[i];
+		}
+		totalCurrent += rhs.totalCurrent;
+		totalPeak += rhs.totalPeak;
+		return *this;
+	}
+
+	static const char* CategoryName(DyscoMemoryCategory category);
+
+	/** Write a human readable table of the memory usage to the stream. */
+	void Print(std::ostream& stream) const;
+};
+
+/**
+ * Keeps track of the memory allocated by a column. Allocations can be
+ * registered by any thread.
+ */
+class MemoryCounters
+{
+public:
+	MemoryCounters()
+	{
+		for(size_t i=0; i!=MemoryCategoryCount; ++i)
+		{
+			_current[i].store(0, std::memory_order_relaxed);
+			_peak[i].store(0, std::memory_order_relaxed);
+		}
+		_totalCurrent.store(0, std::memory_order_relaxed);
+		_totalPeak.store(0, std::memory_order_relaxed);
+	}
+
+	MemoryCounters(const MemoryCounters&) = delete;
+	void operator=(const MemoryCounters&) = delete;
+
+	/** Register that memory of the given category was allocated. */
+	void Allocate(DyscoMemoryCategory category, uint64_t bytes)
+	{
+		updatePeak(_peak[category], _current[category].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+		updatePeak(_totalPeak, _totalCurrent.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+	}
+
+	/** Register that memory of the given category was freed. */
+	void Free(DyscoMemoryCategory category, uint64_t bytes)
+	{
+		_current[category].fetch_sub(bytes, std::memory_order_relaxed);
+		_totalCurrent.fetch_sub(bytes, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Change the registered size of an allocation.
+	 * @param size The currently registered size, which is updated to @p newSize.
+	 */
+	void Resize(DyscoMemoryCategory category, uint64_t& size, uint64_t newSize)
+	{
+		if(newSize > size)
+			Allocate(category, newSize - size);
+		else
+			Free(category, size - newSize);
+		size = newSize;
+	}
+
+	DyscoMemoryUsage Usage() const
+	{
+		DyscoMemoryUsage usage;
+		for(size_t i=0; i!=MemoryCategoryCount; ++i)
+		{
+			usage.current[i] = _current[i].load(std::memory_order_relaxed);
+			usage.peak[i] = _peak[i].load(std::memory_order_relaxed);
+		}
+		usage.totalCurrent = _totalCurrent.load(std::memory_order_relaxed);
+		usage.totalPeak = _totalPeak.load(std::memory_order_relaxed);
+		return usage;
+	}
+
+private:
+	static void updatePeak(std::atomic<uint64_t>& peak, uint64_t value)
+	{
+		uint64_t oldPeak = peak.load(std::memory_order_relaxed);
+		while(value > oldPeak && !peak.compare_exchange_weak(oldPeak, value, std::memory_order_relaxed))
+		{ }
+	}
+
+	std::atomic<uint64_t> _current[MemoryCategoryCount];
+	std::atomic<uint64_t> _peak[MemoryCategoryCount];
+	std::atomic<uint64_t> _totalCurrent, _totalPeak;
+};
+
+/**
+ * Accuracy of the compression, measured while encoding by comparing the
+ * original values with the decoded symbols. Values are counted per float,
+ * i.e., a complex value counts as two values.
+ */
+struct DyscoErrorStatistics
+{
+	DyscoErrorStatistics() :
+		blockCount(0), valueCount(0), nonFiniteCount(0), clippedCount(0),
+		squaredErrorSum(0.0), squaredValueSum(0.0), maxBlockRMSError(0.0)
+	{ }
+
+	/** Number of blocks that were measured. */
+	uint64_t blockCount;
+	/** Number of finite values that were decoded as finite values. */
+	uint64_t valueCount;
+	/** Number of values that are non-finite, or that were decoded as non-finite values. */
+	uint64_t nonFiniteCount;
+	/** Number of values outside the range of the quantizer. */
+	uint64_t clippedCount;
+	/** Sum of the squared quantization errors of the finite values. */
+	double squaredErrorSum;
+	/** Sum of the squares of the finite values. */
+	double squaredValueSum;
+	/** Largest RMS quantization error of a single block. */
+	double maxBlockRMSError;
+
+	/** Root-mean-square of the quantization error. */
+	double RMSError() const { return valueCount == 0 ? 0.0 : std::sqrt(squaredErrorSum / valueCount); }
+
+	/** RMS quantization error relative to the RMS of the values. */
+	double RelativeRMSError() const { return squaredValueSum == 0.0 ? 0.0 : std::sqrt(squaredErrorSum / squaredValueSum); }
+
+	/** Fraction of the finite values that were clipped. */
+	double ClippedFraction() const { return valueCount == 0 ? 0.0 : double(clippedCount) / valueCount; }
+
+	DyscoErrorStatistics& operator+=(const DyscoErrorStatistics& rhs)
+	{
+		blockCount += rhs.blockCount;
+		valueCount += rhs.valueCount;
+		nonFiniteCount += rhs.nonFiniteCount;
+		clippedCount += rhs.clippedCount;
+		squaredErrorSum += rhs.squaredErrorSum;
+		squaredValueSum += rhs.squaredValueSum;
+		maxBlockRMSError = std::max(maxBlockRMSError, rhs.maxBlockRMSError);
+		return *this;
+	}
+
+	/** Write a human readable summary to the stream. */
+	void Print(std::ostream& stream) const;
+};
+
+/**
+ * Collection of statistics for a column. Threads that work on the column
+ * register their own counters, and the counters are merged when they are
+ * read.
+ */
+class DyscoStatistics
+{
+public:
+	DyscoStatistics() { }
+
+	DyscoStatistics(const DyscoStatistics&) = delete;
+	void operator=(const DyscoStatistics&) = delete;
+
+	/**
+	 * Create counters for a new thread. The returned object stays valid for the
+	 * lifetime of this DyscoStatistics object. This method is thread-safe.
+	 */
+	StageCounters* NewThreadCounters()
+	{
+		altthread::mutex::scoped_lock lock(_mutex);
+		_threadCounters.emplace_back(new StageCounters());
+		return _threadCounters.back().get();
+	}
+
+	/** Merge the counters of all threads. This method is thread-safe. */
+	DyscoTimings Timings() const;
+
+	/**
+	 * Add the error statistics of an encoded block. This is called once per block,
+	 * and is thread-safe.
+	 */
+	void AddErrors(const DyscoErrorStatistics& blockErrors)
+	{
+		altthread::mutex::scoped_lock lock(_mutex);
+		_errors += blockErrors;
+	}
+
+	/**
+	 * Record the number of blocks in the write cache, sampled each time a
+	 * block is added to it. This method is thread-safe.
+	 * @param occupancy Number of blocks in the cache.
+	 * @param maxOccupancy Maximum number of blocks that fit in the cache.
+	 */
+	void AddCacheOccupancy(size_t occupancy, size_t maxOccupancy)
+	{
+		altthread::mutex::scoped_lock lock(_mutex);
+		if(_cacheOccupancy.size() <= maxOccupancy)
+			_cacheOccupancy.resize(maxOccupancy + 1, 0);
+		++_cacheOccupancy[std::min(occupancy, maxOccupancy)];
+	}
+
+	/**
+	 * Histogram of the cache occupancy: element i holds how often the write cache
+	 * contained i blocks after a block was added. This method is thread-safe.
+	 */
+	std::vector<uint64_t> CacheOccupancy() const
+	{
+		altthread::mutex::scoped_lock lock(_mutex);
+		return _cacheOccupancy;
+	}
+
+	/** Write a cache occupancy histogram as returned by CacheOccupancy() to the stream. */
+	static void PrintCacheOccupancy(std::ostream& stream, const std::vector<uint64_t>& histogram);
+
+	/** Memory allocations of the column. */
+	MemoryCounters& Memory() { return _memory; }
+	const MemoryCounters& Memory() const { return _memory; }
+
+	/** Error statistics of all blocks encoded so far. This method is thread-safe. */
+	DyscoErrorStatistics ErrorStatistics() const
+	{
+		altthread::mutex::scoped_lock lock(_mutex);
+		return _errors;
+	}
+
+private:
+	mutable altthread::mutex _mutex;
+	std::vector<std::unique_ptr<StageCounters>> _threadCounters;
+	DyscoErrorStatistics _errors;
+	std::vector<uint64_t> _cacheOccupancy;
+	MemoryCounters _memory;
+};
+
+} // end of namespace
+
+#endif
@@ -2,10 +2,25 @@
 #include "dyscostmancol.h"
 #include "dyscostmanerror.h"
 #include "dyscodatacolumn.h"
+#include "dyscoflagcolumn.h"
 #include "dyscoweightcolumn.h"
 
 #include "header.h"
 
+#include <casacore/casa/Arrays/Vector.h>
+
+#include <casacore/ms/MeasurementSets/MeasurementSet.h>
+
+#include <casacore/tables/Tables/ArrayColumn.h>
+#include <casacore/tables/Tables/ScalarColumn.h>
+#include <casacore/tables/Tables/TableDesc.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
 using namespace altthread;
 
 void register_dyscostman()
@@ -18,7 +33,7 @@ namespace dyscostman
 
 const unsigned short
 	DyscoStMan::VERSION_MAJOR = 1,
-	DyscoStMan::VERSION_MINOR = 0;
+	DyscoStMan::VERSION_MINOR = 4;
 
 DyscoStMan::DyscoStMan(unsigned dataBitCount, unsigned weightBitCount, const casacore::String& name) :
 	DataManager(),
@@ -31,12 +46,43 @@ DyscoStMan::DyscoStMan(unsigned dataBitCount, unsigned weightBitCount, const cas
 	_name(name),
 	_dataBitCount(dataBitCount),
 	_weightBitCount(weightBitCount),
+	_dataBitCountPerPol(),
+	_baselineBitCounts(),
+	_baselineLengthThresholds(),
+	_baselineClassPerBlockRow(),
+	_weightBlockModes(false),
+	_weightChannelScales(false),
+	_weightPerPolarization(false),
+	_deriveFlags(false),
+	_losslessAutoCorrelations(false),
+	_losslessBlockRows(),
+	_predictionInterval(0),
+	_stokesTransform(false),
+	_skipFlaggedData(false),
+	_declaredRowsPerBlock(0),
+	_declaredAntennaCount(0),
+	_variableRowsPerBlock(false),
+	_blockStartRows(1, 0),
+	_blockPerStride(),
+	_isBlockIndexChanged(false),
+	_timeCol(),
+	_fieldCol(),
+	_dataDescIdCol(),
+	_maxPolarizations(0),
+	_maxChannels(0),
+	_channelsPerDataDesc(),
+	_filePerColumn(false),
+	_columnFiles(),
 	_distribution(TruncatedGaussianDistribution),
 	_normalization(AFNormalization),
 	_studentTNu(0.0),
 	_distributionTruncation(2.5),
-	_staticSeed(false)
+	_staticSeed(false),
+	_errorStatistics(getenv("DYSCO_STATISTICS") != nullptr),
+	_traceFile(),
+	_tracer()
 {
+	initializeTracer();
 }
 
 DyscoStMan::DyscoStMan(const casacore::String& name, const casacore::Record& spec) :
@@ -50,13 +96,44 @@ DyscoStMan::DyscoStMan(const casacore::String& name, const casacore::Record& spe
 	_name(name),
 	_dataBitCount(0),
 	_weightBitCount(0),
+	_dataBitCountPerPol(),
+	_baselineBitCounts(),
+	_baselineLengthThresholds(),
+	_baselineClassPerBlockRow(),
+	_weightBlockModes(false),
+	_weightChannelScales(false),
+	_weightPerPolarization(false),
+	_deriveFlags(false),
+	_losslessAutoCorrelations(false),
+	_losslessBlockRows(),
+	_predictionInterval(0),
+	_stokesTransform(false),
+	_skipFlaggedData(false),
+	_declaredRowsPerBlock(0),
+	_declaredAntennaCount(0),
+	_variableRowsPerBlock(false),
+	_blockStartRows(1, 0),
+	_blockPerStride(),
+	_isBlockIndexChanged(false),
+	_timeCol(),
+	_fieldCol(),
+	_dataDescIdCol(),
+	_maxPolarizations(0),
+	_maxChannels(0),
+	_channelsPerDataDesc(),
+	_filePerColumn(false),
+	_columnFiles(),
 	_distribution(GaussianDistribution),
 	_normalization(AFNormalization),
 	_studentTNu(0.0),
 	_distributionTruncation(0.0),
-	_staticSeed(false)
+	_staticSeed(false),
+	_errorStatistics(getenv("DYSCO_STATISTICS") != nullptr),
+	_traceFile(),
+	_tracer()
 {
 	setFromSpec(spec);
+	initializeTracer();
 }
 
 DyscoStMan::DyscoStMan(const DyscoStMan& source) :
@@ -70,12 +147,44 @@ DyscoStMan::DyscoStMan(const DyscoStMan& source) :
 	_name(source._name),
 	_dataBitCount(source._dataBitCount),
 	_weightBitCount(source._weightBitCount),
+	_dataBitCountPerPol(source._dataBitCountPerPol),
+	_baselineBitCounts(source._baselineBitCounts),
+	_baselineLengthThresholds(source._baselineLengthThresholds),
+	_baselineClassPerBlockRow(),
+	_weightBlockModes(source._weightBlockModes),
+	_weightChannelScales(source._weightChannelScales),
+	_weightPerPolarization(source._weightPerPolarization),
+	_floatColumnBitCounts(source._floatColumnBitCounts),
+	_deriveFlags(source._deriveFlags),
+	_losslessAutoCorrelations(source._losslessAutoCorrelations),
+	_losslessBlockRows(),
+	_predictionInterval(source._predictionInterval),
+	_stokesTransform(source._stokesTransform),
+	_skipFlaggedData(source._skipFlaggedData),
+	_declaredRowsPerBlock(source._declaredRowsPerBlock),
+	_declaredAntennaCount(source._declaredAntennaCount),
+	_variableRowsPerBlock(source._variableRowsPerBlock),
+	_blockStartRows(1, 0),
+	_blockPerStride(),
+	_isBlockIndexChanged(false),
+	_timeCol(),
+	_fieldCol(),
+	_dataDescIdCol(),
+	_maxPolarizations(source._maxPolarizations),
+	_maxChannels(source._maxChannels),
+	_channelsPerDataDesc(),
+	_filePerColumn(source._filePerColumn),
+	_columnFiles(),
 	_distribution(source._distribution),
 	_normalization(source._normalization),
 	_studentTNu(source._studentTNu),
 	_distributionTruncation(source._distributionTruncation),
-	_staticSeed(source._staticSeed)
+	_staticSeed(source._staticSeed),
+	_errorStatistics(source._errorStatistics),
+	_traceFile(source._traceFile),
+	_tracer()
 {
+	initializeTracer();
 }
 
 void DyscoStMan::setFromSpec(const casacore::Record& spec)
@@ -109,23 +218,265 @@ void DyscoStMan::setFromSpec(const casacore::Record& spec)
 			_normalization = AFNormalization;
 		else if(str == "Row")
 			_normalization = RowNormalization;
+		else if(str == "Auto")
+			_normalization = AutoNormalization;
 		else throw DyscoStManError("Unsupported normalization specified");
 		if(spec.description().fieldNumber("studentTNu") >= 0)
 			_studentTNu = spec.asDouble("studentTNu");
 		else
 			_studentTNu = 0.0;
 		_distributionTruncation = spec.asDouble("distributionTruncation");
+		_dataBitCountPerPol.clear();
+		if(spec.description().fieldNumber("dataBitCountPerPol") >= 0)
+		{
+			casacore::Vector<casacore::Int> bitCounts(spec.asArrayInt("dataBitCountPerPol"));
+			for(size_t p=0; p!=bitCounts.size(); ++p)
+			{
+				if(bitCounts[p] <= 0)
+					throw DyscoStManError("Invalid data bit rate in dataBitCountPerPol");
+				_dataBitCountPerPol.push_back(bitCounts[p]);
+			}
+		}
+		_baselineBitCounts.clear();
+		_baselineLengthThresholds.clear();
+		if(spec.description().fieldNumber("baselineBitCounts") >= 0)
+		{
+			casacore::Vector<casacore::Int> bitCounts(spec.asArrayInt("baselineBitCounts"));
+			for(size_t c=0; c!=bitCounts.size(); ++c)
+			{
+				if(bitCounts[c] <= 0)
+					throw DyscoStManError("Invalid data bit rate in baselineBitCounts");
+				_baselineBitCounts.push_back(bitCounts[c]);
+			}
+			if(spec.description().fieldNumber("baselineLengthThresholds") >= 0)
+			{
+				casacore::Vector<casacore::Double> thresholds(spec.asArrayDouble("baselineLengthThresholds"));
+				_baselineLengthThresholds = thresholds.tovector();
+			}
+		}
+		if(spec.description().fieldNumber("weightBlockModes") >= 0)
+			_weightBlockModes = spec.asBool("weightBlockModes");
+		else
+			_weightBlockModes = false;
+		if(spec.description().fieldNumber("weightChannelScales") >= 0)
+			_weightChannelScales = spec.asBool("weightChannelScales");
+		else
+			_weightChannelScales = false;
+		if(spec.description().fieldNumber("weightPerPolarization") >= 0)
+			_weightPerPolarization = spec.asBool("weightPerPolarization");
+		else
+			_weightPerPolarization = false;
+		_floatColumnBitCounts.clear();
+		if(spec.description().fieldNumber("floatColumnBitCounts") >= 0)
+		{
+			const casacore::Record& bitCounts = spec.subRecord("floatColumnBitCounts");
+			for(casacore::uInt i=0; i!=bitCounts.nfields(); ++i)
+			{
+				if(bitCounts.asInt(i) <= 0)
+					throw DyscoStManError("Invalid bit count for column " + bitCounts.name(i) + " in floatColumnBitCounts");
+				_floatColumnBitCounts[bitCounts.name(i)] = bitCounts.asInt(i);
+			}
+		}
+		if(spec.description().fieldNumber("deriveFlags") >= 0)
+			_deriveFlags = spec.asBool("deriveFlags");
+		else
+			_deriveFlags = false;
+		if(spec.description().fieldNumber("losslessAutoCorrelations") >= 0)
+			_losslessAutoCorrelations = spec.asBool("losslessAutoCorrelations");
+		else
+			_losslessAutoCorrelations = false;
+		if(spec.description().fieldNumber("predictionInterval") >= 0)
+			_predictionInterval = spec.asInt("predictionInterval");
+		else
+			_predictionInterval = 0;
+		if(spec.description().fieldNumber("stokesTransform") >= 0)
+			_stokesTransform = spec.asBool("stokesTransform");
+		else
+			_stokesTransform = false;
+		if(spec.description().fieldNumber("skipFlaggedData") >= 0)
+			_skipFlaggedData = spec.asBool("skipFlaggedData");
+		else
+			_skipFlaggedData = false;
+		if(spec.description().fieldNumber("rowsPerBlock") >= 0)
+		{
+			if(spec.description().fieldNumber("antennaCount") < 0)
+				throw DyscoStManError("The antennaCount should be specified together with the rowsPerBlock");
+			if(spec.asInt("rowsPerBlock") <= 0 || spec.asInt("antennaCount") <= 0)
+				throw DyscoStManError("Invalid rowsPerBlock or antennaCount specified");
+			_declaredRowsPerBlock = spec.asInt("rowsPerBlock");
+			_declaredAntennaCount = spec.asInt("antennaCount");
+		}
+		else {
+			_declaredRowsPerBlock = 0;
+			_declaredAntennaCount = 0;
+		}
+		if(spec.description().fieldNumber("variableRowsPerBlock") >= 0)
+			_variableRowsPerBlock = spec.asBool("variableRowsPerBlock");
+		else
+			_variableRowsPerBlock = false;
+		if(spec.description().fieldNumber("maximumShape") >= 0)
+		{
+			casacore::Vector<casacore::Int> maximumShape(spec.asArrayInt("maximumShape"));
+			if(maximumShape.size() != 2 || maximumShape[0] <= 0 || maximumShape[1] <= 0)
+				throw DyscoStManError("Invalid maximumShape specified: it should hold the number of polarizations and channels");
+			_maxPolarizations = maximumShape[0];
+			_maxChannels = maximumShape[1];
+		}
+		else {
+			_maxPolarizations = 0;
+			_maxChannels = 0;
+		}
+		if(spec.description().fieldNumber("filePerColumn") >= 0)
+			_filePerColumn = spec.asBool("filePerColumn");
+		else
+			_filePerColumn = false;
 	}
+	if(spec.description().fieldNumber("errorStatistics") >= 0)
+		_errorStatistics = _errorStatistics || spec.asBool("errorStatistics");
+	if(spec.description().fieldNumber("traceFile") >= 0)
+		_traceFile = spec.asString("traceFile");
+}
+
+void DyscoStMan::initializeTracer()
+{
+	std::string filename = _traceFile;
+	const char* tracePrefix = getenv("DYSCO_TRACE");
+	if(filename.empty() && tracePrefix != nullptr)
+		filename = std::string(tracePrefix) + _name + ".json";
+	if(!filename.empty())
+		_tracer.reset(new DyscoTracer(filename));
+}
+
+void DyscoStMan::SetTraceFile(const std::string& filename)
+{
+	// Columns hold buffers of the current tracer
+	if(!_columns.empty())
+		throw DyscoStManError("The trace file of DyscoStMan can only be set before columns are added");
+	_traceFile = filename;
+	_tracer.reset();
+	initializeTracer();
+}
+
+TraceBuffer* DyscoStMan::newTraceBuffer(const std::string& threadName)
+{
+	if(_tracer)
+		return _tracer->NewThreadBuffer(threadName);
+	else
+		return nullptr;
 }
 
 void DyscoStMan::makeEmpty()
 {
 	for(std::vector<DyscoStManColumn*>::iterator i = _columns.begin(); i!=_columns.end(); ++i)
-	{
 		(*i)->shutdown();
-		delete *i;
+	if(_isBlockIndexChanged)
+	{
+		// This is called from the destructor, so errors are reported instead of thrown
+		try {
+			writeBlockIndex();
+		} catch(std::exception& e) {
+			std::cerr << e.what() << '\n';
+		}
 	}
+	if(!_columns.empty() && getenv("DYSCO_STATISTICS") != nullptr)
+		printStatistics(std::cout);
+	if(!_columns.empty() && _tracer)
+	{
+		// This is called from the destructor, so errors are reported instead of thrown
+		try {
+			_tracer->Write();
+		} catch(std::exception& e) {
+			std::cerr << e.what() << '\n';
+		}
+	}
+	for(std::vector<DyscoStManColumn*>::iterator i = _columns.begin(); i!=_columns.end(); ++i)
+		delete *i;
 	_columns.clear();
+	_columnFiles.clear();
+}
+
+void DyscoStMan::printStatistics(std::ostream& stream) const
+{
+	for(const DyscoStManColumn* column : _columns)
+	{
+		stream << "Dysco timings for column " << column->Name() << ":\n";
+		column->Statistics().Timings().Print(stream);
+		if(_errorStatistics)
+		{
+			stream << "Dysco compression errors for column " << column->Name() << ":\n";
+			column->Statistics().ErrorStatistics().Print(stream);
+		}
+		stream << "Dysco memory usage for column " << column->Name() << ":\n";
+		column->Statistics().Memory().Usage().Print(stream);
+		const std::vector<uint64_t> occupancy = column->Statistics().CacheOccupancy();
+		if(!occupancy.empty())
+		{
+			stream << "Dysco write cache occupancy for column " << column->Name() << ":\n";
+			DyscoStatistics::PrintCacheOccupancy(stream, occupancy);
+		}
+	}
+	if(_columns.size() > 1)
+	{
+		stream << "Dysco timings for all columns:\n";
+		GetTimings().Print(stream);
+		stream << "Dysco memory usage for all columns:\n";
+		GetMemoryUsage().Print(stream);
+	}
+	stream.flush();
+}
+
+DyscoTimings DyscoStMan::GetTimings() const
+{
+	DyscoTimings timings;
+	for(const DyscoStManColumn* column : _columns)
+		timings += column->Statistics().Timings();
+	return timings;
+}
+
+DyscoTimings DyscoStMan::GetTimings(const std::string& columnName) const
+{
+	return findColumn(columnName).Statistics().Timings();
+}
+
+DyscoErrorStatistics DyscoStMan::GetErrorStatistics() const
+{
+	DyscoErrorStatistics errors;
+	for(const DyscoStManColumn* column : _columns)
+		errors += column->Statistics().ErrorStatistics();
+	return errors;
+}
+
+DyscoErrorStatistics DyscoStMan::GetErrorStatistics(const std::string& columnName) const
+{
+	return findColumn(columnName).Statistics().ErrorStatistics();
+}
+
+std::vector<uint64_t> DyscoStMan::GetCacheOccupancy(const std::string& columnName) const
+{
+	return findColumn(columnName).Statistics().CacheOccupancy();
+}
+
+DyscoMemoryUsage DyscoStMan::GetMemoryUsage() const
+{
+	DyscoMemoryUsage usage;
+	for(const DyscoStManColumn* column : _columns)
+		usage += column->Statistics().Memory().Usage();
+	return usage;
+}
+
+DyscoMemoryUsage DyscoStMan::GetMemoryUsage(const std::string& columnName) const
+{
+	return findColumn(columnName).Statistics().Memory().Usage();
+}
+
+const DyscoStManColumn& DyscoStMan::findColumn(const std::string& columnName) const
+{
+	for(const DyscoStManColumn* column : _columns)
+	{
+		if(column->Name() == columnName)
+			return *column;
+	}
+	throw DyscoStManError("Column " + columnName + " is not stored by DyscoStMan " + _name);
 }
 
 DyscoStMan::~DyscoStMan()
@@ -151,10 +502,70 @@ casacore::Record DyscoStMan::dataManagerSpec() const
     case AFNormalization: normStr = "AF"; break;
     case RFNormalization: normStr = "RF"; break;
     case RowNormalization: normStr = "Row"; break;
+    case AutoNormalization: normStr = "Auto"; break;
   }
   spec.define("normalization", normStr);
   spec.define("studentTNu", _studentTNu);
   spec.define("distributionTruncation", _distributionTruncation);
+  if(!_dataBitCountPerPol.empty())
+  {
+    casacore::Vector<casacore::Int> bitCounts(_dataBitCountPerPol.size());
+    for(size_t p=0; p!=_dataBitCountPerPol.size(); ++p)
+      bitCounts[p] = _dataBitCountPerPol[p];
+    spec.define("dataBitCountPerPol", bitCounts);
+  }
+  if(!_baselineBitCounts.empty())
+  {
+    casacore::Vector<casacore::Int> bitCounts(_baselineBitCounts.size());
+    for(size_t c=0; c!=_baselineBitCounts.size(); ++c)
+      bitCounts[c] = _baselineBitCounts[c];
+    spec.define("baselineBitCounts", bitCounts);
+    if(!_baselineLengthThresholds.empty())
+      spec.define("baselineLengthThresholds", casacore::Vector<casacore::Double>(_baselineLengthThresholds));
+  }
+  if(_weightBlockModes)
+    spec.define("weightBlockModes", true);
+  if(_weightChannelScales)
+    spec.define("weightChannelScales", true);
+  if(_weightPerPolarization)
+    spec.define("weightPerPolarization", true);
+  if(!_floatColumnBitCounts.empty())
+  {
+    casacore::Record bitCounts;
+    for(const std::pair<const std::string, unsigned>& bitCount : _floatColumnBitCounts)
+      bitCounts.define(bitCount.first, int(bitCount.second));
+    spec.defineRecord("floatColumnBitCounts", bitCounts);
+  }
+  if(_deriveFlags)
+    spec.define("deriveFlags", true);
+  if(_losslessAutoCorrelations)
+    spec.define("losslessAutoCorrelations", true);
+  if(_predictionInterval > 1)
+    spec.define("predictionInterval", int(_predictionInterval));
+  if(_stokesTransform)
+    spec.define("stokesTransform", true);
+  if(_skipFlaggedData)
+    spec.define("skipFlaggedData", true);
+  if(_declaredRowsPerBlock != 0)
+  {
+    spec.define("rowsPerBlock", int(_declaredRowsPerBlock));
+    spec.define("antennaCount", int(_declaredAntennaCount));
+  }
+  if(_variableRowsPerBlock)
+    spec.define("variableRowsPerBlock", true);
+  if(_maxChannels != 0)
+  {
+    casacore::Vector<casacore::Int> maximumShape(2);
+    maximumShape[0] = _maxPolarizations;
+    maximumShape[1] = _maxChannels;
+    spec.define("maximumShape", maximumShape);
+  }
+  if(_filePerColumn)
+    spec.define("filePerColumn", true);
+  if(_errorStatistics)
+    spec.define("errorStatistics", true);
+  if(!_traceFile.empty())
+    spec.define("traceFile", _traceFile);
 	return spec;
 }
 
@@ -165,7 +576,25 @@ void DyscoStMan::registerClass()
 
 casacore::Bool DyscoStMan::flush(casacore::AipsIO&, casacore::Bool doFsync)
 {
-	return false;
+	bool isWritten = false;
+	for(DyscoStManColumn* col : _columns)
+	{
+		if(col->Flush())
+			isWritten = true;
+	}
+	if(isWritten)
+	{
+		mutex::scoped_lock lock(_mutex);
+		_fStream->flush();
+		for(std::pair<const DyscoStManColumn* const, ColumnFile>& file : _columnFiles)
+			file.second.stream->flush();
+	}
+	if(_isBlockIndexChanged)
+	{
+		writeBlockIndex();
+		isWritten = true;
+	}
+	return isWritten;
 }
 
 void DyscoStMan::create(casacore::uInt nRow)
@@ -175,6 +604,62 @@ void DyscoStMan::create(casacore::uInt nRow)
 	if(_fStream->fail())
 		throw DyscoStManError("I/O error: could not create new file '" + fileName() + "'");
 	_nBlocksInFile = 0;
+	// A block index of a previous table with this name is no longer valid
+	unlink(blockIndexFileName().c_str());
+	_blockStartRows.assign(1, 0);
+	_blockPerStride.clear();
+	_channelsPerDataDesc.clear();
+	if(_filePerColumn)
+	{
+		for(DyscoStManColumn* col : _columns)
+			openColumnFile(col, true);
+	}
+}
+
+unsigned short DyscoStMan::requiredVersionMinor() const
+{
+	// Files are written with the lowest version that supports the used
+	// features, so that older versions of Dysco can still open them.
+	unsigned short versionMinor = 0;
+	if(!_dataBitCountPerPol.empty())
+		versionMinor = 1;
+	if(!_baselineBitCounts.empty())
+		versionMinor = 2;
+	if(_normalization == AutoNormalization)
+		versionMinor = 3;
+	if(featureFlags() != 0)
+		versionMinor = 4;
+	return versionMinor;
+}
+
+uint32_t DyscoStMan::featureFlags() const
+{
+	uint32_t flags = 0;
+	if(_weightBlockModes)
+		flags |= WeightBlockModesFeature;
+	if(_weightChannelScales)
+		flags |= WeightChannelScalesFeature;
+	if(_weightPerPolarization)
+		flags |= WeightPerPolarizationFeature;
+	if(_deriveFlags)
+		flags |= DerivedFlagsFeature;
+	if(_losslessAutoCorrelations)
+		flags |= LosslessAutoCorrelationsFeature;
+	if(_predictionInterval > 1)
+		flags |= PredictiveEncodingFeature;
+	if(_stokesTransform)
+		flags |= StokesTransformFeature;
+	if(_skipFlaggedData)
+		flags |= SkipFlaggedDataFeature;
+	if(_variableRowsPerBlock)
+		flags |= VariableRowsPerBlockFeature;
+	if(_maxChannels != 0)
+		flags |= VariableShapeFeature;
+	if(_filePerColumn)
+		flags |= FilePerColumnFeature;
+	if(!_floatColumnBitCounts.empty())
+		flags |= FloatColumnBitCountsFeature;
+	return flags;
 }
 
 void DyscoStMan::writeHeader()
@@ -187,9 +672,23 @@ void DyscoStMan::writeHeader()
 	header.antennaCount = _antennaCount;
 	header.blockSize = _blockSize;
 	header.versionMajor = VERSION_MAJOR;
-	header.versionMinor = VERSION_MINOR;
+	header.versionMinor = requiredVersionMinor();
 	header.dataBitCount = _dataBitCount;
 	header.weightBitCount = _weightBitCount;
+	header.dataBitCountPerPol.assign(_dataBitCountPerPol.begin(), _dataBitCountPerPol.end());
+	header.baselineBitCounts.assign(_baselineBitCounts.begin(), _baselineBitCounts.end());
+	header.baselineLengthThresholds = _baselineLengthThresholds;
+	header.baselineClassPerBlockRow = _baselineClassPerBlockRow;
+	header.featureFlags = featureFlags();
+	header.losslessBlockRows = _losslessBlockRows;
+	header.predictionInterval = _predictionInterval;
+	header.maxPolarizations = _maxPolarizations;
+	header.maxChannels = _maxChannels;
+	for(const std::pair<const std::string, unsigned>& bitCount : _floatColumnBitCounts)
+	{
+		header.floatColumnNames.push_back(bitCount.first);
+		header.floatColumnBitCounts.push_back(bitCount.second);
+	}
 	header.distribution = _distribution;
 	header.normalization = _normalization;
 	header.studentTNu = _studentTNu;
@@ -227,6 +726,26 @@ void DyscoStMan::readHeader()
 	_name = header.storageManagerName;
 	_dataBitCount = header.dataBitCount;
 	_weightBitCount = header.weightBitCount;
+	_dataBitCountPerPol.assign(header.dataBitCountPerPol.begin(), header.dataBitCountPerPol.end());
+	_baselineBitCounts.assign(header.baselineBitCounts.begin(), header.baselineBitCounts.end());
+	_baselineLengthThresholds = header.baselineLengthThresholds;
+	_baselineClassPerBlockRow = header.baselineClassPerBlockRow;
+	_weightBlockModes = (header.featureFlags & WeightBlockModesFeature) != 0;
+	_weightChannelScales = (header.featureFlags & WeightChannelScalesFeature) != 0;
+	_weightPerPolarization = (header.featureFlags & WeightPerPolarizationFeature) != 0;
+	_deriveFlags = (header.featureFlags & DerivedFlagsFeature) != 0;
+	_losslessAutoCorrelations = (header.featureFlags & LosslessAutoCorrelationsFeature) != 0;
+	_losslessBlockRows = header.losslessBlockRows;
+	_predictionInterval = header.predictionInterval;
+	_stokesTransform = (header.featureFlags & StokesTransformFeature) != 0;
+	_skipFlaggedData = (header.featureFlags & SkipFlaggedDataFeature) != 0;
+	_variableRowsPerBlock = (header.featureFlags & VariableRowsPerBlockFeature) != 0;
+	_maxPolarizations = header.maxPolarizations;
+	_maxChannels = header.maxChannels;
+	_floatColumnBitCounts.clear();
+	for(size_t i=0; i!=header.floatColumnNames.size(); ++i)
+		_floatColumnBitCounts[header.floatColumnNames[i]] = header.floatColumnBitCounts[i];
+	_filePerColumn = (header.featureFlags & FilePerColumnFeature) != 0;
 	_distribution = (enum DyscoDistribution) header.distribution;
 	_normalization = (enum DyscoNormalization) header.normalization;
 	_studentTNu = header.studentTNu;
@@ -235,10 +754,17 @@ void DyscoStMan::readHeader()
 	_antennaCount = header.antennaCount;
 	_blockSize = header.blockSize;
 	
-	if(header.versionMajor != 1 || header.versionMinor != 0)
+	if(header.versionMajor != VERSION_MAJOR || header.versionMinor > VERSION_MINOR)
 	{
 		std::stringstream s;
-		s << "The compressed file has file format version " << header.versionMajor << "." << header.versionMinor << ", but this version of Dysco can only open file format version 1.0. Upgrade Dysco.\n";
+		s << "The compressed file has file format version " << header.versionMajor << "." << header.versionMinor << ", but this version of Dysco can only open file format versions " << VERSION_MAJOR << ".0 to " << VERSION_MAJOR << "." << VERSION_MINOR << ". Upgrade Dysco.\n";
+		throw DyscoStManError(s.str());
+	}
+	
+	if((header.featureFlags & ~KnownFeatureFlags) != 0)
+	{
+		std::stringstream s;
+		s << "The compressed file uses features (flags 0x" << std::hex << (header.featureFlags & ~KnownFeatureFlags) << ") that this version of Dysco does not support. Upgrade Dysco.\n";
 		throw DyscoStManError(s.str());
 	}
 	
@@ -262,16 +788,72 @@ void DyscoStMan::readHeader()
 
 void DyscoStMan::initializeRowsPerBlock(size_t rowsPerBlock, size_t antennaCount, bool writeToHeader)
 {
+	// With variable rows per block, later blocks can hold antennas that are not in the first block
+	if(_variableRowsPerBlock && !areOffsetsInitialized() && table().keywordSet().isDefined("ANTENNA"))
+		antennaCount = std::max<size_t>(antennaCount, table().keywordSet().asTable("ANTENNA").nrow());
+	
 	if(areOffsetsInitialized() && (rowsPerBlock != _rowsPerBlock || antennaCount != _antennaCount))
 		throw DyscoStManError("initializeRowsPerBlock() called with two different values; something is wrong");
 	
+	// A new file determines the baseline classes from its first block, an existing
+	// file has read them from its header. This is done before the layout is stored, so
+	// that a table without baseline lengths still has no layout when this fails.
+	std::vector<unsigned> bitsPerBlockRow;
+	if(!_baselineBitCounts.empty())
+	{
+		if(_baselineClassPerBlockRow.empty())
+			initializeBaselineClasses(rowsPerBlock);
+		else if(_baselineClassPerBlockRow.size() != rowsPerBlock)
+			throw DyscoStManError("The baseline classes in the header of the DyscoStMan file do not match the number of rows per block");
+		for(uint8_t baselineClass : _baselineClassPerBlockRow)
+		{
+			if(baselineClass >= _baselineBitCounts.size())
+				throw DyscoStManError("Invalid baseline class in the header of the DyscoStMan file");
+			bitsPerBlockRow.push_back(_baselineBitCounts[baselineClass]);
+		}
+	}
+	
 	_rowsPerBlock = rowsPerBlock;
 	_antennaCount = antennaCount;
 	_blockSize = 0;
+	
+	if(_losslessAutoCorrelations)
+	{
+		if(_losslessBlockRows.empty())
+			initializeLosslessBlockRows();
+		for(uint32_t row : _losslessBlockRows)
+		{
+			if(row >= rowsPerBlock)
+				throw DyscoStManError("Invalid lossless row index in the header of the DyscoStMan file");
+		}
+	}
+	
 	for(DyscoStManColumn* col : _columns)
 	{
+		DyscoDataColumn* dataCol = dynamic_cast<DyscoDataColumn*>(col);
+		if(dataCol != 0)
+		{
+			dataCol->SetBitsPerBlockRow(bitsPerBlockRow);
+			dataCol->SetLosslessBlockRows(_losslessBlockRows);
+		}
+		
 		size_t columnBlockSize = col->CalculateBlockSize(rowsPerBlock, antennaCount);
-		col->SetOffsetInBlock(_blockSize);
+		if(_filePerColumn)
+		{
+			// The number of blocks of an existing file is known once its block size is known
+			col->SetOffsetInBlock(0);
+			ColumnFile& file = columnFile(col);
+			if(file.blockSize == 0 && columnBlockSize != 0)
+			{
+				file.stream->seekg(0, std::ios_base::end);
+				file.nBlocks = (uint64_t(file.stream->tellg()) - file.headerSize) / columnBlockSize;
+				_nBlocksInFile = std::max(_nBlocksInFile, file.nBlocks);
+			}
+			file.blockSize = columnBlockSize;
+		}
+		else {
+			col->SetOffsetInBlock(_blockSize);
+		}
 		_blockSize += columnBlockSize;
 		
 		col->InitializeAfterNRowsPerBlockIsKnown();
@@ -280,6 +862,53 @@ void DyscoStMan::initializeRowsPerBlock(size_t rowsPerBlock, size_t antennaCount
 		writeHeader();
 }
 
+void DyscoStMan::initializeBaselineClasses(size_t rowsPerBlock)
+{
+	if(!_baselineLengthThresholds.empty() && _baselineLengthThresholds.size()+1 != _baselineBitCounts.size())
+		throw DyscoStManError("The number of baseline length thresholds should be one less than the number of baseline bit counts");
+	
+	// The rows of the first block define the baseline length of every row index in a block
+	const std::string uvwName = casacore::MeasurementSet::columnName(casacore::MSMainEnums::UVW);
+	if(!table().tableDesc().isColumn(uvwName))
+		throw DyscoStManError("Baseline bit counts were set, but the table has no " + uvwName + " column to determine the baseline lengths from");
+	std::vector<double> lengths(rowsPerBlock);
+	casacore::ArrayColumn<double> uvwCol(table(), uvwName);
+	for(size_t row=0; row!=rowsPerBlock; ++row)
+	{
+		casacore::Array<double> uvw = uvwCol(row);
+		const double* uvwPtr = uvw.data();
+		lengths[row] = std::sqrt(uvwPtr[0]*uvwPtr[0] + uvwPtr[1]*uvwPtr[1] + uvwPtr[2]*uvwPtr[2]);
+	}
+	
+	if(_baselineLengthThresholds.empty())
+	{
+		// Without thresholds, every class gets an equal share of the baselines
+		std::vector<double> sortedLengths(lengths);
+		std::sort(sortedLengths.begin(), sortedLengths.end());
+		for(size_t c=1; c!=_baselineBitCounts.size(); ++c)
+			_baselineLengthThresholds.push_back(sortedLengths[c * sortedLengths.size() / _baselineBitCounts.size()]);
+	}
+	
+	_baselineClassPerBlockRow.resize(rowsPerBlock);
+	for(size_t row=0; row!=rowsPerBlock; ++row)
+	{
+		_baselineClassPerBlockRow[row] = std::upper_bound(_baselineLengthThresholds.begin(), _baselineLengthThresholds.end(), lengths[row]) - _baselineLengthThresholds.begin();
+	}
+}
+
+void DyscoStMan::initializeLosslessBlockRows()
+{
+	casacore::ScalarColumn<int>
+		ant1Col(table(), casacore::MeasurementSet::columnName(casacore::MSMainEnums::ANTENNA1)),
+		ant2Col(table(), casacore::MeasurementSet::columnName(casacore::MSMainEnums::ANTENNA2));
+	_losslessBlockRows.clear();
+	for(size_t row=0; row!=_rowsPerBlock; ++row)
+	{
+		if(ant1Col(row) == ant2Col(row))
+			_losslessBlockRows.push_back(row);
+	}
+}
+
 void DyscoStMan::open(casacore::uInt nRow, casacore::AipsIO&)
 {
 	_nRow = nRow;
@@ -297,10 +926,178 @@ void DyscoStMan::open(casacore::uInt nRow, casacore::AipsIO&)
 	if(_fStream->fail())
 		throw DyscoStManError("I/O error: error reading file '" + fileName());
 	std::streampos size = _fStream->tellg();
-	if(size > _headerSize)
+	if(size > _headerSize && !_filePerColumn)
 		_nBlocksInFile = (size_t(size) - _headerSize) / _blockSize;
 	else
 		_nBlocksInFile = 0;
+	
+	if(_filePerColumn)
+	{
+		for(DyscoStManColumn* col : _columns)
+			openColumnFile(col, false);
+	}
+	
+	readBlockIndex();
+}
+
+size_t DyscoStMan::findBlock(uint64_t row) const
+{
+	const size_t indexedBlocks = _blockStartRows.size() - 1;
+	if(row >= _blockStartRows.back())
+		return indexedBlocks + (row - _blockStartRows.back()) / _rowsPerBlock;
+	
+	// Because blocks hold at most _rowsPerBlock rows, the row is in one of the blocks
+	// from the block of the previous multiple of _rowsPerBlock up to the block of the next.
+	const size_t stride = row / _rowsPerBlock;
+	const size_t first = _blockPerStride[stride];
+	const size_t last = (stride+1 < _blockPerStride.size()) ? _blockPerStride[stride+1] : indexedBlocks - 1;
+	return std::upper_bound(_blockStartRows.begin() + first + 1, _blockStartRows.begin() + last + 1, row) - _blockStartRows.begin() - 1;
+}
+
+void DyscoStMan::indexRows(uint64_t row)
+{
+	if(!_variableRowsPerBlock)
+		return;
+	const uint64_t nextRow = _blockStartRows.back();
+	if(row < nextRow)
+	{
+		// A row is rewritten: its metadata should still match the index
+		checkIndexedRow(row);
+		if(row+1 < nextRow)
+			checkIndexedRow(row+1);
+		return;
+	}
+	// Without a declared layout, the rows of the first block are written before the
+	// layout is known, and are indexed together with the row after them.
+	const bool isAfterFirstBlock = _declaredRowsPerBlock == 0 && nextRow == 0 && row == _rowsPerBlock;
+	if(row != nextRow && !isAfterFirstBlock)
+	{
+		std::ostringstream s;
+		s << "With variable rows per block, rows should be written in order, but row " << row << " is written before row " << nextRow;
+		throw DyscoStManError(s.str());
+	}
+	// The metadata of the previous row could have been set after its data was written
+	if(nextRow != 0)
+		checkIndexedRow(nextRow-1);
+	extendBlockIndex(row);
+}
+
+bool DyscoStMan::isTimeBlockStart(uint64_t row) const
+{
+	return row == 0 ||
+		(*_timeCol)(row) != (*_timeCol)(row-1) ||
+		(*_fieldCol)(row) != (*_fieldCol)(row-1) ||
+		(*_dataDescIdCol)(row) != (*_dataDescIdCol)(row-1);
+}
+
+void DyscoStMan::checkIndexedRow(uint64_t row) const
+{
+	const size_t block = findBlock(row);
+	bool isConsistent;
+	if(_blockStartRows[block] == row)
+		isConsistent = row == 0 || row - _blockStartRows[block-1] == _rowsPerBlock || isTimeBlockStart(row);
+	else
+		isConsistent = !isTimeBlockStart(row);
+	if(!isConsistent)
+	{
+		std::ostringstream s;
+		s << "The TIME, FIELD_ID or DATA_DESC_ID of row " << row << " changed after its data was written.\nWith variable rows per block, these should be set before the data of a row is written, and should not change afterwards";
+		throw DyscoStManError(s.str());
+	}
+}
+
+void DyscoStMan::extendBlockIndex(uint64_t row)
+{
+	// A new block starts at the first row, when the time, field or spw changes, or
+	// when the block is full.
+	for(uint64_t r=_blockStartRows.back(); r<=row; ++r)
+	{
+		const bool isNewBlock = r == 0 ||
+			r - _blockStartRows[_blockStartRows.size()-2] == _rowsPerBlock ||
+			isTimeBlockStart(r);
+		if(isNewBlock)
+			_blockStartRows.push_back(r+1);
+		else
+			_blockStartRows.back() = r+1;
+		if(r % _rowsPerBlock == 0)
+			_blockPerStride.push_back(_blockStartRows.size() - 2);
+		_isBlockIndexChanged = true;
+	}
+}
+
+void DyscoStMan::initializeBlockStrides()
+{
+	_blockPerStride.clear();
+	for(size_t block=0; block+1<_blockStartRows.size(); ++block)
+	{
+		uint64_t row = (_blockStartRows[block] + _rowsPerBlock - 1) / _rowsPerBlock * _rowsPerBlock;
+		for(; row < _blockStartRows[block+1]; row += _rowsPerBlock)
+			_blockPerStride.push_back(block);
+	}
+}
+
+void DyscoStMan::setDataDescChannelCount(int dataDescId, size_t nChannels)
+{
+	const size_t current = dataDescChannelCount(dataDescId);
+	if(current == 0)
+	{
+		_channelsPerDataDesc[dataDescId] = nChannels;
+		_isBlockIndexChanged = true;
+	}
+	else if(current != nChannels)
+	{
+		std::ostringstream s;
+		s << "The rows of data description " << dataDescId << " have " << current << " channels, but a row with " << nChannels << " channels was written";
+		throw DyscoStManError(s.str());
+	}
+}
+
+void DyscoStMan::readBlockIndex()
+{
+	// Without an index file, the index is rebuilt from the table in prepare()
+	_blockStartRows.assign(1, 0);
+	_channelsPerDataDesc.clear();
+	std::ifstream stream(blockIndexFileName().c_str(), std::ios_base::in | std::ios_base::binary);
+	if(stream.good())
+	{
+		const uint64_t count = Serializable::UnserializeUInt64(stream);
+		std::vector<uint64_t> startRows;
+		for(uint64_t i=0; i!=count && stream.good(); ++i)
+			startRows.push_back(Serializable::UnserializeUInt64(stream));
+		const uint64_t dataDescCount = Serializable::UnserializeUInt64(stream);
+		for(uint64_t i=0; i!=dataDescCount && stream.good(); ++i)
+		{
+			const int dataDescId = Serializable::UnserializeUInt32(stream);
+			_channelsPerDataDesc[dataDescId] = Serializable::UnserializeUInt32(stream);
+		}
+		bool isValid = !stream.fail() && !startRows.empty() && startRows[0] == 0;
+		for(size_t i=1; isValid && i!=startRows.size(); ++i)
+			isValid = startRows[i] > startRows[i-1] && startRows[i] - startRows[i-1] <= _rowsPerBlock;
+		if(!isValid)
+			throw DyscoStManError("I/O error: the block index file '" + blockIndexFileName() + "' is corrupted");
+		if(_variableRowsPerBlock)
+			_blockStartRows = std::move(startRows);
+	}
+	if(_variableRowsPerBlock)
+		initializeBlockStrides();
+	_isBlockIndexChanged = false;
+}
+
+void DyscoStMan::writeBlockIndex()
+{
+	std::ofstream stream(blockIndexFileName().c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+	Serializable::SerializeToUInt64(stream, _blockStartRows.size());
+	for(uint64_t row : _blockStartRows)
+		Serializable::SerializeToUInt64(stream, row);
+	Serializable::SerializeToUInt64(stream, _channelsPerDataDesc.size());
+	for(const std::pair<const int, uint32_t>& channels : _channelsPerDataDesc)
+	{
+		Serializable::SerializeToUInt32(stream, channels.first);
+		Serializable::SerializeToUInt32(stream, channels.second);
+	}
+	if(stream.fail())
+		throw DyscoStManError("I/O error: could not write block index file '" + blockIndexFileName() + "'");
+	_isBlockIndexChanged = false;
 }
 
 casacore::DataManagerColumn* DyscoStMan::makeScalarColumn(const casacore::String& name, int dataType, const casacore::String& dataTypeID)
@@ -314,27 +1111,34 @@ casacore::DataManagerColumn* DyscoStMan::makeDirArrColumn(const casacore::String
 {
 	DyscoStManColumn *col = 0;
 	
-	if(name == "WEIGHT_SPECTRUM")
+	// Float columns use the weight encoder. Other columns than WEIGHT_SPECTRUM need
+	// their own bit count, which is checked in prepare() once the header is read.
+	if(dataType == casacore::TpFloat)
 	{
-		if(dataType == casacore::TpFloat)
-			col = new DyscoWeightColumn(this, dataType);
-		else
-			throw DyscoStManError("Trying to create a Dysco weight column with wrong type");
+		col = new DyscoWeightColumn(this, name, dataType);
+	}
+	else if(dataType == casacore::TpBool)
+	{
+		col = new DyscoFlagColumn(this, name, dataType);
 	}
 	else if(dataType == casacore::TpComplex)
 	{
-		col = new DyscoDataColumn(this, dataType);
+		col = new DyscoDataColumn(this, name, dataType);
 		if(_staticSeed)
 			static_cast<DyscoDataColumn*>(col)->SetStaticRandomizationSeed();
 	} else
-		throw DyscoStManError("Trying to create a Dysco data column with wrong type");
+		throw DyscoStManError("Trying to create a Dysco column with unsupported type: only Complex, Float and Bool columns are supported");
 	_columns.push_back(col);
 	return col;
 }
 
 casacore::DataManagerColumn* DyscoStMan::makeIndArrColumn(const casacore::String& name, int dataType, const casacore::String& dataTypeID)
 {
-	throw DyscoStManError("makeIndArrColumn() called on DyscoStMan. DyscoStMan can only created direct columns!\nUse casacore::ColumnDesc::Direct as option in your column desc constructor");
+	// Columns without a fixed shape are stored with the maximum shape, which is
+	// set on the column in prepare(), because the header is not read yet.
+	makeDirArrColumn(name, dataType, dataTypeID);
+	_columns.back()->SetVariableShape();
+	return _columns.back();
 }
 
 void DyscoStMan::resync(casacore::uInt nRow)
@@ -344,6 +1148,9 @@ void DyscoStMan::resync(casacore::uInt nRow)
 void DyscoStMan::deleteManager()
 {
 	unlink(fileName().c_str());
+	unlink(blockIndexFileName().c_str());
+	for(const DyscoStManColumn* col : _columns)
+		unlink(columnFileName(*col).c_str());
 }
 
 void DyscoStMan::prepare()
@@ -353,24 +1160,109 @@ void DyscoStMan::prepare()
 	if(_dataBitCount == 0 || _weightBitCount == 0)
 		throw DyscoStManError("One of the required parameters of the DyscoStMan was not set!\nDyscoStMan was not correctly initialized by your program.");
 	
+	// The inverse transform spreads a non-finite value over all correlations of a
+	// visibility, so that the flags can not be derived from the decoded values
+	if(_deriveFlags && _stokesTransform)
+		throw DyscoStManError("Flags can not be derived from a data column that is stored with the Stokes transform");
+	DyscoStManColumn* flagSource = _deriveFlags ? derivedFlagSource() : nullptr;
 	for(DyscoStManColumn* col : _columns)
 	{
+		if(col->IsVariableShape())
+		{
+			if(_maxChannels == 0)
+				throw DyscoStManError("Column " + col->Name() + " has no fixed shape, which requires that the maximum shape of the DyscoStMan is set.\nSet it with DyscoStMan::SetMaximumShape(), or use casacore::ColumnDesc::Direct as option in your column desc constructor");
+			col->setShapeColumn(casacore::IPosition(2, _maxPolarizations, _maxChannels));
+		}
 		DyscoDataColumn* dataCol = dynamic_cast<DyscoDataColumn*>(col);
 		if(dataCol != 0)
+		{
 			dataCol->SetBitsPerSymbol(_dataBitCount);
+			dataCol->SetBitsPerPolarization(_dataBitCountPerPol);
+			dataCol->SetPredictionInterval(_predictionInterval);
+			dataCol->SetStokesTransform(_stokesTransform);
+			dataCol->SetSkipFlaggedData(_skipFlaggedData);
+		}
 		else {
 			DyscoWeightColumn* wghtCol = dynamic_cast<DyscoWeightColumn*>(col);
 			if(wghtCol != 0)
-				wghtCol->SetBitsPerSymbol(_weightBitCount);
+			{
+				wghtCol->SetBitsPerSymbol(floatColumnBitCount(col->Name()));
+				wghtCol->SetBlockModes(_weightBlockModes);
+				wghtCol->SetChannelScales(_weightChannelScales);
+				wghtCol->SetPerPolarization(_weightPerPolarization);
+			}
+			DyscoFlagColumn* flagCol = dynamic_cast<DyscoFlagColumn*>(col);
+			if(flagCol != 0)
+				flagCol->SetDerivedFrom(flagSource);
 		}
 		col->Prepare(_distribution, _normalization, _studentTNu, _distributionTruncation);
 	}
 	
-	// In case this is a new measurement set, we do not know the rowsPerBlock yet
-	// If this measurement set is opened, we do know it, and we have to call
-	// initializeRowsPerBlock() to let the columns know this value.
+	if(_variableRowsPerBlock)
+	{
+		if(!_baselineBitCounts.empty() || _losslessAutoCorrelations)
+			throw DyscoStManError("Per-baseline bit counts and lossless autocorrelations assume that every block has the same baselines, and can not be combined with variable rows per block");
+		_timeCol.reset(new casacore::ScalarColumn<double>(table(), casacore::MeasurementSet::columnName(casacore::MSMainEnums::TIME)));
+		_fieldCol.reset(new casacore::ScalarColumn<int>(table(), casacore::MeasurementSet::columnName(casacore::MSMainEnums::FIELD_ID)));
+		_dataDescIdCol.reset(new casacore::ScalarColumn<int>(table(), casacore::MeasurementSet::columnName(casacore::MSMainEnums::DATA_DESC_ID)));
+	}
+	
+	// In case this is a new measurement set, we do not know the rowsPerBlock yet,
+	// unless it was declared. If this measurement set is opened, we do know it, and
+	// we have to call initializeRowsPerBlock() to let the columns know this value.
 	if(areOffsetsInitialized())
+	{
+		if(_declaredRowsPerBlock != 0 && (_declaredRowsPerBlock != _rowsPerBlock || _declaredAntennaCount != _antennaCount))
+		{
+			std::ostringstream s;
+			s << "The declared block layout of " << _declaredRowsPerBlock << " rows and " << _declaredAntennaCount << " antennae does not match the layout of " << _rowsPerBlock << " rows and " << _antennaCount << " antennae in DyscoStMan file '" << fileName() << "'";
+			throw DyscoStManError(s.str());
+		}
 		initializeRowsPerBlock(_rowsPerBlock, _antennaCount, false);
+		// A block index that is missing or behind the file is rebuilt from the table
+		if(_variableRowsPerBlock && _blockStartRows.size()-1 < _nBlocksInFile && _nRow != 0)
+			extendBlockIndex(_nRow - 1);
+	}
+	else if(_declaredRowsPerBlock != 0)
+	{
+		if(!_baselineBitCounts.empty() || _losslessAutoCorrelations)
+			throw DyscoStManError("Per-baseline bit counts and lossless autocorrelations are determined from the first block, and can not be combined with a declared block layout");
+		// A declared layout allows writing blocks out of order, whereas a predicted block
+		// can only be encoded after its keyframe was written
+		if(_predictionInterval > 1)
+			throw DyscoStManError("Predictive encoding requires that the blocks are written in order, and can not be combined with a declared block layout");
+		initializeRowsPerBlock(_declaredRowsPerBlock, _declaredAntennaCount, true);
+	}
+}
+
+DyscoStManColumn* DyscoStMan::derivedFlagSource() const
+{
+	DyscoStManColumn* source = nullptr;
+	for(DyscoStManColumn* col : _columns)
+	{
+		if(dynamic_cast<DyscoDataColumn*>(col) != 0 && (source == nullptr || col->Name() == "DATA"))
+			source = col;
+	}
+	if(source == nullptr)
+	{
+		for(DyscoStManColumn* col : _columns)
+		{
+			if(dynamic_cast<DyscoFlagColumn*>(col) != 0)
+				throw DyscoStManError("Column " + col->Name() + " should be derived from a data column, but the DyscoStMan has no data column");
+		}
+	}
+	return source;
+}
+
+unsigned DyscoStMan::floatColumnBitCount(const std::string& columnName) const
+{
+	std::map<std::string, unsigned>::const_iterator bitCount = _floatColumnBitCounts.find(columnName);
+	if(bitCount != _floatColumnBitCounts.end())
+		return bitCount->second;
+	else if(columnName == "WEIGHT_SPECTRUM")
+		return _weightBitCount;
+	else
+		throw DyscoStManError("Float column " + columnName + " is stored with the weight encoder, which can only store non-negative values, but its bit count was not set.\nSet it with DyscoStMan::SetFloatColumnBitCount() or the floatColumnBitCounts field of the spec");
 }
 
 void DyscoStMan::reopenRW()
@@ -387,12 +1279,38 @@ void DyscoStMan::removeRow(casacore::uInt rowNr)
 	if(rowNr != _nRow-1)
 		throw DyscoStManError("Trying to remove a row in the middle of the file: the DyscoStMan does not support this");
 	_nRow--;
+	if(_variableRowsPerBlock && _blockStartRows.back() > rowNr)
+	{
+		if(rowNr % _rowsPerBlock == 0)
+			_blockPerStride.pop_back();
+		_blockStartRows.back() = rowNr;
+		if(_blockStartRows.back() == _blockStartRows[_blockStartRows.size()-2])
+			_blockStartRows.pop_back();
+		_isBlockIndexChanged = true;
+	}
 }
 
-void DyscoStMan::addColumn(casacore::DataManagerColumn* /*column*/)
+void DyscoStMan::addColumn(casacore::DataManagerColumn* column)
 {
-	if(_nBlocksInFile != 0)
-		throw DyscoStManError("Can't add columns while data has been committed to table");
+	// Preparing the columns again would discard rows that could not be flushed
+	for(DyscoStManColumn* col : _columns)
+	{
+		if(col != column && col->HasUnflushedRows())
+			throw DyscoStManError("Can't add columns before the first time block is complete, because the number of rows per block is not yet known.\nDeclare the layout with DyscoStMan::SetBlockLayout() to add columns earlier");
+	}
+	if(_filePerColumn)
+	{
+		// The existing columns are prepared again, which discards their current block
+		for(DyscoStManColumn* col : _columns)
+		{
+			if(col == column)
+				openColumnFile(col, true);
+			else
+				col->Flush();
+		}
+	}
+	else if(_nBlocksInFile != 0)
+		throw DyscoStManError("Can't add columns while data has been committed to table, unless every column has its own file");
 	
 	prepare();
 	writeHeader();
@@ -404,8 +1322,16 @@ void DyscoStMan::removeColumn(casacore::DataManagerColumn* column)
 	{
 		if(*i == column)
 		{
+			// Deleting the column writes its current block, so its file is
+			// closed and removed afterwards
+			const std::string filename = columnFileName(**i);
 			delete *i;
 			_columns.erase(i);
+			if(_filePerColumn)
+			{
+				_columnFiles.erase(static_cast<const DyscoStManColumn*>(column));
+				unlink(filename.c_str());
+			}
 			writeHeader();
 			return;
 		}
@@ -413,35 +1339,123 @@ void DyscoStMan::removeColumn(casacore::DataManagerColumn* column)
 	throw DyscoStManError("Trying to remove column that was not part of the storage manager");
 }
 
-void DyscoStMan::readCompressedData(size_t blockIndex, const DyscoStManColumn *column, unsigned char* dest, size_t size)
+uint64_t DyscoStMan::nBlocksInFile(const DyscoStManColumn* column) const
+{
+	mutex::scoped_lock lock(_mutex);
+	if(_filePerColumn)
+	{
+		std::map<const DyscoStManColumn*, ColumnFile>::const_iterator file = _columnFiles.find(column);
+		return file == _columnFiles.end() ? 0 : file->second.nBlocks;
+	}
+	else
+		return _nBlocksInFile;
+}
+
+std::string DyscoStMan::columnFileName(const DyscoStManColumn& column) const
+{
+	return fileName() + "_" + column.Name();
+}
+
+void DyscoStMan::openColumnFile(const DyscoStManColumn* column, bool isNew)
+{
+	const std::string filename = columnFileName(*column);
+	ColumnFile& file = _columnFiles[column];
+	ColumnFileHeader header;
+	if(isNew)
+	{
+		file.stream.reset(new std::fstream(filename.c_str(), std::ios_base::in | std::ios_base::out | std::ios_base::trunc));
+		if(file.stream->fail())
+			throw DyscoStManError("I/O error: could not create new file '" + filename + "'");
+		header.magic = ColumnFileMagic;
+		header.versionMajor = VERSION_MAJOR;
+		header.versionMinor = requiredVersionMinor();
+		header.columnName = column->Name();
+		header.Serialize(*file.stream);
+		if(file.stream->fail())
+			throw DyscoStManError("I/O error: could not write header of file '" + filename + "'");
+	}
+	else {
+		file.stream.reset(new std::fstream(filename.c_str(), std::ios_base::in | std::ios_base::out));
+		if(file.stream->fail())
+		{
+			file.stream.reset(new std::fstream(filename.c_str(), std::ios_base::in));
+			if(file.stream->fail())
+				throw DyscoStManError("I/O error: could not open file '" + filename + "', which should be an existing file");
+		}
+		header.Unserialize(*file.stream);
+		if(file.stream->fail() || header.magic != ColumnFileMagic)
+			throw DyscoStManError("I/O error: file '" + filename + "' is not a DyscoStMan column file");
+		if(header.versionMajor != VERSION_MAJOR || header.versionMinor > VERSION_MINOR)
+		{
+			std::ostringstream s;
+			s << "The column file '" << filename << "' has file format version " << header.versionMajor << "." << header.versionMinor << ", but this version of Dysco can only open file format versions " << VERSION_MAJOR << ".0 to " << VERSION_MAJOR << "." << VERSION_MINOR << ". Upgrade Dysco.\n";
+			throw DyscoStManError(s.str());
+		}
+		if(header.columnName != column->Name())
+			throw DyscoStManError("The file '" + filename + "' stores column " + header.columnName + " instead of column " + column->Name());
+	}
+	file.nBlocks = 0;
+	file.blockSize = 0;
+	file.headerSize = header.calculateSize();
+}
+
+DyscoStMan::ColumnFile& DyscoStMan::columnFile(const DyscoStManColumn* column)
+{
+	std::map<const DyscoStManColumn*, ColumnFile>::iterator file = _columnFiles.find(column);
+	if(file == _columnFiles.end())
+		throw DyscoStManError("Column " + column->Name() + " has no opened file in DyscoStMan '" + fileName() + "'");
+	return file->second;
+}
+
+void DyscoStMan::readCompressedData(size_t blockIndex, const DyscoStManColumn *column, unsigned char* dest, size_t size, size_t offset)
 {
 	mutex::scoped_lock lock(_mutex);
-	size_t fileOffset = getFileOffset(blockIndex);
+	std::fstream* stream = _fStream.get();
+	size_t fileOffset, nBlocks = _nBlocksInFile;
+	if(_filePerColumn)
+	{
+		const ColumnFile& file = columnFile(column);
+		stream = file.stream.get();
+		fileOffset = file.headerSize + file.blockSize * blockIndex + offset;
+		nBlocks = file.nBlocks;
+	}
+	else
+		fileOffset = getFileOffset(blockIndex) + column->OffsetInBlock() + offset;
 	
-	size_t columnOffset = column->OffsetInBlock();
-	_fStream->seekg(fileOffset + columnOffset, std::ios_base::beg);
-	_fStream->read(reinterpret_cast<char*>(dest), size);
-	if(_fStream->fail())
+	stream->seekg(fileOffset, std::ios_base::beg);
+	stream->read(reinterpret_cast<char*>(dest), size);
+	if(stream->fail())
 	{
 		// This can be sort of ok ; row exists because other columns have written here,
 		// but no data had been written yet for this column
-		if(blockIndex+1 != _nBlocksInFile)
+		if(blockIndex+1 != nBlocks)
 			throw DyscoStManError("I/O error: error while reading file '" + fileName() + "'");
-		_fStream->clear(); // reset fail bit
+		stream->clear(); // reset fail bit
 	}
 }
 
 void DyscoStMan::writeCompressedData(size_t blockIndex, const DyscoStManColumn *column, const unsigned char *data, size_t size)
 {
 	mutex::scoped_lock lock(_mutex);
+	std::fstream* stream = _fStream.get();
+	size_t fileOffset;
+	if(_filePerColumn)
+	{
+		ColumnFile& file = columnFile(column);
+		if(file.nBlocks <= blockIndex)
+			file.nBlocks = blockIndex + 1;
+		stream = file.stream.get();
+		fileOffset = file.headerSize + file.blockSize * blockIndex;
+	}
+	else
+		fileOffset = getFileOffset(blockIndex) + column->OffsetInBlock();
 	if(_nBlocksInFile <= blockIndex)
 	{
 		_nBlocksInFile = blockIndex + 1;
 	}
-	size_t fileOffset = getFileOffset(blockIndex);
-	_fStream->seekp(fileOffset + column->OffsetInBlock(), std::ios_base::beg);
-	_fStream->write(reinterpret_cast<const char*>(data), size);
-	if(_fStream->fail())
+	stream->seekp(fileOffset, std::ios_base::beg);
+	stream->write(reinterpret_cast<const char*>(data), size);
+	if(stream->fail())
 		throw DyscoStManError("I/O error: error while writing file '" + fileName() + "'");
 }
 
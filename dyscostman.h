@@ -5,12 +5,18 @@
 
 #include <casacore/casa/Containers/Record.h>
 
+#include <casacore/tables/Tables/ScalarColumn.h>
+
 #include <fstream>
+#include <map>
+#include <memory>
 #include <vector>
 
 #include "uvector.h"
 #include "dyscodistribution.h"
 #include "dysconormalization.h"
+#include "dyscostatistics.h"
+#include "dyscotrace.h"
 #include "thread.h"
 
 /**
@@ -126,10 +132,281 @@ public:
 		_normalization = normalization;
 	}
 	
+	/**
+	 * Use a different number of bits for each polarization of the data column,
+	 * e.g. to store the cross-hand polarizations, which mostly contain noise,
+	 * with fewer bits. The number of values should equal the number of polarizations
+	 * of the data column. The data bit count is still used to normalize the data.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 * @param bitCounts Bits per float for each polarization index, or an empty
+	 * vector to use the data bit count for all polarizations (the default).
+	 */
+	void SetDataBitCountPerPolarization(const std::vector<unsigned>& bitCounts)
+	{
+		_dataBitCountPerPol = bitCounts;
+	}
+	
+	/**
+	 * Use a different number of bits for short and long baselines of the data
+	 * column. Short baselines have a higher signal-to-noise ratio and therefore
+	 * benefit more from extra bits. Baselines are divided in classes by their
+	 * UVW length in the first time block, and each row index within a block
+	 * keeps the class of that first block. The table therefore needs a UVW column,
+	 * of which the rows of the first block are written before the second block starts.
+	 * This can not be combined with SetDataBitCountPerPolarization().
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 * @param bitCounts Bits per float for each baseline class, ordered from the shortest
+	 * to the longest baselines. An empty vector disables this mode (the default).
+	 * @param lengthThresholds Baseline lengths in metres at which the next class starts,
+	 * one less than the number of classes. When empty, the thresholds are chosen such that
+	 * every class holds the same number of baselines.
+	 */
+	void SetBaselineBitCounts(const std::vector<unsigned>& bitCounts, const std::vector<double>& lengthThresholds = std::vector<double>())
+	{
+		_baselineBitCounts = bitCounts;
+		_baselineLengthThresholds = lengthThresholds;
+	}
+	
+	/**
+	 * Store weight blocks in which all weights are equal as a single value, and
+	 * weight blocks in which every row has a single weight with one value per row.
+	 * Disabled by default. This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetWeightBlockModes(bool weightBlockModes)
+	{
+		_weightBlockModes = weightBlockModes;
+	}
+	
+	/**
+	 * Quantize the weights of every channel relative to the largest weight of that
+	 * channel in the block, instead of the largest weight of the block. This stores
+	 * one extra float per channel and block, but keeps channels with smaller weights
+	 * accurate at lower weight bit counts. Disabled by default. This requires
+	 * file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetWeightChannelScales(bool weightChannelScales)
+	{
+		_weightChannelScales = weightChannelScales;
+	}
+	
+	/**
+	 * Store a weight for every polarization. By default, the smallest weight of the
+	 * polarizations is stored, which is sufficient when all polarizations are
+	 * flagged together. This multiplies the size of the weights by the
+	 * number of polarizations. This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetWeightPerPolarization(bool weightPerPolarization)
+	{
+		_weightPerPolarization = weightPerPolarization;
+	}
+	
+	/**
+	 * Store the Float column with the given name with the weight encoder, with the
+	 * given number of bits per value. Without this, WEIGHT_SPECTRUM is the only Float
+	 * column that can be stored, with the weight bit count. The weight encoder quantizes
+	 * between zero and the maximum of a block, so writing a negative or non-finite value
+	 * to the column is an error. This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetFloatColumnBitCount(const std::string& columnName, unsigned bitCount)
+	{
+		_floatColumnBitCounts[columnName] = bitCount;
+	}
+	
+	/**
+	 * Derive the Bool columns of this manager, such as FLAG, from a data column
+	 * instead of storing them: a value is flagged when the visibility is not finite.
+	 * The data column named DATA is used when there is one, otherwise the first data column.
+	 * Derived columns take no space and can not be written, so the writer should set
+	 * flagged visibilities to NaN. Can not be combined with the Stokes transform.
+	 * This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetDeriveFlags(bool deriveFlags)
+	{
+		_deriveFlags = deriveFlags;
+	}
+	
+	/**
+	 * Store the autocorrelations of the data columns without loss, as floats. The
+	 * autocorrelation rows are those with equal antennas in the first block,
+	 * and are stored without loss in every block. Autocorrelations are much larger than
+	 * cross-correlations, and are therefore not quantized well together with them.
+	 * This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetLosslessAutoCorrelations(bool losslessAutoCorrelations)
+	{
+		_losslessAutoCorrelations = losslessAutoCorrelations;
+	}
+	
+	/**
+	 * Encode the blocks of the data columns as the difference with a keyframe, which
+	 * is every interval'th block. Consecutive timesteps are often similar, in which
+	 * case the residual is smaller than the values and is quantized with a smaller error.
+	 * A larger interval predicts more blocks, but from keyframes that are further away.
+	 * Blocks should be written in order, because a block is encoded after its keyframe
+	 * was written. When a keyframe is rewritten, the blocks that were predicted from it are
+	 * encoded again. Can not be combined with a declared block layout. This requires file
+	 * format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 * @param interval Number of blocks per keyframe; 0 or 1 disables prediction.
+	 */
+	void SetPredictionInterval(unsigned interval)
+	{
+		_predictionInterval = interval;
+	}
+	
+	/**
+	 * Quantize the sums and differences of the four correlations of the data columns, which
+	 * are similar to the Stokes parameters, instead of the correlations. Combined with
+	 * SetDataBitCountPerPolarization(), the weak polarized products can be stored with
+	 * fewer bits than the total intensity. Requires data columns with four polarizations
+	 * and file format version 1.4, and can not be combined with derived flags.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetStokesTransform(bool stokesTransform)
+	{
+		_stokesTransform = stokesTransform;
+	}
+	
+	/**
+	 * Do not store the symbols of rows and channels of the data columns in which every
+	 * value of a block is non-finite, e.g. of a dead station or of channels that are flagged
+	 * because of RFI. Every data block stores which rows and channels are present, and the
+	 * missing ones are decoded as NaN. The space for a full block remains reserved in
+	 * the file, but only the remaining symbols are read and written. Can not be
+	 * combined with bit counts per polarization or per baseline. This requires
+	 * file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetSkipFlaggedData(bool skipFlaggedData)
+	{
+		_skipFlaggedData = skipFlaggedData;
+	}
+	
+	/**
+	 * Declare the layout of the blocks of a new measurement set up front. Without it,
+	 * the layout is determined from the first time block that is written, the
+	 * first blocks need to be written consecutively, and a flush before the first time
+	 * block is complete keeps its rows in memory. With a declared layout, blocks
+	 * can be written in any order and flushed at any time. It can not be combined with per-baseline bit counts
+	 * or lossless autocorrelations, because these are determined from the rows of the
+	 * first block, nor with predictive encoding, which requires ordered writes. For an existing file, the declared layout should match the layout
+	 * of the file.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 * @param rowsPerBlock Number of rows in one time block, e.g. the number of baselines.
+	 * @param antennaCount Highest antenna index + 1 used in a time block.
+	 */
+	void SetBlockLayout(size_t rowsPerBlock, size_t antennaCount)
+	{
+		_declaredRowsPerBlock = rowsPerBlock;
+		_declaredAntennaCount = antennaCount;
+	}
+	
+	/**
+	 * Support measurement sets in which the timesteps have different baselines. Every
+	 * time block then ends where the time, field or spw changes, and the rows per block
+	 * become the maximum number of rows of a block: longer time blocks are split. The first
+	 * row of every block is stored in a block index file next to the data file, which is
+	 * extended while rows are written, and each block takes its baselines from the ANTENNA1
+	 * and ANTENNA2 columns of its rows. To allow for antennas that are not
+	 * in the first block, the antenna count is at least the number of rows of the
+	 * ANTENNA table. Rows should be written in order, and their time, field and spw should be
+	 * set before their data is written; writing fails otherwise, because the blocks
+	 * are indexed while the rows are written. It can not be combined with per-baseline bit counts
+	 * or lossless autocorrelations. This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetVariableRowsPerBlock(bool variableRowsPerBlock)
+	{
+		_variableRowsPerBlock = variableRowsPerBlock;
+	}
+	
+	/**
+	 * Set the shape with which columns that have no fixed shape are stored, such as the
+	 * data of a measurement set with spectral windows of different channel counts. Every
+	 * row of such a column has the number of channels of its DATA_DESC_ID, which is set
+	 * by the first row of that data description that is written. Rows with fewer channels
+	 * are padded: the padding of data columns consists of NaNs, which are not stored when
+	 * SetSkipFlaggedData() is enabled. The channel counts are stored in the block index
+	 * file. Columns without a fixed shape can only be added when this is set.
+	 * This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 * @param nPolarizations Number of polarizations of every row.
+	 * @param nChannels Maximum number of channels of a row.
+	 */
+	void SetMaximumShape(size_t nPolarizations, size_t nChannels)
+	{
+		_maxPolarizations = nPolarizations;
+		_maxChannels = nChannels;
+	}
+	
+	/**
+	 * Store the blocks of every column in a separate file, named after the file of the
+	 * manager and the column, instead of interleaving the columns in one file. Each column
+	 * file starts with a short header with the file version and the column name, and the
+	 * file of the manager then only holds the headers of the manager. Columns can then be added while
+	 * data has already been written, e.g. a MODEL_DATA column to a measurement set
+	 * that has compressed DATA, and reading one column does not read the blocks of the
+	 * other columns. This requires file format version 1.4.
+	 * This method should only be called directly after creating DyscoStMan, before adding
+	 * columns, and reading/writing data.
+	 */
+	void SetFilePerColumn(bool filePerColumn)
+	{
+		_filePerColumn = filePerColumn;
+	}
+	
 	void SetStaticSeed(bool staticSeed)
 	{
 		_staticSeed = staticSeed;
 	}
+	
+	/**
+	 * Record the activity of all threads that read and write the columns of this
+	 * manager, and write it as a Chrome trace to the given file when the manager is
+	 * closed. The trace can be inspected with chrome://tracing or Perfetto.
+	 * This method should only be called directly after creating DyscoStMan, before
+	 * adding columns. Tracing can also be enabled with the "traceFile" spec field, or
+	 * by setting the environment variable DYSCO_TRACE. In the latter case, the value of the
+	 * variable is used as prefix, and the name of the manager and ".json" are appended to
+	 * form the filename.
+	 * @param filename Trace filename, or an empty string to disable tracing.
+	 * @throws DyscoStManError if columns were already added.
+	 */
+	void SetTraceFile(const std::string& filename);
+	
+	/**
+	 * Measure the accuracy of the compression while encoding. Every encoded block is
+	 * decoded again by the encoding thread and compared with the original values.
+	 * The results can be retrieved with GetErrorStatistics().
+	 * This can also be enabled with the "errorStatistics" spec field, or by setting
+	 * the environment variable DYSCO_STATISTICS.
+	 * This method should only be called directly after creating DyscoStMan, before
+	 * writing data.
+	 */
+	void SetErrorStatistics(bool errorStatistics)
+	{
+		_errorStatistics = errorStatistics;
+	}
 
 	/**
 	* This constructor is called by Casa when it needs to create a DyscoStMan.
@@ -197,8 +474,11 @@ public:
 
 	/**
 	* Whether columns can be added.
-	* @returns @c true (but restrictions apply; columns can only be added as long
-	* as no writes have been performed on the set).
+	* @returns @c true (but restrictions apply; with SetFilePerColumn(), columns can
+	* also be added after data was written, otherwise only as long as no blocks
+	* have been written to the file. In both cases, columns can not be added while
+	* another column holds rows of a first time block that is not yet complete,
+	* unless the layout was declared with SetBlockLayout()).
 	*/
 	virtual casacore::Bool canAddColumn() const final override { return true; }
 
@@ -232,6 +512,80 @@ public:
 	*/
 	static void registerClass();
 	
+	/**
+	* Get the time spent in each stage of the encoding and decoding pipelines,
+	* summed over all columns and threads. This method is thread-safe, and can
+	* be called while data is being written.
+	* If the environment variable DYSCO_STATISTICS is set, a summary of
+	* these timings is written to the standard output when the manager is closed.
+	* @returns The total timings of this storage manager.
+	*/
+	DyscoTimings GetTimings() const;
+	
+	/**
+	* Get the time spent in each stage of the encoding and decoding pipelines
+	* of a single column.
+	* @param columnName Name of the column.
+	* @returns The timings of the column.
+	* @throws DyscoStManError if this manager does not store the given column.
+	*/
+	DyscoTimings GetTimings(const std::string& columnName) const;
+	
+	/**
+	 * Get the accuracy of the compression, summed over all columns. This is only
+	 * measured when enabled (see SetErrorStatistics()). This method is thread-safe.
+	 * @returns The error statistics of all blocks that were encoded so far.
+	 */
+	DyscoErrorStatistics GetErrorStatistics() const;
+	
+	/**
+	 * Get the accuracy of the compression of a single column.
+	 * @param columnName Name of the column.
+	 * @returns The error statistics of the column.
+	 * @throws DyscoStManError if this manager does not store the given column.
+	 */
+	DyscoErrorStatistics GetErrorStatistics(const std::string& columnName) const;
+	
+	/**
+	 * Get a histogram of the number of blocks in the write cache of a column. Element i
+	 * holds how often the cache contained i blocks after a block was submitted for
+	 * encoding. Together with the waiting times returned by GetTimings(), this shows
+	 * whether writing is limited by the number of encoding threads, the cache size or I/O.
+	 * @param columnName Name of the column.
+	 * @returns The histogram, which is empty when no blocks were written.
+	 * @throws DyscoStManError if this manager does not store the given column.
+	 */
+	std::vector<uint64_t> GetCacheOccupancy(const std::string& columnName) const;
+	
+	/**
+	 * Get the number of bytes that the columns of this manager have allocated, per
+	 * category (write cache, decoded block, read buffers and encode buffers). Both
+	 * the current and peak usage are returned. The peaks are the sum of the peaks
+	 * of the columns. This method is thread-safe.
+	 * @returns Memory usage of all columns.
+	 */
+	DyscoMemoryUsage GetMemoryUsage() const;
+	
+	/**
+	 * Get the number of bytes allocated by a single column.
+	 * @param columnName Name of the column.
+	 * @returns Memory usage of the column.
+	 * @throws DyscoStManError if this manager does not store the given column.
+	 */
+	DyscoMemoryUsage GetMemoryUsage(const std::string& columnName) const;
+	
+	/**
+	 * Get the baseline class of every row index within a block, see SetBaselineBitCounts().
+	 * This method is thread-safe.
+	 * @returns Index into the baseline bit counts for every row of a block. Empty when no
+	 * baseline bit counts are set, or when the first block is not complete yet.
+	 */
+	std::vector<uint8_t> GetBaselineClasses() const
+	{
+		altthread::mutex::scoped_lock lock(_mutex);
+		return _baselineClassPerBlockRow;
+	}
+	
 protected:
 	/**
 	* The number of rows that are actually stored in the file.
@@ -243,11 +597,19 @@ protected:
 		return _nBlocksInFile;
 	}
 	
+	/**
+	 * The number of blocks that are stored for the given column. This is nBlocksInFile(),
+	 * unless every column has its own file.
+	 * This method is synchronized (i.e., thread-safe).
+	 */
+	uint64_t nBlocksInFile(const DyscoStManColumn* column) const;
+	
 	/**
 	 * Number of rows in one "time-block", i.e. a sequence of rows that
-	 * belong to the same timestep, spw and field.
-	 * This value is only available after a first time block was written
-	 * (see areOffsetsInitialized()).
+	 * belong to the same timestep, spw and field. With variable rows per
+	 * block, this is the maximum number of rows in a block (see rowsInBlock()).
+	 * This value is only available after a first time block was written, or
+	 * when the layout was declared (see areOffsetsInitialized()).
 	 * @returns Number of measurement set rows in one time block.
 	 */
 	size_t nRowsInBlock() const { return _rowsPerBlock; }
@@ -268,7 +630,13 @@ protected:
 	 * @param row A measurement set row.
 	 * @returns Block index.
 	 */
-	size_t getBlockIndex(uint64_t row) const { return row / _rowsPerBlock; }
+	size_t getBlockIndex(uint64_t row) const
+	{
+		if(_variableRowsPerBlock)
+			return findBlock(row);
+		else
+			return row / _rowsPerBlock;
+	}
 	
 	/**
 	 * Return the offset of the row within the block.
@@ -278,19 +646,77 @@ protected:
 	 * @param row A measurement set row.
 	 * @returns offset of row within block.
 	 */
-	size_t getRowWithinBlock(uint64_t row) const { return row % _rowsPerBlock; }
+	size_t getRowWithinBlock(uint64_t row) const
+	{
+		if(_variableRowsPerBlock)
+			return row - getRowIndex(findBlock(row));
+		else
+			return row % _rowsPerBlock;
+	}
 	
 	/**
 	 * Calculate first measurement set row index of a given block index.
+	 * With variable rows per block, blocks beyond the block index are assumed
+	 * to hold nRowsInBlock() rows.
 	 * @param block A block index
 	 * @returns First measurement set row index of given block.
 	 */
-	uint64_t getRowIndex(size_t block) const { return uint64_t(block) * uint64_t(_rowsPerBlock); }
+	uint64_t getRowIndex(size_t block) const
+	{
+		const size_t indexedBlocks = _blockStartRows.size() - 1;
+		if(_variableRowsPerBlock && block < indexedBlocks)
+			return _blockStartRows[block];
+		else if(_variableRowsPerBlock)
+			return _blockStartRows.back() + uint64_t(block - indexedBlocks) * uint64_t(_rowsPerBlock);
+		else
+			return uint64_t(block) * uint64_t(_rowsPerBlock);
+	}
+	
+	/**
+	 * Number of measurement set rows in the given block. This is nRowsInBlock(),
+	 * unless rows per block are variable and the block is in the block index. The
+	 * last indexed block can still grow while rows are written.
+	 * @param block A block index
+	 * @returns Number of rows of the block.
+	 */
+	size_t rowsInBlock(size_t block) const
+	{
+		if(_variableRowsPerBlock && block+1 < _blockStartRows.size())
+			return _blockStartRows[block+1] - _blockStartRows[block];
+		else
+			return _rowsPerBlock;
+	}
+	
+	/**
+	 * Extend the block index up to and including the given row, when rows per block
+	 * are variable. To be called before a row is written. Rows should be written in
+	 * order and their time, field and spw should be set; a row that is written again
+	 * should still match the index. A DyscoStManError is thrown otherwise.
+	 * @param row A measurement set row.
+	 */
+	void indexRows(uint64_t row);
+	
+	/**
+	 * Number of channels of the rows with the given data description in
+	 * columns without a fixed shape.
+	 * @returns The channel count, or 0 when no row of the data description was written.
+	 */
+	size_t dataDescChannelCount(int dataDescId) const
+	{
+		std::map<int, uint32_t>::const_iterator i = _channelsPerDataDesc.find(dataDescId);
+		return i == _channelsPerDataDesc.end() ? 0 : i->second;
+	}
+	
+	/**
+	 * Set the number of channels of the rows with the given data description.
+	 * @throws DyscoStManError when the data description already has a different channel count.
+	 */
+	void setDataDescChannelCount(int dataDescId, size_t nChannels);
 	
 	/**
 	 * This method returns @c true when the number of rows per block and the number
 	 * of antennae per block are known. This is only the case once the first time-
-	 * block was written to the file.
+	 * block was written to the file, or when the layout was declared with SetBlockLayout().
 	 * @returns True when the nr of rows per block and antennae are available.
 	 */
 	bool areOffsetsInitialized() const { return _rowsPerBlock!=0; }
@@ -307,23 +733,102 @@ private:
 	
 	const static unsigned short VERSION_MAJOR, VERSION_MINOR;
 		
-	void readCompressedData(size_t blockIndex, const DyscoStManColumn *column, unsigned char *dest, size_t size);
+	void readCompressedData(size_t blockIndex, const DyscoStManColumn *column, unsigned char *dest, size_t size, size_t offset);
 	
 	void writeCompressedData(size_t blockIndex, const DyscoStManColumn *column, const unsigned char *data, size_t size);
 	
 	void readHeader();
 	
 	void writeHeader();
+	
+	/** Lowest minor file format version that can store the current settings. */
+	unsigned short requiredVersionMinor() const;
+	
+	/** Combination of HeaderFeatureFlags for the current settings. */
+	uint32_t featureFlags() const;
+	
+	/** The data column from which the Bool columns are derived when flags are derived. */
+	DyscoStManColumn* derivedFlagSource() const;
+	
+	/** Bits per value of the given Float column; throws when the column can not be stored. */
+	unsigned floatColumnBitCount(const std::string& columnName) const;
+	
+	/**
+	 * Assign a baseline class to every row index of a block from the UVW lengths of the first block.
+	 * @throws DyscoStManError if the table has no UVW column.
+	 */
+	void initializeBaselineClasses(size_t rowsPerBlock);
+	
+	/** Find the autocorrelation rows of a block from the antennas of the first block. */
+	void initializeLosslessBlockRows();
 
 	void makeEmpty();
 	
+	void printStatistics(std::ostream& stream) const;
+	
 	void setFromSpec(const casacore::Record& spec);
 	
+	void initializeTracer();
+	
+	/** Get a trace buffer for a new thread, or nullptr when tracing is disabled. */
+	TraceBuffer* newTraceBuffer(const std::string& threadName);
+	
+	bool isErrorStatisticsEnabled() const { return _errorStatistics; }
+	
+	const DyscoStManColumn& findColumn(const std::string& columnName) const;
+	
 	size_t getFileOffset(size_t blockIndex) const { return _blockSize * blockIndex + _headerSize; }
 	
+	/** Block that holds the given row, using the block index. */
+	size_t findBlock(uint64_t row) const;
+	
+	/**
+	 * Name of the file that stores the first row of every block with variable rows per
+	 * block, and the channel count of every data description.
+	 */
+	std::string blockIndexFileName() const { return fileName() + "_blocks"; }
+	
+	void readBlockIndex();
+	
+	/** Add the rows up to and including the given row to the block index, from the
+	 * time, field and spw of the rows in the table. */
+	void extendBlockIndex(uint64_t row);
+	
+	/** Whether the time, field or spw of a row differs from the previous row. */
+	bool isTimeBlockStart(uint64_t row) const;
+	
+	/** Throw when the block index does not match the time, field and spw of an indexed row. */
+	void checkIndexedRow(uint64_t row) const;
+	
+	/** Name of the file with the blocks of a column, when every column has its own file. */
+	std::string columnFileName(const DyscoStManColumn& column) const;
+	
+	/**
+	 * Open the file with the blocks of a column, when every column has its own file.
+	 * A new file starts with a ColumnFileHeader, which is checked when an existing
+	 * file is opened.
+	 * @param isNew Whether a new, empty file is created.
+	 */
+	void openColumnFile(const DyscoStManColumn* column, bool isNew);
+	
+	struct ColumnFile;
+	
+	/** The opened file of a column, when every column has its own file. */
+	ColumnFile& columnFile(const DyscoStManColumn* column);
+	
+	void writeBlockIndex();
+	
+	/** Calculate _blockPerStride from _blockStartRows. */
+	void initializeBlockStrides();
+	
 	// Flush and optionally fsync the data.
 	// The AipsIO stream represents the main table file and can be
 	// used by virtual column engines to store SMALL amounts of data.
+	// The blocks that were changed are encoded and written, including the
+	// incomplete current block, which is written again once it is completed.
+	// When the first time block was not completed and no layout was declared,
+	// the rows per block are not known and the rows stay in memory; they are
+	// written once the first time block is complete, or when the table is closed.
 	virtual casacore::Bool flush(casacore::AipsIO&, casacore::Bool doFsync) final override;
 	
 	// Let the storage manager create files as needed for a new table.
@@ -386,10 +891,58 @@ private:
 	std::string _name;
 	unsigned _dataBitCount;
 	unsigned _weightBitCount;
+	std::vector<unsigned> _dataBitCountPerPol;
+	std::vector<unsigned> _baselineBitCounts;
+	std::vector<double> _baselineLengthThresholds;
+	std::vector<uint8_t> _baselineClassPerBlockRow;
+	bool _weightBlockModes;
+	bool _weightChannelScales;
+	bool _weightPerPolarization;
+	std::map<std::string, unsigned> _floatColumnBitCounts;
+	bool _deriveFlags;
+	bool _losslessAutoCorrelations;
+	std::vector<uint32_t> _losslessBlockRows;
+	unsigned _predictionInterval;
+	bool _stokesTransform;
+	bool _skipFlaggedData;
+	uint32_t _declaredRowsPerBlock;
+	uint32_t _declaredAntennaCount;
+	bool _variableRowsPerBlock;
+	/**
+	 * The first row of every indexed block, followed by the end of the last indexed block.
+	 * Only used with variable rows per block.
+	 */
+	std::vector<uint64_t> _blockStartRows;
+	/**
+	 * For every multiple k of the rows per block, the block that holds row k*rowsPerBlock.
+	 * Because a block holds at most rowsPerBlock rows, this limits the search for the
+	 * block of a row to the blocks between two entries.
+	 */
+	std::vector<uint32_t> _blockPerStride;
+	bool _isBlockIndexChanged;
+	std::unique_ptr<casacore::ScalarColumn<double>> _timeCol;
+	std::unique_ptr<casacore::ScalarColumn<int>> _fieldCol, _dataDescIdCol;
+	uint32_t _maxPolarizations, _maxChannels;
+	std::map<int, uint32_t> _channelsPerDataDesc;
+	bool _filePerColumn;
+	struct ColumnFile
+	{
+		ColumnFile() : nBlocks(0), blockSize(0), headerSize(0) { }
+		std::unique_ptr<std::fstream> stream;
+		uint64_t nBlocks;
+		size_t blockSize;
+		/** Size of the ColumnFileHeader, after which the blocks start */
+		size_t headerSize;
+	};
+	/** The file of every column, when every column has its own file. */
+	std::map<const DyscoStManColumn*, ColumnFile> _columnFiles;
 	DyscoDistribution _distribution;
 	DyscoNormalization _normalization;
 	double _studentTNu, _distributionTruncation;
 	bool _staticSeed;
+	bool _errorStatistics;
+	std::string _traceFile;
+	std::unique_ptr<DyscoTracer> _tracer;
 
 	std::vector<DyscoStManColumn*> _columns;
 };
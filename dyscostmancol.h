@@ -3,6 +3,8 @@
 
 #include "dyscodistribution.h"
 #include "dysconormalization.h"
+#include "dyscostatistics.h"
+#include "dyscotrace.h"
 
 #include <casacore/tables/DataMan/StManColumn.h>
 
@@ -26,12 +28,15 @@ public:
 	/**
 	 * Constructor, to be overloaded by subclass.
 	 * @param parent The parent stman to which this column belongs.
+	 * @param name Name of the column.
 	 * @param dtype The column's type as defined by Casacore.
 	 */
-  explicit DyscoStManColumn(DyscoStMan* parent, int dtype) :
+  explicit DyscoStManColumn(DyscoStMan* parent, const std::string& name, int dtype) :
 		casacore::StManColumn(dtype),
 		_offsetInBlock(0),
-		_storageManager(parent)
+		_isVariableShape(false),
+		_storageManager(parent),
+		_name(name)
 	{	}
   
   /** Destructor */
@@ -39,6 +44,20 @@ public:
 	
 	/** To be called before destructing the class. */
 	virtual void shutdown() = 0;
+	
+	/**
+	 * Write the changes of this column to the file, without closing it. The current
+	 * block stays in memory, such that it can be completed afterwards. Rows that are
+	 * written before the layout of the blocks is known are kept in memory.
+	 * @returns @c true when data was written.
+	 */
+	virtual bool Flush() = 0;
+	
+	/**
+	 * Whether rows were written that Flush() can not write yet, because the layout
+	 * of the blocks is not known before the first time block is complete.
+	 */
+	virtual bool HasUnflushedRows() const = 0;
 
 	/**
 	 * Whether this column is writable
@@ -68,17 +87,48 @@ public:
 	void SetOffsetInBlock(size_t offsetInBlock) {
 		_offsetInBlock = offsetInBlock;
 	}
+	
+	/** Name of the column, as given when it was created. */
+	const std::string& Name() const { return _name; }
+	
+	/**
+	 * Whether the rows of this column have the channel count of their data description,
+	 * instead of the shape of the column. Such columns are stored with the
+	 * maximum shape of the manager (see DyscoStMan::SetMaximumShape()).
+	 */
+	bool IsVariableShape() const { return _isVariableShape; }
+	
+	void SetVariableShape() { _isVariableShape = true; }
+	
+	/**
+	 * Statistics (such as timings) that are collected while
+	 * reading and writing this column.
+	 */
+	const DyscoStatistics& Statistics() const { return _statistics; }
 
 protected:
 	/** Get the storage manager for this column */
 	DyscoStMan &storageManager() const { return *_storageManager; }
 	
+	DyscoStatistics& statistics() { return _statistics; }
+	
+	/**
+	 * Get an event buffer for a new thread that reads or writes this column.
+	 * @param threadName Description of the thread, shown in the trace.
+	 * @returns The buffer, or nullptr when tracing is disabled.
+	 */
+	TraceBuffer* newTraceBuffer(const std::string& threadName);
+	
+	/** Whether the accuracy of the compression should be measured while encoding. */
+	bool isErrorStatisticsEnabled() const;
+	
 	/**
 	 * Read a row of compressed data from the stman file.
 	 * @param rowIndex The index of the row to read.
 	 * @param dest The destination buffer, should be at least of size Stride().
+	 * @param offset Offset of the first byte to read within the block of this column.
 	 */
-	void readCompressedData(size_t blockIndex, unsigned char* dest, size_t size);
+	void readCompressedData(size_t blockIndex, unsigned char* dest, size_t size, size_t offset = 0);
 	
 	/**
 	 * Write a row of compressed data to the stman file.
@@ -102,6 +152,14 @@ protected:
 	
 	uint64_t getRowIndex(size_t block) const;
 	
+	size_t rowsInBlock(size_t block) const;
+	
+	void indexRows(uint64_t row);
+	
+	size_t dataDescChannelCount(int dataDescId) const;
+	
+	void setDataDescChannelCount(int dataDescId, size_t nChannels);
+	
 	bool areOffsetsInitialized() const;
 	
 	void initializeRowsPerBlock(size_t rowsPerBlock, size_t antennaCount);
@@ -110,7 +168,10 @@ private:
 	void operator=(const DyscoStManColumn &source) = delete;
 	
 	size_t _offsetInBlock;
+	bool _isVariableShape;
   DyscoStMan *_storageManager;
+	std::string _name;
+	DyscoStatistics _statistics;
 };
 
 } // end of namespace
@@ -119,9 +180,9 @@ private:
 
 namespace dyscostman {
 	
-inline void DyscoStManColumn::readCompressedData(size_t blockIndex, unsigned char* dest, size_t size)
+inline void DyscoStManColumn::readCompressedData(size_t blockIndex, unsigned char* dest, size_t size, size_t offset)
 {
-	_storageManager->readCompressedData(blockIndex, this, dest, size);
+	_storageManager->readCompressedData(blockIndex, this, dest, size, offset);
 }
 
 inline void DyscoStManColumn::writeCompressedData(size_t blockIndex, const unsigned char* data, size_t size)
@@ -129,9 +190,19 @@ inline void DyscoStManColumn::writeCompressedData(size_t blockIndex, const unsig
 	_storageManager->writeCompressedData(blockIndex, this, data, size);
 }
 
+inline TraceBuffer* DyscoStManColumn::newTraceBuffer(const std::string& threadName)
+{
+	return _storageManager->newTraceBuffer(threadName);
+}
+
+inline bool DyscoStManColumn::isErrorStatisticsEnabled() const
+{
+	return _storageManager->isErrorStatisticsEnabled();
+}
+
 inline uint64_t DyscoStManColumn::nBlocksInFile() const
 {
-	return _storageManager->nBlocksInFile();
+	return _storageManager->nBlocksInFile(this);
 }
 
 inline size_t DyscoStManColumn::getBlockIndex(uint64_t row) const
@@ -154,6 +225,26 @@ inline uint64_t DyscoStManColumn::getRowIndex(size_t block) const
 	return _storageManager->getRowIndex(block);
 }
 
+inline size_t DyscoStManColumn::rowsInBlock(size_t block) const
+{
+	return _storageManager->rowsInBlock(block);
+}
+
+inline void DyscoStManColumn::indexRows(uint64_t row)
+{
+	_storageManager->indexRows(row);
+}
+
+inline size_t DyscoStManColumn::dataDescChannelCount(int dataDescId) const
+{
+	return _storageManager->dataDescChannelCount(dataDescId);
+}
+
+inline void DyscoStManColumn::setDataDescChannelCount(int dataDescId, size_t nChannels)
+{
+	_storageManager->setDataDescChannelCount(dataDescId, nChannels);
+}
+
 inline size_t DyscoStManColumn::getRowWithinBlock(uint64_t rowIndex) const
 {
 	return _storageManager->getRowWithinBlock(rowIndex);
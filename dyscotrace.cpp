@@ -0,0 +1,76 @@
+#include "dyscotrace.h"
+#include "dyscostmanerror.h"
+
+#include <fstream>
+
+#include <unistd.h>
+
+namespace dyscostman {
+
+namespace {
+	void writeEscaped(std::ostream& stream, const std::string& str)
+	{
+		for(char c : str)
+		{
+			if(c == '"' || c == '\\')
+				stream << '\\';
+			stream << c;
+		}
+	}
+	
+	// Chrome traces use microseconds
+	void writeMicroseconds(std::ostream& stream, uint64_t nanoseconds)
+	{
+		stream << (nanoseconds / 1000) << '.';
+		const uint64_t fraction = nanoseconds % 1000;
+		if(fraction < 100) stream << '0';
+		if(fraction < 10) stream << '0';
+		stream << fraction;
+	}
+}
+
+void DyscoTracer::Write(std::ostream& stream) const
+{
+	altthread::mutex::scoped_lock lock(_mutex);
+	const int pid = getpid();
+	stream << "{\"traceEvents\":[\n";
+	bool isFirst = true;
+	for(size_t threadIndex=0; threadIndex!=_buffers.size(); ++threadIndex)
+	{
+		const TraceBuffer& buffer = *_buffers[threadIndex];
+		if(!isFirst) stream << ",\n";
+		isFirst = false;
+		stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << threadIndex
+			<< ",\"args\":{\"name\":\"";
+		writeEscaped(stream, buffer.ThreadName());
+		stream << "\",\"dropped_events\":" << buffer.DroppedCount() << "}}";
+		for(size_t i=0; i!=buffer.Size(); ++i)
+		{
+			const TraceEvent& event = buffer[i];
+			stream << ",\n{\"name\":\"" << event.name << "\",\"pid\":" << pid << ",\"tid\":" << threadIndex << ",\"ts\":";
+			writeMicroseconds(stream, event.start);
+			if(event.isInstant)
+				stream << ",\"ph\":\"i\",\"s\":\"t\"";
+			else {
+				stream << ",\"ph\":\"X\",\"dur\":";
+				writeMicroseconds(stream, event.duration);
+			}
+			if(event.block >= 0)
+				stream << ",\"args\":{\"block\":" << event.block << '}';
+			stream << '}';
+		}
+	}
+	stream << "\n]}\n";
+}
+
+void DyscoTracer::Write() const
+{
+	std::ofstream file(_filename);
+	if(!file)
+		throw DyscoStManError("Could not open trace file " + _filename + " for writing");
+	Write(file);
+	if(!file)
+		throw DyscoStManError("Error writing trace file " + _filename);
+}
+
+} // end of namespace
@@ -0,0 +1,183 @@
+#ifndef DYSCO_TRACE_H
+#define DYSCO_TRACE_H
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "thread.h"
+
+namespace dyscostman {
+
+/**
+ * A single event in a trace. Events are either 'complete' events, that have
+ * a duration, or instant events, for which the duration is ignored.
+ */
+struct TraceEvent
+{
+	/** Name of the event; should point to a string literal. */
+	const char* name;
+	/** Start time in nanoseconds since the tracer was created. */
+	uint64_t start;
+	/** Duration in nanoseconds. */
+	uint64_t duration;
+	/** Block index that the event refers to, or -1 if not applicable. */
+	int64_t block;
+	/** Whether this is an instant event. */
+	bool isInstant;
+};
+
+/**
+ * Ring buffer with the trace events of a single thread. Once the buffer is
+ * full, the oldest events are overwritten. Events may only be added by the
+ * thread that owns the buffer.
+ */
+class TraceBuffer
+{
+public:
+	TraceBuffer(const std::string& threadName, size_t capacity, std::chrono::steady_clock::time_point epoch) :
+		_threadName(threadName),
+		_events(capacity),
+		_eventCount(0),
+		_epoch(epoch)
+	{ }
+
+	TraceBuffer(const TraceBuffer&) = delete;
+	void operator=(const TraceBuffer&) = delete;
+
+	/** Current time in nanoseconds since the tracer was created. */
+	uint64_t Now() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _epoch).count();
+	}
+
+	/** Add an event that started at the given time and ends now. */
+	void AddComplete(const char* name, uint64_t start, int64_t block = -1)
+	{
+		add(TraceEvent{name, start, Now() - start, block, false});
+	}
+
+	/** Add an event without a duration. */
+	void AddInstant(const char* name, int64_t block = -1)
+	{
+		add(TraceEvent{name, Now(), 0, block, true});
+	}
+
+	const std::string& ThreadName() const { return _threadName; }
+
+	/** Number of events that are stored, which is at most the capacity. */
+	size_t Size() const { return std::min<uint64_t>(_eventCount, _events.size()); }
+
+	/** Number of events that were overwritten because the buffer was full. */
+	uint64_t DroppedCount() const { return _eventCount - Size(); }
+
+	/** Get a stored event, with index 0 being the oldest stored event. */
+	const TraceEvent& operator[](size_t index) const
+	{
+		return _events[(_eventCount - Size() + index) % _events.size()];
+	}
+
+private:
+	void add(const TraceEvent& event)
+	{
+		_events[_eventCount % _events.size()] = event;
+		++_eventCount;
+	}
+
+	std::string _threadName;
+	std::vector<TraceEvent> _events;
+	uint64_t _eventCount;
+	std::chrono::steady_clock::time_point _epoch;
+};
+
+/**
+ * Records a complete event from construction to destruction. When
+ * constructed with a null buffer, nothing is recorded.
+ */
+class TraceScope
+{
+public:
+	TraceScope(TraceBuffer* buffer, const char* name, int64_t block = -1) :
+		_buffer(buffer), _name(name), _block(block),
+		_start(buffer ? buffer->Now() : 0)
+	{ }
+
+	~TraceScope()
+	{
+		if(_buffer)
+			_buffer->AddComplete(_name, _start, _block);
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	void operator=(const TraceScope&) = delete;
+
+private:
+	TraceBuffer* _buffer;
+	const char* _name;
+	int64_t _block;
+	uint64_t _start;
+};
+
+/**
+ * Collects the trace events of all threads of a storage manager, and
+ * writes them as a Chrome trace (JSON) file, which can be viewed with
+ * chrome://tracing or Perfetto.
+ */
+class DyscoTracer
+{
+public:
+	/**
+	 * Constructor.
+	 * @param filename The file to which the trace is written by Write().
+	 * @param capacityPerThread Maximum number of events kept per thread.
+	 */
+	explicit DyscoTracer(const std::string& filename, size_t capacityPerThread = 65536) :
+		_filename(filename),
+		_capacityPerThread(capacityPerThread),
+		_epoch(std::chrono::steady_clock::now())
+	{ }
+
+	DyscoTracer(const DyscoTracer&) = delete;
+	void operator=(const DyscoTracer&) = delete;
+
+	/**
+	 * Create the event buffer for a new thread. The returned object stays valid for
+	 * the lifetime of the tracer. This method is thread-safe.
+	 */
+	TraceBuffer* NewThreadBuffer(const std::string& threadName)
+	{
+		altthread::mutex::scoped_lock lock(_mutex);
+		_buffers.emplace_back(new TraceBuffer(threadName, _capacityPerThread, _epoch));
+		return _buffers.back().get();
+	}
+
+	const std::string& Filename() const { return _filename; }
+
+	/**
+	 * Write all events in Chrome's trace event format. No events may be
+	 * added while writing.
+	 */
+	void Write(std::ostream& stream) const;
+
+	/**
+	 * Write the trace to the file given in the constructor.
+	 * @throws DyscoStManError if the file can not be written.
+	 */
+	void Write() const;
+
+private:
+	std::string _filename;
+	size_t _capacityPerThread;
+	std::chrono::steady_clock::time_point _epoch;
+	mutable altthread::mutex _mutex;
+	std::vector<std::unique_ptr<TraceBuffer>> _buffers;
+};
+
+} // end of namespace
+
+#endif
@@ -1,4 +1,9 @@
 #include "dyscoweightcolumn.h"
+#include "dyscostmanerror.h"
+#include "bytepacker.h"
+
+#include <cmath>
+#include <sstream>
 
 namespace dyscostman {
 
@@ -6,7 +11,21 @@ void DyscoWeightColumn::Prepare(DyscoDistribution distribution, DyscoNormalizati
 {
 	ThreadedDyscoColumn::Prepare(distribution, normalization, studentsTNu, distributionTruncation);
 	const size_t nPolarizations = shape()[0], nChannels = shape()[1];
-	_encoder.reset(new WeightBlockEncoder(nPolarizations, nChannels, 1 << getBitsPerSymbol()));
+	_encoder.reset(new WeightBlockEncoder(nPolarizations, nChannels, 1 << getBitsPerSymbol(), _useBlockModes, _useChannelScales, _perPolarization));
+}
+
+void DyscoWeightColumn::putArrayfloatV(casacore::uInt rowNr, const casacore::Array<float>* dataPtr)
+{
+	for(casacore::Array<float>::const_contiter value = dataPtr->cbegin(); value != dataPtr->cend(); ++value)
+	{
+		if(!(std::isfinite(*value) && *value >= 0.0))
+		{
+			std::ostringstream s;
+			s << "Column " << Name() << " is stored with the weight encoder, which can not store the value " << *value << " in row " << rowNr << ": only finite, non-negative values can be stored";
+			throw DyscoStManError(s.str());
+		}
+	}
+	ThreadedDyscoColumn::putArrayfloatV(rowNr, dataPtr);
 }
 
 void DyscoWeightColumn::initializeDecode(TimeBlockBuffer<data_t>* buffer, const float* metaBuffer, size_t nRow, size_t nAntennae)
@@ -14,14 +33,30 @@ void DyscoWeightColumn::initializeDecode(TimeBlockBuffer<data_t>* buffer, const
 	_encoder->InitializeDecode(metaBuffer);
 }
 
-void DyscoWeightColumn::decode(TimeBlockBuffer<data_t>* buffer, const unsigned int* data, size_t blockRow, size_t a1, size_t a2)
+void DyscoWeightColumn::decode(TimeBlockBuffer<data_t>* buffer, const symbol_t* data, size_t blockRow, size_t a1, size_t a2)
 {
 	_encoder->Decode(*buffer, data, blockRow);
 }
 
-void DyscoWeightColumn::encode(void* threadData, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae)
+void DyscoWeightColumn::encode(void* threadData, size_t blockIndex, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae)
 {
+	StageTimer timer(static_cast<StageCounters*>(threadData), QuantizationStage);
 	_encoder->Encode(*buffer, metaBuffer, symbolBuffer);
 }
 
+size_t DyscoWeightColumn::storedPackedSize(const float* metaBuffer, size_t nRowsInBlock) const
+{
+	return BytePacker::bufferSize(_encoder->StoredSymbolCount(metaBuffer, nRowsInBlock), getBitsPerSymbol());
+}
+
+void DyscoWeightColumn::packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const
+{
+	BytePacker::pack(getBitsPerSymbol(), dest, symbols, _encoder->StoredSymbolCount(metaBuffer, nRowsInBlock));
+}
+
+void DyscoWeightColumn::unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const
+{
+	BytePacker::unpack(getBitsPerSymbol(), symbols, packed, _encoder->StoredSymbolCount(metaBuffer, nRowsInBlock));
+}
+
 }
@@ -20,8 +20,11 @@ public:
 	 * Create a new column. Internally called by DyscoStMan when creating a
 	 * new column.
 	 */
-  DyscoWeightColumn(DyscoStMan* parent, int dtype) :
-		ThreadedDyscoColumn(parent, dtype)
+  DyscoWeightColumn(DyscoStMan* parent, const std::string& name, int dtype) :
+		ThreadedDyscoColumn(parent, name, dtype),
+		_useBlockModes(false),
+		_useChannelScales(false),
+		_perPolarization(false)
 	{ }
   
 	DyscoWeightColumn(const DyscoWeightColumn &source) = delete;
@@ -33,18 +36,44 @@ public:
 	
 	virtual void Prepare(DyscoDistribution distribution, DyscoNormalization normalization, double studentsTNu, double distributionTruncation) override;
 	
+	/**
+	 * Enable the constant and row-constant block modes of the weight encoder.
+	 * Should only be called by DyscoStMan, before Prepare().
+	 */
+	void SetBlockModes(bool useBlockModes) { _useBlockModes = useBlockModes; }
+	
+	/**
+	 * Store the maximum weight of every channel instead of one maximum per block.
+	 * Should only be called by DyscoStMan, before Prepare().
+	 */
+	void SetChannelScales(bool useChannelScales) { _useChannelScales = useChannelScales; }
+	
+	/**
+	 * Store the weight of every polarization instead of their minimum.
+	 * Should only be called by DyscoStMan, before Prepare().
+	 */
+	void SetPerPolarization(bool perPolarization) { _perPolarization = perPolarization; }
+	
+	/**
+	 * Write values into a row. Throws when a value is negative or not finite,
+	 * because the weight encoder can not store it.
+	 */
+	virtual void putArrayfloatV(casacore::uInt rowNr, const casacore::Array<float>* dataPtr) final override;
+	
 protected:
 	virtual void initializeDecode(TimeBlockBuffer<data_t>* buffer, const float* metaBuffer, size_t nRow, size_t nAntennae) final override;
 	
 	virtual void decode(TimeBlockBuffer<data_t>* buffer, const symbol_t* data, size_t blockRow, size_t a1, size_t a2) final override;
 	
-	virtual void initializeEncodeThread(void** threadData) final override
-	{ }
+	virtual void initializeEncodeThread(void** threadData, StageCounters* stageCounters) final override
+	{
+		*threadData = stageCounters;
+	}
 	
 	virtual void destructEncodeThread(void* threadData) final override
 	{ }
 	
-	virtual void encode(void* threadData, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae) final override;
+	virtual void encode(void* threadData, size_t blockIndex, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae) final override;
 	
 	virtual size_t metaDataFloatCount(size_t nRows, size_t nPolarizations, size_t nChannels, size_t nAntennae) const final override
 	{
@@ -56,8 +85,19 @@ protected:
 		return _encoder->SymbolCount(nRowsInBlock);
 	}
 	
+	virtual size_t storedPackedSize(const float* metaBuffer, size_t nRowsInBlock) const final override;
+	
+	virtual bool isStoredSizeVariable() const final override { return _useBlockModes; }
+	
+	virtual void packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const final override;
+	
+	virtual void unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const final override;
+	
 private:
 	std::unique_ptr<WeightBlockEncoder> _encoder;
+	bool _useBlockModes;
+	bool _useChannelScales;
+	bool _perPolarization;
 };
 
 } // end of namespace
@@ -0,0 +1,228 @@
+#ifndef FLAG_BLOCK_ENCODER_H
+#define FLAG_BLOCK_ENCODER_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <stdint.h>
+
+#include "bytepacker.h"
+#include "timeblockbuffer.h"
+#include "cpudispatch.h"
+
+/**
+ * Encodes the flags of a block without loss. Blocks in which no value or every value
+ * is flagged are stored without symbols. Other blocks are stored as a bitmap with one
+ * bit per value, or as the lengths of the alternating runs of unflagged and flagged
+ * values when that is smaller.
+ *
+ * The metadata holds the mode and the number of stored symbols. While encoding and
+ * decoding, the symbols hold one value per flag; the run lengths only exist in packed
+ * form.
+ */
+class FlagBlockEncoder
+{
+public:
+	typedef TimeBlockBuffer<bool>::symbol_t symbol_t;
+
+	enum BlockMode {
+		AllClearMode = 0,
+		AllSetMode = 1,
+		BitmapMode = 2,
+		RunLengthMode = 3
+	};
+
+	FlagBlockEncoder(size_t nPolarizations, size_t nChannels) :
+		_nPolarizations(nPolarizations), _nChannels(nChannels)
+	{ }
+
+	size_t MetaDataFloatCount() const
+	{
+		return 2;
+	}
+
+	size_t SymbolCount(size_t nRowsInBlock) const
+	{
+		return nRowsInBlock * _nChannels * _nPolarizations;
+	}
+
+	/**
+	 * Number of bytes reserved for the packed symbols of a block, i.e. the
+	 * size of the bitmap, which is the largest mode.
+	 */
+	size_t PackedSize(size_t nRowsInBlock) const
+	{
+		return dyscostman::BytePacker::bufferSize(SymbolCount(nRowsInBlock), 1);
+	}
+
+	/**
+	 * Number of bytes of packed symbols that are stored for a block.
+	 */
+	size_t StoredPackedSize(const float* metaBuffer) const
+	{
+		switch(mode(metaBuffer))
+		{
+			case BitmapMode: return dyscostman::BytePacker::bufferSize(storedCount(metaBuffer), 1);
+			case RunLengthMode: return dyscostman::BytePacker::bufferSize(storedCount(metaBuffer), RunLengthBits);
+			default: return 0;
+		}
+	}
+
+	DYSCO_TARGET_CLONES
+	void Encode(const TimeBlockBuffer<bool>& buffer, float* metaBuffer, symbol_t* symbolBuffer) const
+	{
+		const std::vector<TimeBlockBuffer<bool>::DataRow>& rows = buffer.GetVector();
+		const size_t valuesPerRow = _nChannels * _nPolarizations;
+		size_t setCount = 0;
+		for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
+		{
+			const bool* flags = rows[rowIndex].visibilities.data();
+			symbol_t* rowSymbols = &symbolBuffer[rowIndex * valuesPerRow];
+			for(size_t i=0; i!=valuesPerRow; ++i)
+			{
+				rowSymbols[i] = flags[i] ? 1 : 0;
+				setCount += rowSymbols[i];
+			}
+		}
+
+		const size_t valueCount = rows.size() * valuesPerRow;
+		size_t runCount = 0;
+		if(setCount != 0 && setCount != valueCount)
+			forEachRun(symbolBuffer, valueCount, [&runCount](size_t) { ++runCount; return true; });
+
+		if(setCount == 0)
+			setMetaData(metaBuffer, AllClearMode, 0);
+		else if(setCount == valueCount)
+			setMetaData(metaBuffer, AllSetMode, 0);
+		else if(dyscostman::BytePacker::bufferSize(runCount, RunLengthBits) < dyscostman::BytePacker::bufferSize(valueCount, 1))
+			setMetaData(metaBuffer, RunLengthMode, runCount);
+		else
+			setMetaData(metaBuffer, BitmapMode, valueCount);
+	}
+
+	void Pack(unsigned char* dest, const float* metaBuffer, const symbol_t* symbolBuffer, size_t nRowsInBlock) const
+	{
+		const size_t count = storedCount(metaBuffer);
+		switch(mode(metaBuffer))
+		{
+			case BitmapMode:
+				dyscostman::BytePacker::pack(1, dest, symbolBuffer, count);
+				break;
+			case RunLengthMode: {
+				std::vector<symbol_t> runs;
+				runs.reserve(count);
+				// The encoded values consist of count runs. The block may have fewer rows than
+				// nRowsInBlock, in which case the last run may extend into unused symbols.
+				forEachRun(symbolBuffer, SymbolCount(nRowsInBlock), [&runs, count](size_t length) {
+					runs.push_back(length);
+					return runs.size() != count;
+				});
+				dyscostman::BytePacker::pack(RunLengthBits, dest, runs.data(), count);
+			} break;
+			default:
+				break;
+		}
+	}
+
+	void Unpack(symbol_t* symbolBuffer, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const
+	{
+		const size_t count = storedCount(metaBuffer), symbolCount = SymbolCount(nRowsInBlock);
+		switch(mode(metaBuffer))
+		{
+			case AllClearMode:
+				std::fill(symbolBuffer, symbolBuffer + symbolCount, 0);
+				break;
+			case AllSetMode:
+				std::fill(symbolBuffer, symbolBuffer + symbolCount, 1);
+				break;
+			case BitmapMode:
+				dyscostman::BytePacker::unpack(1, symbolBuffer, packed, std::min(count, symbolCount));
+				std::fill(symbolBuffer + std::min(count, symbolCount), symbolBuffer + symbolCount, 0);
+				break;
+			case RunLengthMode: {
+				std::vector<symbol_t> runs(count);
+				dyscostman::BytePacker::unpack(RunLengthBits, runs.data(), packed, count);
+				size_t position = 0;
+				symbol_t value = 0;
+				for(symbol_t length : runs)
+				{
+					const size_t end = std::min(position + length, symbolCount);
+					std::fill(symbolBuffer + position, symbolBuffer + end, value);
+					position = end;
+					value ^= 1;
+				}
+				std::fill(symbolBuffer + position, symbolBuffer + symbolCount, 0);
+			} break;
+		}
+	}
+
+	DYSCO_TARGET_CLONES
+	void Decode(TimeBlockBuffer<bool>& buffer, const symbol_t* symbolBuffer, size_t blockRow) const
+	{
+		const size_t valuesPerRow = _nChannels * _nPolarizations;
+		TimeBlockBuffer<bool>::DataRow& row = buffer[blockRow];
+		row.visibilities.resize(valuesPerRow);
+		const symbol_t* rowSymbols = &symbolBuffer[blockRow * valuesPerRow];
+		bool* flags = row.visibilities.data();
+		for(size_t i=0; i!=valuesPerRow; ++i)
+			flags[i] = rowSymbols[i] != 0;
+	}
+
+private:
+	static const unsigned RunLengthBits = 16;
+	static const size_t MaxRunLength = (1 << RunLengthBits) - 1;
+
+	/**
+	 * Calls onRun with the lengths of the alternating runs of unflagged and
+	 * flagged values, starting with unflagged values. Runs that are longer than
+	 * MaxRunLength are split by an empty run of the other value. Stops when
+	 * onRun returns false.
+	 */
+	template<typename Function>
+	static void forEachRun(const symbol_t* symbols, size_t count, Function onRun)
+	{
+		symbol_t current = 0;
+		size_t length = 0;
+		for(size_t i=0; i!=count; ++i)
+		{
+			if(symbols[i] != current)
+			{
+				if(!onRun(length)) return;
+				current = symbols[i];
+				length = 0;
+			}
+			else if(length == MaxRunLength)
+			{
+				if(!onRun(length) || !onRun(0)) return;
+				length = 0;
+			}
+			++length;
+		}
+		onRun(length);
+	}
+
+	static BlockMode mode(const float* metaBuffer)
+	{
+		return BlockMode(int(metaBuffer[0]));
+	}
+
+	/** The count is stored as an integer, because a float can not hold all counts exactly */
+	static size_t storedCount(const float* metaBuffer)
+	{
+		uint32_t count;
+		memcpy(&count, &metaBuffer[1], sizeof(count));
+		return count;
+	}
+
+	static void setMetaData(float* metaBuffer, BlockMode mode, uint32_t count)
+	{
+		metaBuffer[0] = mode;
+		memcpy(&metaBuffer[1], &count, sizeof(count));
+	}
+
+	const size_t _nPolarizations;
+	const size_t _nChannels;
+};
+
+#endif
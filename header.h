@@ -5,10 +5,47 @@
 
 #include <stdint.h>
 
+#include <vector>
+
 namespace dyscostman
 {
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
+/** Bits of Header::featureFlags */
+enum HeaderFeatureFlags
+{
+	/** Weight blocks start with a mode, see WeightBlockEncoder */
+	WeightBlockModesFeature = 0x1,
+	/** Weight blocks hold a maximum per channel */
+	WeightChannelScalesFeature = 0x2,
+	/** Weight blocks hold a weight for every polarization */
+	WeightPerPolarizationFeature = 0x4,
+	/** Bool columns are not stored, but derived from a data column */
+	DerivedFlagsFeature = 0x8,
+	/** Autocorrelation rows of data blocks are stored without loss */
+	LosslessAutoCorrelationsFeature = 0x10,
+	/** Data blocks are predicted by keyframes */
+	PredictiveEncodingFeature = 0x20,
+	/** Data blocks hold sums and differences of the correlations */
+	StokesTransformFeature = 0x40,
+	/** Data blocks only store the symbols of rows and channels that have a finite value */
+	SkipFlaggedDataFeature = 0x80,
+	/** Blocks end where the time, field or spw changes and hold at most rowsPerBlock rows;
+	 * their first rows are stored in a separate block index file */
+	VariableRowsPerBlockFeature = 0x100,
+	/** Columns without a fixed shape are stored with a maximum shape, and the channel counts
+	 * of the data descriptions are stored in the block index file */
+	VariableShapeFeature = 0x200,
+	/** The blocks of every column are stored in a separate file that starts with a
+	 * ColumnFileHeader; this file only holds the headers */
+	FilePerColumnFeature = 0x400,
+	/** Float columns other than WEIGHT_SPECTRUM are stored with their own bit count */
+	FloatColumnBitCountsFeature = 0x800
+};
+
+/** Combination of all HeaderFeatureFlags that this version can read */
+const uint32_t KnownFeatureFlags = 0xFFF;
+
 struct Header : public Serializable
 {
 	/** Size of the total header, including column subheaders */
@@ -33,14 +70,64 @@ struct Header : public Serializable
 	uint8_t normalization;
 	double studentTNu, distributionTruncation;
 	
+	/** Data bits per polarization; empty when all use dataBitCount. Since version 1.1. */
+	std::vector<uint8_t> dataBitCountPerPol;
+	
+	/** Data bits per baseline class, the length thresholds between the classes
+	 * and the class of every row index within a block. Since version 1.2. */
+	std::vector<uint8_t> baselineBitCounts;
+	std::vector<double> baselineLengthThresholds;
+	std::vector<uint8_t> baselineClassPerBlockRow;
+	
+	/** Combination of HeaderFeatureFlags. Since version 1.4. */
+	uint32_t featureFlags;
+	
+	/** Row indices within a block that are stored without loss. Only
+	 * stored with LosslessAutoCorrelationsFeature. */
+	std::vector<uint32_t> losslessBlockRows;
+	
+	/** Number of blocks per keyframe. Only stored with PredictiveEncodingFeature. */
+	uint32_t predictionInterval;
+	
+	/** Number of polarizations and channels with which columns without a fixed shape
+	 * are stored. Only stored with VariableShapeFeature. */
+	uint32_t maxPolarizations, maxChannels;
+	
+	/** Names and bit counts of the Float columns, other than WEIGHT_SPECTRUM, that are
+	 * stored with the weight encoder. Only stored with FloatColumnBitCountsFeature. */
+	std::vector<std::string> floatColumnNames;
+	std::vector<uint8_t> floatColumnBitCounts;
+	
 	uint32_t calculateColumnHeaderOffset() const
 	{
-		return
+		uint32_t offset =
 			7 * 4 + // 6 x uint32 + string length
 			storageManagerName.size() +
 			2 * 2 + // 2 x uint16
 			4 * 1 + // 4 x uint8
 			2 * 8; // 2 x double
+		if(versionMinor >= 1)
+			offset += 4 + dataBitCountPerPol.size(); // count + uint8 per polarization
+		if(versionMinor >= 2)
+			offset +=
+				4 + baselineBitCounts.size() +
+				4 + baselineLengthThresholds.size() * 8 +
+				4 + baselineClassPerBlockRow.size();
+		if(versionMinor >= 4)
+			offset += 4; // feature flags
+		if(featureFlags & LosslessAutoCorrelationsFeature)
+			offset += 4 + losslessBlockRows.size() * 4;
+		if(featureFlags & PredictiveEncodingFeature)
+			offset += 4;
+		if(featureFlags & VariableShapeFeature)
+			offset += 2 * 4;
+		if(featureFlags & FloatColumnBitCountsFeature)
+		{
+			offset += 4; // count
+			for(const std::string& name : floatColumnNames)
+				offset += 4 + name.size() + 1; // string length, name and uint8
+		}
+		return offset;
 	}
 	
 	virtual void Serialize(std::ostream &stream) const final override
@@ -60,6 +147,48 @@ struct Header : public Serializable
 		SerializeToUInt8(stream, normalization);
 		SerializeToDouble(stream, studentTNu);
 		SerializeToDouble(stream, distributionTruncation);
+		if(versionMinor >= 1)
+		{
+			SerializeToUInt32(stream, dataBitCountPerPol.size());
+			for(uint8_t bitCount : dataBitCountPerPol)
+				SerializeToUInt8(stream, bitCount);
+		}
+		if(versionMinor >= 2)
+		{
+			SerializeToUInt32(stream, baselineBitCounts.size());
+			for(uint8_t bitCount : baselineBitCounts)
+				SerializeToUInt8(stream, bitCount);
+			SerializeToUInt32(stream, baselineLengthThresholds.size());
+			for(double threshold : baselineLengthThresholds)
+				SerializeToDouble(stream, threshold);
+			SerializeToUInt32(stream, baselineClassPerBlockRow.size());
+			for(uint8_t baselineClass : baselineClassPerBlockRow)
+				SerializeToUInt8(stream, baselineClass);
+		}
+		if(versionMinor >= 4)
+			SerializeToUInt32(stream, featureFlags);
+		if(featureFlags & LosslessAutoCorrelationsFeature)
+		{
+			SerializeToUInt32(stream, losslessBlockRows.size());
+			for(uint32_t row : losslessBlockRows)
+				SerializeToUInt32(stream, row);
+		}
+		if(featureFlags & PredictiveEncodingFeature)
+			SerializeToUInt32(stream, predictionInterval);
+		if(featureFlags & VariableShapeFeature)
+		{
+			SerializeToUInt32(stream, maxPolarizations);
+			SerializeToUInt32(stream, maxChannels);
+		}
+		if(featureFlags & FloatColumnBitCountsFeature)
+		{
+			SerializeToUInt32(stream, floatColumnNames.size());
+			for(size_t i=0; i!=floatColumnNames.size(); ++i)
+			{
+				SerializeTo32bString(stream, floatColumnNames[i]);
+				SerializeToUInt8(stream, floatColumnBitCounts[i]);
+			}
+		}
 	}
 	
 	virtual void Unserialize(std::istream &stream) final override
@@ -84,11 +213,118 @@ struct Header : public Serializable
 		normalization = UnserializeUInt8(stream);
 		studentTNu = UnserializeDouble(stream);
 		distributionTruncation = UnserializeDouble(stream);
+		
+		dataBitCountPerPol.clear();
+		if(versionMajor == 1 && versionMinor >= 1)
+		{
+			dataBitCountPerPol.resize(UnserializeUInt32(stream));
+			for(uint8_t& bitCount : dataBitCountPerPol)
+				bitCount = UnserializeUInt8(stream);
+		}
+		
+		baselineBitCounts.clear();
+		baselineLengthThresholds.clear();
+		baselineClassPerBlockRow.clear();
+		if(versionMajor == 1 && versionMinor >= 2)
+		{
+			baselineBitCounts.resize(UnserializeUInt32(stream));
+			for(uint8_t& bitCount : baselineBitCounts)
+				bitCount = UnserializeUInt8(stream);
+			baselineLengthThresholds.resize(UnserializeUInt32(stream));
+			for(double& threshold : baselineLengthThresholds)
+				threshold = UnserializeDouble(stream);
+			baselineClassPerBlockRow.resize(UnserializeUInt32(stream));
+			for(uint8_t& baselineClass : baselineClassPerBlockRow)
+				baselineClass = UnserializeUInt8(stream);
+		}
+		
+		if(versionMajor == 1 && versionMinor >= 4)
+			featureFlags = UnserializeUInt32(stream);
+		else
+			featureFlags = 0;
+		
+		losslessBlockRows.clear();
+		if(featureFlags & LosslessAutoCorrelationsFeature)
+		{
+			losslessBlockRows.resize(UnserializeUInt32(stream));
+			for(uint32_t& row : losslessBlockRows)
+				row = UnserializeUInt32(stream);
+		}
+		
+		if(featureFlags & PredictiveEncodingFeature)
+			predictionInterval = UnserializeUInt32(stream);
+		else
+			predictionInterval = 0;
+		
+		if(featureFlags & VariableShapeFeature)
+		{
+			maxPolarizations = UnserializeUInt32(stream);
+			maxChannels = UnserializeUInt32(stream);
+		}
+		else {
+			maxPolarizations = 0;
+			maxChannels = 0;
+		}
+		
+		floatColumnNames.clear();
+		floatColumnBitCounts.clear();
+		if(featureFlags & FloatColumnBitCountsFeature)
+		{
+			const size_t count = UnserializeUInt32(stream);
+			floatColumnNames.resize(count);
+			floatColumnBitCounts.resize(count);
+			for(size_t i=0; i!=count; ++i)
+			{
+				Unserialize32bString(stream, floatColumnNames[i]);
+				floatColumnBitCounts[i] = UnserializeUInt8(stream);
+			}
+		}
 	}
 	
 	// the column headers start here (first generic header, then column specific header)
 };
 
+/** Value of ColumnFileHeader::magic */
+const uint32_t ColumnFileMagic = 0x4F435944;
+
+/** Header at the start of the file of a column, with FilePerColumnFeature. The blocks
+ * of the column follow the header. */
+struct ColumnFileHeader : public Serializable
+{
+	/** Identifies the file as a Dysco column file; equals ColumnFileMagic */
+	uint32_t magic;
+	
+	/** File version number, as in the main header */
+	uint16_t versionMajor, versionMinor;
+	
+	/** Name of the column that is stored in the file */
+	std::string columnName;
+	
+	uint32_t calculateSize() const
+	{
+		return
+			4 + // magic
+			2 * 2 + // 2 x uint16
+			4 + columnName.size(); // string length + name
+	}
+	
+	virtual void Serialize(std::ostream &stream) const final override
+	{
+		SerializeToUInt32(stream, magic);
+		SerializeToUInt16(stream, versionMajor);
+		SerializeToUInt16(stream, versionMinor);
+		SerializeTo32bString(stream, columnName);
+	}
+	
+	virtual void Unserialize(std::istream &stream) final override
+	{
+		magic = UnserializeUInt32(stream);
+		versionMajor = UnserializeUInt16(stream);
+		versionMinor = UnserializeUInt16(stream);
+		Unserialize32bString(stream, columnName);
+	}
+};
+
 struct GenericColumnHeader : public Serializable
 {
 	/** size of generic header + column specific header */
@@ -1,4 +1,5 @@
 #include "rowtimeblockencoder.h"
+#include "cpudispatch.h"
 #include "stochasticencoder.h"
 
 using namespace dyscostman;
@@ -17,6 +18,12 @@ void RowTimeBlockEncoder::InitializeDecode(const float* metaBuffer, size_t nRow,
 }
 
 void RowTimeBlockEncoder::Decode(const StochasticEncoder<float>& gausEncoder, FBuffer& buffer, const symbol_t* symbolBuffer, size_t blockRow, size_t antenna1, size_t antenna2)
+{
+	decode(gausEncoder, buffer, symbolBuffer, blockRow, antenna1, antenna2);
+}
+
+DYSCO_TARGET_CLONES
+void RowTimeBlockEncoder::decode(const StochasticEncoder<float>& gausEncoder, FBuffer& buffer, const symbol_t* symbolBuffer, size_t blockRow, size_t antenna1, size_t antenna2)
 {
 	FBufferRow& row = buffer[blockRow];
 	row.antenna1 = antenna1;
@@ -25,20 +32,25 @@ void RowTimeBlockEncoder::Decode(const StochasticEncoder<float>& gausEncoder, FB
 	std::complex<float>* destination = row.visibilities.data();
 	const symbol_t* srcRowPtr = symbolBuffer + blockRow * SymbolsPerRow();
 	const size_t visPerRow = _nPol * _nChannels;
+	ao::uvector<const dyscostman::StochasticEncoder<float>*> quantizers(_nPol);
+	selectQuantizers(gausEncoder, blockRow, quantizers);
 	for(size_t i=0; i!=visPerRow; ++i)
 	{
 		double factor = _rowFactors[blockRow];
-		destination->real(double(gausEncoder.Decode(*srcRowPtr)) * factor);
+		const dyscostman::StochasticEncoder<float>& symbolEncoder = *quantizers[i%_nPol];
+		destination->real(double(symbolEncoder.Decode(*srcRowPtr)) * factor);
 		++srcRowPtr;
-		destination->imag(double(gausEncoder.Decode(*srcRowPtr)) * factor);
+		destination->imag(double(symbolEncoder.Decode(*srcRowPtr)) * factor);
 		++srcRowPtr;
 		++destination;
 	}
 }
 
 template<bool UseDithering>
+DYSCO_TARGET_CLONES
 void RowTimeBlockEncoder::encode(const StochasticEncoder<float>& gausEncoder, const FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd)
 {
+	dyscostman::StageTimer timer(_stageCounters, dyscostman::NormalizationStage);
 	// Note that encoding is performed with doubles
 	std::vector<DBufferRow> data;
 	buffer.ConvertVector<std::complex<double>>(data);
@@ -63,19 +75,24 @@ void RowTimeBlockEncoder::encode(const StochasticEncoder<float>& gausEncoder, co
 		metaBuffer[rowIndex] = maxVal / maxLevel;
 	}
 	
+	timer.Switch(dyscostman::QuantizationStage);
 	symbol_t* symbolBufferPtr = symbolBuffer;
-	for(const DBufferRow& row : data)
+	ao::uvector<const dyscostman::StochasticEncoder<float>*> quantizers(_nPol);
+	for(size_t rowIndex=0; rowIndex!=data.size(); ++rowIndex)
 	{
+		const DBufferRow& row = data[rowIndex];
+		selectQuantizers(gausEncoder, rowIndex, quantizers);
 		for(size_t i=0; i!=visPerRow; ++i)
 		{
+			const dyscostman::StochasticEncoder<float>& symbolEncoder = *quantizers[i%_nPol];
 			if(UseDithering)
 			{
-				symbolBufferPtr[i*2]   = gausEncoder.EncodeWithDithering(row.visibilities[i].real(), _ditherDist(*rnd));
-				symbolBufferPtr[i*2+1] = gausEncoder.EncodeWithDithering(row.visibilities[i].imag(), _ditherDist(*rnd));
+				symbolBufferPtr[i*2]   = symbolEncoder.EncodeWithDithering(row.visibilities[i].real(), _ditherDist(*rnd));
+				symbolBufferPtr[i*2+1] = symbolEncoder.EncodeWithDithering(row.visibilities[i].imag(), _ditherDist(*rnd));
 			}
 			else {
-				symbolBufferPtr[i*2]   = gausEncoder.Encode(row.visibilities[i].real());
-				symbolBufferPtr[i*2+1] = gausEncoder.Encode(row.visibilities[i].imag());
+				symbolBufferPtr[i*2]   = symbolEncoder.Encode(row.visibilities[i].real());
+				symbolBufferPtr[i*2+1] = symbolEncoder.Encode(row.visibilities[i].imag());
 			}
 		}
 		symbolBufferPtr += visPerRow*2;
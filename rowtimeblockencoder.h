@@ -56,6 +56,8 @@ private:
 	template<bool UseDithering>
 	void encode(const dyscostman::StochasticEncoder<float>& gausEncoder, const FBuffer& buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t antennaCount, std::mt19937* rnd);
 	
+	void decode(const dyscostman::StochasticEncoder<float>& gausEncoder, FBuffer& buffer, const symbol_t* symbolBuffer, size_t blockRow, size_t antenna1, size_t antenna2);
+	
 	size_t _nPol, _nChannels;
 	
 	std::uniform_int_distribution<unsigned> _ditherDist;
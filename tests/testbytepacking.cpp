@@ -32,18 +32,18 @@ void assertEqualArray(const T *expected, const T *actual, size_t size, const std
 
 BOOST_AUTO_TEST_CASE( under_and_overflow )
 {
-	const size_t NBITSIZES=8;
-	size_t bitSizes[NBITSIZES] = {2, 3, 4, 6, 8, 10, 12, 16};
+	const size_t NBITSIZES=9;
+	size_t bitSizes[NBITSIZES] = {1, 2, 3, 4, 6, 8, 10, 12, 16};
 	for(size_t i=0; i!=NBITSIZES; ++i)
 	{
 		for(size_t s=0; s!=12; ++s)
 		{
-			unsigned arr[12] = { 1, 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31 };
-			unsigned expected[13] = {37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37};
+			BytePacker::symbol_t arr[12] = { 1, 2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31 };
+			BytePacker::symbol_t expected[13] = {37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37};
 			for(size_t x=0;x!=12;++x)
 				arr[x] &= (1<<bitSizes[i]) - 1;
 	
-			unsigned result[13] = { 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37};
+			BytePacker::symbol_t result[13] = { 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37, 37};
 			unsigned char packed[24], packedOr[24];
 			memset(packed, 39, 24);
 			memset(packedOr, 39, 24);
@@ -58,13 +58,13 @@ BOOST_AUTO_TEST_CASE( under_and_overflow )
 			assertEqualArray(packedOr, &packed[packedSize], 24-packedSize, "packed not overwritten past length");
 		}
 		
-		unsigned arr2[15];
+		BytePacker::symbol_t arr2[15];
 		for(size_t x=0; x!=15; ++x)
 			arr2[x] = (1<<bitSizes[i]) - 1;
 		unsigned char packed[30];
 		memset(packed, 0, 30);
-		unsigned result[15];
-		memset(result, 0, 15*sizeof(unsigned));
+		BytePacker::symbol_t result[15];
+		memset(result, 0, 15*sizeof(BytePacker::symbol_t));
 		BytePacker::pack(bitSizes[i], packed, arr2, 15);
 		BytePacker::unpack(bitSizes[i], result, packed, 15);
 		std::stringstream msg;
@@ -75,10 +75,10 @@ BOOST_AUTO_TEST_CASE( under_and_overflow )
 }
 
 
-void testSingle(const ao::uvector<unsigned int>& data, int bitCount)
+void testSingle(const ao::uvector<BytePacker::symbol_t>& data, int bitCount)
 {
 	int limit = (1<<bitCount);
-	ao::uvector<unsigned int> trimmedData(data.size()), restoredData(data.size());
+	ao::uvector<BytePacker::symbol_t> trimmedData(data.size()), restoredData(data.size());
 	for(size_t i=0; i!=data.size(); ++i)
 		trimmedData[i] = data[i] % limit;
 	ao::uvector<unsigned char> buffer(BytePacker::bufferSize(trimmedData.size(), bitCount), 0);
@@ -98,30 +98,30 @@ void testSingle(const ao::uvector<unsigned int>& data, int bitCount)
 	}
 }
 
-void testCombinations(const ao::uvector<unsigned int>& data, int bitCount)
+void testCombinations(const ao::uvector<BytePacker::symbol_t>& data, int bitCount)
 {
 	for(size_t dataSize=1; dataSize!=std::min<size_t>(32u, data.size()); ++dataSize)
 	{
-		ao::uvector<unsigned int> resizedData(data.begin(), data.begin()+dataSize);
+		ao::uvector<BytePacker::symbol_t> resizedData(data.begin(), data.begin()+dataSize);
 		testSingle(resizedData, bitCount);
 	}
 	testSingle(data, bitCount);
 	for(size_t dataSize=1; dataSize!=std::min<size_t>(32u, data.size()-1); ++dataSize)
 	{
-		ao::uvector<unsigned int> resizedData(data.begin()+1, data.begin()+dataSize+1);
+		ao::uvector<BytePacker::symbol_t> resizedData(data.begin()+1, data.begin()+dataSize+1);
 		testSingle(resizedData, bitCount);
 	}
-	ao::uvector<unsigned int> resizedData(data.begin()+1, data.end());
+	ao::uvector<BytePacker::symbol_t> resizedData(data.begin()+1, data.end());
 	testSingle(resizedData, bitCount);
 }
 
-const int bitrates[] = {2, 3, 4, 6, 8, 10, 12, 16};
+const int bitrates[] = {1, 2, 3, 4, 6, 8, 10, 12, 16};
 
 BOOST_AUTO_TEST_CASE( pack_unpack )
 {
 	for(int sample : bitrates)
 	{
-		ao::uvector<unsigned int> testArray{1337, 2, 100, 0};
+		ao::uvector<BytePacker::symbol_t> testArray{1337, 2, 100, 0};
 		for(int i=0; i!=1000; ++i)
 		{
 			testArray.push_back(i);
@@ -1,6 +1,10 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/filesystem/operations.hpp>
 
+#include <cmath>
+#include <limits>
+#include <sstream>
+
 #include <casacore/tables/Tables/ArrayColumn.h>
 #include <casacore/tables/Tables/Table.h>
 #include <casacore/tables/Tables/TableDesc.h>
@@ -9,6 +13,7 @@
 #include <casacore/tables/Tables/ScaColDesc.h>
 
 #include "../dyscostman.h"
+#include "../dyscostmanerror.h"
 
 using namespace casacore;
 using namespace dyscostman;
@@ -26,61 +31,135 @@ casa::Record GetDyscoSpec()
 	return dyscoSpec;
 }
 
+/**
+ * Adds a fixed-shape column that is stored by DyscoStMan.
+ */
+template<typename T>
+void AddDyscoColumn(casacore::TableDesc& tableDesc, const std::string& name, const IPosition& shape)
+{
+	casacore::ArrayColumnDesc<T> columnDesc(name, "", "DyscoStMan", "", shape);
+	columnDesc.setOptions(casacore::ColumnDesc::Direct | casacore::ColumnDesc::FixedShape);
+	tableDesc.addColumn(columnDesc);
+}
+
+/**
+ * Creates the test table with the given columns, which are all bound to
+ * (a clone of) the given storage manager, and with the measurement set
+ * columns that the storage manager reads its metadata from.
+ */
+casacore::Table CreateTable(const casacore::TableDesc& dyscoColumns, const DataManager& dysco)
+{
+	casacore::TableDesc tableDesc(dyscoColumns);
+	tableDesc.addColumn(casacore::ScalarColumnDesc<int>("ANTENNA1"));
+	tableDesc.addColumn(casacore::ScalarColumnDesc<int>("ANTENNA2"));
+	tableDesc.addColumn(casacore::ScalarColumnDesc<int>("FIELD_ID"));
+	tableDesc.addColumn(casacore::ScalarColumnDesc<int>("DATA_DESC_ID"));
+	tableDesc.addColumn(casacore::ScalarColumnDesc<double>("TIME"));
+	casacore::SetupNewTable setupNewTable("TestTable", tableDesc, casacore::Table::New);
+	
+	register_dyscostman();
+	for(size_t i=0; i!=dyscoColumns.ncolumn(); ++i)
+		setupNewTable.bindColumn(dyscoColumns[i].name(), dysco);
+	return casacore::Table(setupNewTable);
+}
+
+void PutMetaData(casacore::Table& table, size_t row, int antenna1, int antenna2, double time, int dataDescId = 0)
+{
+	casacore::ScalarColumn<int>
+		a1Col(table, "ANTENNA1"),
+		a2Col(table, "ANTENNA2"),
+		fieldCol(table, "FIELD_ID"),
+		dataDescIdCol(table, "DATA_DESC_ID");
+	casacore::ScalarColumn<double> timeCol(table, "TIME");
+	a1Col.put(row, antenna1);
+	a2Col.put(row, antenna2);
+	fieldCol.put(row, 0);
+	dataDescIdCol.put(row, dataDescId);
+	timeCol.put(row, time);
+}
+
+/** Number of rows of a timestep in tables written by WriteTimesteps(). */
+const size_t TimestepRows = 3;
+
+/**
+ * Sets the metadata of a row of a table with timesteps of the three baselines
+ * between antennas 0, 1 and 2, starting at time 10.
+ */
+void PutTimestepMetaData(casacore::Table& table, size_t row, int dataDescId = 0)
+{
+	const size_t baseline = row % TimestepRows;
+	PutMetaData(table, row, baseline == 2 ? 1 : 0, baseline == 0 ? 1 : 2, 10.0 + row / TimestepRows, dataDescId);
+}
+
+/**
+ * Adds timesteps to the table, see PutTimestepMetaData(), and writes them in order.
+ * Every value of a row of the column is set to row + 1.
+ */
+template<typename T>
+void WriteTimesteps(casacore::Table& table, const std::string& columnName, size_t nTimes)
+{
+	casacore::ArrayColumn<T> column(table, columnName);
+	const size_t firstRow = table.nrow();
+	table.addRow(nTimes * TimestepRows);
+	for(size_t row=firstRow; row!=table.nrow(); ++row)
+	{
+		PutTimestepMetaData(table, row);
+		column.put(row, casacore::Array<T>(column.shapeColumn(), T(row + 1)));
+	}
+}
+
+/**
+ * Checks that the rows of the column hold the values of WriteTimesteps().
+ */
+template<typename T>
+void CheckTimesteps(const casacore::Table& table, const std::string& columnName, double tolerance = 1e-2)
+{
+	casacore::ArrayColumn<T> column(table, columnName);
+	for(size_t row=0; row!=table.nrow(); ++row)
+		BOOST_CHECK_CLOSE_FRACTION(std::real(*column(row).cbegin()), float(row + 1), tolerance);
+}
+
+/**
+ * Removes the test table when a test ends, also when the test fails.
+ */
+struct TestTableRemover
+{
+	~TestTableRemover()
+	{
+		boost::filesystem::remove_all("TestTable");
+	}
+};
+
 struct TestTableFixture
 {
-	explicit TestTableFixture(size_t nAnt)
-	{
-		casacore::TableDesc tableDesc;
-		IPosition shape(2, 1, 1);
-		casacore::ArrayColumnDesc<casacore::Complex> columnDesc("DATA", "", "DyscoStMan", "", shape);
-		columnDesc.setOptions(casacore::ColumnDesc::Direct | casacore::ColumnDesc::FixedShape);
-		casacore::ScalarColumnDesc<int>
-			ant1Desc("ANTENNA1"),
-			ant2Desc("ANTENNA2"),
-			fieldDesc("FIELD_ID"),
-			dataDescIdDesc("DATA_DESC_ID");
-		casacore::ScalarColumnDesc<double>
-			timeDesc("TIME");
-		tableDesc.addColumn(columnDesc);
-		tableDesc.addColumn(ant1Desc);
-		tableDesc.addColumn(ant2Desc);
-		tableDesc.addColumn(fieldDesc);
-		tableDesc.addColumn(dataDescIdDesc);
-		tableDesc.addColumn(timeDesc);
-		casacore::SetupNewTable setupNewTable("TestTable", tableDesc, casacore::Table::New);
+	explicit TestTableFixture(size_t nAnt, const casa::Record& dyscoSpec = GetDyscoSpec(), size_t nPol = 1, bool autoCorrelations = false)
+	{
+		casacore::TableDesc dyscoColumns;
+		IPosition shape(2, nPol, 1);
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
 		
 		register_dyscostman();
 		DataManagerCtor dyscoConstructor = DataManager::getCtor("DyscoStMan");
-		std::unique_ptr<DataManager> dysco(dyscoConstructor("DATA_dm", GetDyscoSpec()));
-		setupNewTable.bindColumn("DATA", *dysco);
-		casacore::Table newTable(setupNewTable);
+		std::unique_ptr<DataManager> dysco(dyscoConstructor("DATA_dm", dyscoSpec));
+		casacore::Table newTable = CreateTable(dyscoColumns, *dysco);
 		
-		size_t a1 = 0, a2 = 1;
+		const size_t firstOffset = autoCorrelations ? 0 : 1;
+		size_t a1 = 0, a2 = firstOffset;
 		double time = 10.0;
-		const size_t nRow = 2*nAnt*(nAnt-1)/2;
+		const size_t nRow = 2*(nAnt*(nAnt-1)/2 + (autoCorrelations ? nAnt : 0));
 		newTable.addRow(nRow);
-		casacore::ScalarColumn<int>
-			a1Col(newTable, "ANTENNA1"),
-			a2Col(newTable, "ANTENNA2"),
-			fieldCol(newTable, "FIELD_ID"),
-			dataDescIdCol(newTable, "DATA_DESC_ID");
-		casacore::ScalarColumn<double> timeCol(newTable, "TIME");
 		for(size_t i=0; i!=nRow; ++i)
 		{
-			a1Col.put(i, a1);
-			a2Col.put(i, a2);
-			fieldCol.put(i, 0);
-			dataDescIdCol.put(i, 0);
-			timeCol.put(i, time);
+			PutMetaData(newTable, i, a1, a2, time);
 			a2++;
 			if(a2 == nAnt)
 			{
 				++a1;
-				a2=a1+1;
+				a2=a1+firstOffset;
 				if(a2 == nAnt)
 				{
 					a1 = 0;
-					a2 = 1;
+					a2 = firstOffset;
 					++time;
 				}
 			}
@@ -106,6 +185,13 @@ BOOST_AUTO_TEST_CASE( spec )
 	Record spec = dysco.dataManagerSpec();
 	BOOST_CHECK_EQUAL(spec.asInt("dataBitCount"), 8);
 	BOOST_CHECK_EQUAL(spec.asInt("weightBitCount"), 12);
+	
+	dysco.SetNormalization(AutoNormalization);
+	BOOST_CHECK_EQUAL(dysco.dataManagerSpec().asString("normalization"), "Auto");
+	
+	BOOST_CHECK(!spec.isDefined("weightBlockModes"));
+	dysco.SetWeightBlockModes(true);
+	BOOST_CHECK(dysco.dataManagerSpec().asBool("weightBlockModes"));
 }
 
 BOOST_AUTO_TEST_CASE( name )
@@ -141,7 +227,234 @@ BOOST_AUTO_TEST_CASE( makecolumn )
 	dysco.createDirArrColumn("WEIGHT_SPECTRUM", casacore::DataType::TpFloat, "");
 	dysco.createDirArrColumn("CORRECTED_DATA", casacore::DataType::TpComplex, "");
 	dysco.createDirArrColumn("ANYTHING", casacore::DataType::TpComplex, "");
-	BOOST_CHECK(true);
+	dysco.createDirArrColumn("SIGMA_SPECTRUM", casacore::DataType::TpFloat, "");
+	dysco.createDirArrColumn("IMAGING_WEIGHT_SPECTRUM", casacore::DataType::TpFloat, "");
+	dysco.createDirArrColumn("FLAG", casacore::DataType::TpBool, "");
+	BOOST_CHECK_THROW(dysco.createDirArrColumn("INTEGERS", casacore::DataType::TpInt, ""), DyscoStManError);
+}
+
+BOOST_AUTO_TEST_CASE( timings )
+{
+	DyscoStMan dysco(8, 12, "mydysco");
+	dysco.createDirArrColumn("DATA", casacore::DataType::TpComplex, "");
+	dysco.createDirArrColumn("WEIGHT_SPECTRUM", casacore::DataType::TpFloat, "");
+	DyscoTimings timings = dysco.GetTimings();
+	for(size_t i=0; i!=StageCount; ++i)
+	{
+		BOOST_CHECK_EQUAL(timings.seconds[i], 0.0);
+		BOOST_CHECK_EQUAL(timings.counts[i], 0u);
+	}
+	timings = dysco.GetTimings("DATA");
+	BOOST_CHECK_EQUAL(timings.counts[QuantizationStage], 0u);
+	BOOST_CHECK_THROW(dysco.GetTimings("NOT_A_COLUMN"), DyscoStManError);
+	BOOST_CHECK(dysco.GetCacheOccupancy("DATA").empty());
+	BOOST_CHECK_EQUAL(dysco.GetMemoryUsage().totalCurrent, 0u);
+}
+
+BOOST_AUTO_TEST_CASE( memory_counters )
+{
+	MemoryCounters memory;
+	uint64_t decodedSize = 0;
+	memory.Allocate(WriteCacheMemory, 100);
+	memory.Resize(DecodedBlockMemory, decodedSize, 50);
+	memory.Free(WriteCacheMemory, 100);
+	memory.Resize(DecodedBlockMemory, decodedSize, 20);
+	BOOST_CHECK_EQUAL(decodedSize, 20u);
+	DyscoMemoryUsage usage = memory.Usage();
+	BOOST_CHECK_EQUAL(usage.current[WriteCacheMemory], 0u);
+	BOOST_CHECK_EQUAL(usage.peak[WriteCacheMemory], 100u);
+	BOOST_CHECK_EQUAL(usage.current[DecodedBlockMemory], 20u);
+	BOOST_CHECK_EQUAL(usage.peak[DecodedBlockMemory], 50u);
+	BOOST_CHECK_EQUAL(usage.totalCurrent, 20u);
+	BOOST_CHECK_EQUAL(usage.totalPeak, 150u);
+}
+
+BOOST_AUTO_TEST_CASE( cache_occupancy )
+{
+	DyscoStatistics statistics;
+	statistics.AddCacheOccupancy(1, 3);
+	statistics.AddCacheOccupancy(3, 3);
+	statistics.AddCacheOccupancy(3, 3);
+	const std::vector<uint64_t> occupancy = statistics.CacheOccupancy();
+	BOOST_CHECK_EQUAL(occupancy.size(), 4u);
+	BOOST_CHECK_EQUAL(occupancy[0], 0u);
+	BOOST_CHECK_EQUAL(occupancy[1], 1u);
+	BOOST_CHECK_EQUAL(occupancy[3], 2u);
+}
+
+BOOST_AUTO_TEST_CASE( stage_timer )
+{
+	StageCounters counters;
+	{
+		StageTimer timer(&counters, PackingStage);
+		timer.Switch(WriteIOStage);
+	}
+	BOOST_CHECK_EQUAL(counters.Count(PackingStage), 1u);
+	BOOST_CHECK_EQUAL(counters.Count(WriteIOStage), 1u);
+	BOOST_CHECK_EQUAL(counters.Count(ReadIOStage), 0u);
+}
+
+BOOST_AUTO_TEST_CASE( statistics_of_table )
+{
+	TestTableRemover remover;
+	// Four blocks of three rows
+	const size_t nBlocks = 4;
+	{
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", IPosition(2, 2, 4));
+		casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", GetDyscoSpec()));
+		WriteTimesteps<casacore::Complex>(newTable, "DATA", nBlocks);
+		newTable.flush();
+		
+		const DyscoStMan& dysco = dynamic_cast<DyscoStMan&>(*newTable.findDataManager("DATA", true));
+		const DyscoTimings timings = dysco.GetTimings("DATA");
+		BOOST_CHECK(timings.counts[QuantizationStage] != 0);
+		BOOST_CHECK(timings.counts[WriteIOStage] >= nBlocks);
+		BOOST_CHECK(timings.seconds[WriteIOStage] > 0.0);
+		BOOST_CHECK_EQUAL(timings.counts[ReadIOStage], 0u);
+		
+		// Every stored block was counted once when it entered the write cache
+		const std::vector<uint64_t> occupancy = dysco.GetCacheOccupancy("DATA");
+		BOOST_CHECK(!occupancy.empty());
+		uint64_t storedBlocks = 0;
+		for(uint64_t count : occupancy)
+			storedBlocks += count;
+		BOOST_CHECK_EQUAL(storedBlocks, timings.counts[WriteIOStage]);
+		
+		// The write cache is empty after the flush, but the current block is still decoded
+		const DyscoMemoryUsage memory = dysco.GetMemoryUsage("DATA");
+		BOOST_CHECK(memory.peak[WriteCacheMemory] != 0);
+		BOOST_CHECK_EQUAL(memory.current[WriteCacheMemory], 0u);
+		BOOST_CHECK(memory.current[DecodedBlockMemory] != 0);
+		BOOST_CHECK(memory.totalPeak >= memory.totalCurrent);
+	}
+	
+	casacore::Table table("TestTable");
+	CheckTimesteps<casacore::Complex>(table, "DATA");
+	const DyscoStMan& dysco = dynamic_cast<DyscoStMan&>(*table.findDataManager("DATA", true));
+	const DyscoTimings timings = dysco.GetTimings("DATA");
+	BOOST_CHECK(timings.counts[ReadIOStage] >= nBlocks);
+	BOOST_CHECK(timings.counts[DecodeStage] != 0);
+	BOOST_CHECK_EQUAL(timings.counts[WriteIOStage], 0u);
+	BOOST_CHECK(dysco.GetCacheOccupancy("DATA").empty());
+	BOOST_CHECK(dysco.GetMemoryUsage("DATA").peak[PackedReadBufferMemory] != 0);
+}
+
+BOOST_AUTO_TEST_CASE( error_statistics )
+{
+	DyscoStMan dysco(8, 12);
+	dysco.SetErrorStatistics(true);
+	BOOST_CHECK(dysco.dataManagerSpec().asBool("errorStatistics"));
+	dysco.createDirArrColumn("DATA", casacore::DataType::TpComplex, "");
+	BOOST_CHECK_EQUAL(dysco.GetErrorStatistics("DATA").blockCount, 0u);
+	BOOST_CHECK_THROW(dysco.GetErrorStatistics("NOT_A_COLUMN"), DyscoStManError);
+	
+	DyscoErrorStatistics a, b;
+	a.blockCount = 1;
+	a.valueCount = 4;
+	a.clippedCount = 1;
+	a.squaredErrorSum = 4.0;
+	a.squaredValueSum = 16.0;
+	a.maxBlockRMSError = 1.0;
+	b.blockCount = 1;
+	b.valueCount = 4;
+	b.nonFiniteCount = 2;
+	b.squaredErrorSum = 12.0;
+	b.squaredValueSum = 48.0;
+	b.maxBlockRMSError = std::sqrt(3.0);
+	a += b;
+	BOOST_CHECK_EQUAL(a.blockCount, 2u);
+	BOOST_CHECK_EQUAL(a.nonFiniteCount, 2u);
+	BOOST_CHECK_CLOSE_FRACTION(a.RMSError(), std::sqrt(2.0), 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(a.RelativeRMSError(), 0.5, 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(a.ClippedFraction(), 0.125, 1e-6);
+	BOOST_CHECK_CLOSE_FRACTION(a.maxBlockRMSError, std::sqrt(3.0), 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE( error_statistics_of_table )
+{
+	TestTableRemover remover;
+	// Four blocks of three rows with two polarizations, of which one visibility is NaN
+	const size_t nRow = 4 * TimestepRows;
+	IPosition shape(2, 2, 1);
+	DyscoErrorStatistics errors;
+	{
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+		casa::Record spec = GetDyscoSpec();
+		spec.define("errorStatistics", true);
+		casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec));
+		
+		newTable.addRow(nRow);
+		casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+		for(size_t row=0; row!=nRow; ++row)
+		{
+			PutTimestepMetaData(newTable, row);
+			casacore::Array<casacore::Complex> arr(shape, casacore::Complex(row + 1, 0.5 * row));
+			if(row == 4)
+				arr(IPosition(2, 1, 0)) = casacore::Complex(std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::quiet_NaN());
+			dataCol.put(row, arr);
+		}
+		newTable.flush();
+		DyscoStMan& dysco = dynamic_cast<DyscoStMan&>(*newTable.findDataManager("DATA", true));
+		errors = dysco.GetErrorStatistics("DATA");
+	}
+	BOOST_CHECK_EQUAL(errors.blockCount, 4u);
+	BOOST_CHECK_EQUAL(errors.valueCount, nRow * 2 * 2 - 2);
+	BOOST_CHECK_EQUAL(errors.nonFiniteCount, 2u);
+	BOOST_CHECK(errors.RelativeRMSError() > 0.0);
+	BOOST_CHECK(errors.RelativeRMSError() < 0.05);
+	BOOST_CHECK(errors.maxBlockRMSError >= errors.RMSError());
+	
+	// The errors are those of the values that are read back
+	casacore::Table table("TestTable");
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	double squaredErrorSum = 0.0, squaredValueSum = 0.0;
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		const casacore::Array<casacore::Complex> arr = dataCol(row);
+		for(casacore::Array<casacore::Complex>::const_contiter i=arr.cbegin(); i!=arr.cend(); ++i)
+		{
+			if(std::isfinite(i->real()))
+			{
+				const casacore::Complex original(row + 1, 0.5 * row);
+				squaredErrorSum += std::norm(*i - original);
+				squaredValueSum += std::norm(original);
+			}
+		}
+	}
+	BOOST_CHECK_CLOSE_FRACTION(errors.squaredErrorSum, squaredErrorSum, 1e-3);
+	BOOST_CHECK_CLOSE_FRACTION(errors.squaredValueSum, squaredValueSum, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE( trace )
+{
+	DyscoStMan dysco(8, 12);
+	dysco.SetTraceFile("dysco-trace.json");
+	BOOST_CHECK_EQUAL(dysco.dataManagerSpec().asString("traceFile"), "dysco-trace.json");
+	
+	DyscoTracer tracer("unused.json", 2);
+	TraceBuffer* buffer = tracer.NewThreadBuffer("DATA \"encoder\"");
+	buffer->AddInstant("block submit", 3);
+	{
+		TraceScope scope(buffer, "encode", 3);
+	}
+	{
+		TraceScope scope(buffer, "write", 3);
+	}
+	BOOST_CHECK_EQUAL(buffer->Size(), 2u);
+	BOOST_CHECK_EQUAL(buffer->DroppedCount(), 1u);
+	BOOST_CHECK_EQUAL((*buffer)[0].name, "encode");
+	BOOST_CHECK_EQUAL((*buffer)[1].name, "write");
+	BOOST_CHECK((*buffer)[0].start <= (*buffer)[1].start);
+	
+	std::ostringstream stream;
+	tracer.Write(stream);
+	const std::string json = stream.str();
+	BOOST_CHECK(json.find("\"traceEvents\"") != std::string::npos);
+	BOOST_CHECK(json.find("DATA \\\"encoder\\\"") != std::string::npos);
+	BOOST_CHECK(json.find("\"name\":\"write\"") != std::string::npos);
+	BOOST_CHECK(json.find("block submit") == std::string::npos);
 }
 
 BOOST_AUTO_TEST_CASE( maketable )
@@ -157,6 +470,573 @@ BOOST_AUTO_TEST_CASE( maketable )
 	}
 }
 
+BOOST_AUTO_TEST_CASE( bit_count_per_polarization )
+{
+	DyscoStMan dysco(8, 12);
+	dysco.SetDataBitCountPerPolarization(std::vector<unsigned>{8, 4});
+	casacore::Vector<casacore::Int> bitCounts(dysco.dataManagerSpec().asArrayInt("dataBitCountPerPol"));
+	BOOST_CHECK_EQUAL(bitCounts.size(), 2u);
+	BOOST_CHECK_EQUAL(bitCounts[1], 4);
+	
+	casa::Record spec = GetDyscoSpec();
+	spec.define("dataBitCountPerPol", casacore::Vector<casacore::Int>(std::vector<casacore::Int>{8, 4}));
+	size_t nAnt = 3;
+	TestTableFixture fixture(nAnt, spec, 2);
+	
+	casacore::Table table("TestTable");
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK_EQUAL(dm->dataManagerSpec().asArrayInt("dataBitCountPerPol").nelements(), 2u);
+	for(size_t i=0; i!=table.nrow(); ++i)
+	{
+		BOOST_CHECK_CLOSE_FRACTION((*dataCol(i).cbegin()).real(), float(i), 1e-3);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( baseline_bit_counts )
+{
+	DyscoStMan dysco(8, 12);
+	dysco.SetBaselineBitCounts(std::vector<unsigned>{10, 6}, std::vector<double>{1000.0});
+	Record dyscoSpec = dysco.dataManagerSpec();
+	BOOST_CHECK_EQUAL(dyscoSpec.asArrayInt("baselineBitCounts").nelements(), 2u);
+	casacore::Vector<casacore::Double> thresholds(dyscoSpec.asArrayDouble("baselineLengthThresholds"));
+	BOOST_CHECK_EQUAL(thresholds.size(), 1u);
+	BOOST_CHECK_CLOSE_FRACTION(thresholds[0], 1000.0, 1e-6);
+	
+	// Baselines 0-1, 0-2 and 1-2 are 100, 2000 and 500 metres long. Without thresholds
+	// every class gets an equal share, which puts the middle baseline in the long class.
+	TestTableRemover remover;
+	const std::vector<unsigned> bitCounts{10, 6};
+	const double lengths[] = { 100.0, 2000.0, 500.0 };
+	const std::vector<double> thresholdCases[] = { {1000.0}, {} };
+	const std::vector<uint8_t> expectedClasses[] = { {0, 1, 0}, {0, 1, 1} };
+	const size_t nRow = 2 * TimestepRows, nChannels = 16;
+	IPosition shape(2, 1, nChannels);
+	casacore::TableDesc dyscoColumns;
+	AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+	{
+		// The baseline lengths are read from the UVW column when the first block is complete
+		DyscoStMan baselineDysco("DATA_dm", GetDyscoSpec());
+		baselineDysco.SetBaselineBitCounts(bitCounts);
+		casacore::Table newTable = CreateTable(dyscoColumns, baselineDysco);
+		BOOST_CHECK_THROW(WriteTimesteps<casacore::Complex>(newTable, "DATA", 2), DyscoStManError);
+	}
+	
+	for(size_t c=0; c!=2; ++c)
+	{
+		{
+			DyscoStMan baselineDysco("DATA_dm", GetDyscoSpec());
+			baselineDysco.SetBaselineBitCounts(bitCounts, thresholdCases[c]);
+			casacore::Table newTable = CreateTable(dyscoColumns, baselineDysco);
+			casacore::ArrayColumnDesc<double> uvwDesc("UVW", "", "", "", IPosition(1, 3));
+			uvwDesc.setOptions(casacore::ColumnDesc::Direct | casacore::ColumnDesc::FixedShape);
+			newTable.addColumn(uvwDesc);
+			
+			newTable.addRow(nRow);
+			casacore::ArrayColumn<double> uvwCol(newTable, "UVW");
+			casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+			for(size_t row=0; row!=nRow; ++row)
+			{
+				PutTimestepMetaData(newTable, row);
+				casacore::Array<double> uvw(IPosition(1, 3), 0.0);
+				uvw(IPosition(1, 0)) = lengths[row % TimestepRows];
+				uvwCol.put(row, uvw);
+			}
+			for(size_t row=0; row!=nRow; ++row)
+			{
+				casacore::Array<casacore::Complex> values(shape);
+				for(size_t ch=0; ch!=nChannels; ++ch)
+					values(IPosition(2, 0, ch)) = casacore::Complex(row + 1 + std::sin(ch), std::cos(ch));
+				dataCol.put(row, values);
+			}
+			const DyscoStMan& writtenDysco = dynamic_cast<DyscoStMan&>(*newTable.findDataManager("DATA", true));
+			BOOST_CHECK(writtenDysco.GetBaselineClasses() == expectedClasses[c]);
+		}
+		
+		// The classes are stored in the header, and the rows of the class with 6 bits
+		// are less accurate than those of the class with 10 bits
+		{
+			casacore::Table table("TestTable");
+			const DyscoStMan& readDysco = dynamic_cast<DyscoStMan&>(*table.findDataManager("DATA", true));
+			const std::vector<uint8_t> classes = readDysco.GetBaselineClasses();
+			BOOST_CHECK(classes == expectedClasses[c]);
+			casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+			double maxError[2] = { 0.0, 0.0 }, minError[2] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+			for(size_t row=0; row!=nRow; ++row)
+			{
+				const casacore::Array<casacore::Complex> values = dataCol(row);
+				double squaredError = 0.0;
+				for(size_t ch=0; ch!=nChannels; ++ch)
+					squaredError += std::norm(values(IPosition(2, 0, ch)) - casacore::Complex(row + 1 + std::sin(ch), std::cos(ch)));
+				const uint8_t baselineClass = classes[row % TimestepRows];
+				maxError[baselineClass] = std::max(maxError[baselineClass], squaredError);
+				minError[baselineClass] = std::min(minError[baselineClass], squaredError);
+			}
+			BOOST_CHECK(maxError[0] < minError[1]);
+		}
+		boost::filesystem::remove_all("TestTable");
+	}
+}
+
+BOOST_AUTO_TEST_CASE( lossless_autocorrelations )
+{
+	casa::Record spec = GetDyscoSpec();
+	spec.define("losslessAutoCorrelations", true);
+	size_t nAnt = 3;
+	TestTableFixture fixture(nAnt, spec, 1, true);
+	
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK(dm->dataManagerSpec().asBool("losslessAutoCorrelations"));
+	casacore::ScalarColumn<int> a1Col(table, "ANTENNA1"), a2Col(table, "ANTENNA2");
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	for(size_t i=0; i!=table.nrow(); ++i)
+	{
+		const float value = (*dataCol(i).cbegin()).real();
+		if(a1Col(i) == a2Col(i))
+			BOOST_CHECK_EQUAL(value, float(i));
+		else
+			BOOST_CHECK_CLOSE_FRACTION(value, float(i), 1e-4);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( prediction )
+{
+	casa::Record spec = GetDyscoSpec();
+	spec.define("predictionInterval", 2);
+	size_t nAnt = 4;
+	TestTableFixture fixture(nAnt, spec);
+	
+	// The second timestep is predicted by the first
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK_EQUAL(dm->dataManagerSpec().asInt("predictionInterval"), 2);
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	for(size_t i=table.nrow(); i!=0; --i)
+	{
+		BOOST_CHECK_CLOSE_FRACTION((*dataCol(i-1).cbegin()).real(), float(i-1), 1e-3);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( prediction_rewritten_keyframe )
+{
+	TestTableRemover remover;
+	const size_t nBaselines = TimestepRows, nTimes = 2, nRow = nBaselines * nTimes;
+	IPosition shape(2, 1, 1);
+	casacore::TableDesc dyscoColumns;
+	AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+	casa::Record spec = GetDyscoSpec();
+	spec.define("predictionInterval", 2);
+	{
+		casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec));
+		WriteTimesteps<casacore::Complex>(newTable, "DATA", nTimes);
+	}
+	
+	// Rewriting the keyframe should not change the block that was predicted from it
+	{
+		casacore::Table table("TestTable", casacore::Table::Update);
+		casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+		for(size_t row=0; row!=nBaselines; ++row)
+			dataCol.put(row, casacore::Array<casacore::Complex>(shape, casacore::Complex(100.0, 1.0)));
+	}
+	
+	{
+		casacore::Table table("TestTable");
+		casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+		for(size_t row=0; row!=nBaselines; ++row)
+			BOOST_CHECK_CLOSE_FRACTION((*dataCol(row).cbegin()).real(), 100.0, 1e-2);
+		for(size_t row=nBaselines; row!=nRow; ++row)
+			BOOST_CHECK_CLOSE_FRACTION((*dataCol(row).cbegin()).real(), float(row + 1), 1e-2);
+	}
+	
+	// Blocks can only be predicted when they are written in order
+	boost::filesystem::remove_all("TestTable");
+	spec.define("rowsPerBlock", int(nBaselines));
+	spec.define("antennaCount", 3);
+	BOOST_CHECK_THROW(CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec)), DyscoStManError);
+}
+
+BOOST_AUTO_TEST_CASE( stokes_transform )
+{
+	casa::Record spec = GetDyscoSpec();
+	spec.define("stokesTransform", true);
+	spec.define("dataBitCountPerPol", casacore::Vector<casacore::Int>(std::vector<casacore::Int>{10, 10, 6, 6}));
+	size_t nAnt = 3;
+	TestTableFixture fixture(nAnt, spec, 4);
+	
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK(dm->dataManagerSpec().asBool("stokesTransform"));
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	for(size_t i=0; i!=table.nrow(); ++i)
+	{
+		casacore::Array<casacore::Complex> values = dataCol(i);
+		BOOST_CHECK_CLOSE_FRACTION(values.data()[0].real(), float(i), 1e-2);
+		BOOST_CHECK_SMALL(values.data()[3].real(), 0.05f);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( skip_flagged_data )
+{
+	casa::Record spec = GetDyscoSpec();
+	spec.define("skipFlaggedData", true);
+	size_t nAnt = 4;
+	TestTableFixture fixture(nAnt, spec, 2);
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	{
+		// Every baseline with antenna 3 is flagged, as well as the second polarization of antenna 2
+		casacore::Table table("TestTable", casacore::Table::Update);
+		casacore::ScalarColumn<int> a2Col(table, "ANTENNA2");
+		casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+		for(size_t i=0; i!=table.nrow(); ++i)
+		{
+			const bool isDead = a2Col(i) == 3;
+			casacore::Array<casacore::Complex> arr(IPosition(2, 2, 1), isDead ? casacore::Complex(nan, nan) : casacore::Complex(i, 1.0));
+			if(a2Col(i) == 2)
+				arr(IPosition(2, 1, 0)) = casacore::Complex(nan, nan);
+			dataCol.put(i, arr);
+		}
+	}
+
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK(dm->dataManagerSpec().asBool("skipFlaggedData"));
+	casacore::ScalarColumn<int> a2Col(table, "ANTENNA2");
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	for(size_t i=0; i!=table.nrow(); ++i)
+	{
+		casacore::Array<casacore::Complex> values = dataCol(i);
+		if(a2Col(i) == 3)
+		{
+			BOOST_CHECK(!std::isfinite(values(IPosition(2, 0, 0)).real()));
+			BOOST_CHECK(!std::isfinite(values(IPosition(2, 1, 0)).imag()));
+		}
+		else {
+			BOOST_CHECK_CLOSE_FRACTION(values(IPosition(2, 0, 0)).real(), float(i), 1e-2);
+			BOOST_CHECK_EQUAL(std::isfinite(values(IPosition(2, 1, 0)).real()), a2Col(i) != 2);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( declared_block_layout )
+{
+	TestTableRemover remover;
+	const size_t nAnt = 3, nBaselines = TimestepRows, nTimes = 4, nRow = nBaselines * nTimes;
+	IPosition shape(2, 1, 1);
+	{
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+		casa::Record spec = GetDyscoSpec();
+		spec.define("rowsPerBlock", int(nBaselines));
+		spec.define("antennaCount", int(nAnt));
+		casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec));
+		
+		newTable.addRow(nRow);
+		casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+		// The blocks are written from the last to the first
+		for(size_t i=nRow; i!=0; --i)
+		{
+			PutTimestepMetaData(newTable, i - 1);
+			dataCol.put(i - 1, casacore::Array<casacore::Complex>(shape, casacore::Complex(i, 1.0)));
+		}
+	}
+	
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK_EQUAL(dm->dataManagerSpec().asInt("rowsPerBlock"), int(nBaselines));
+	CheckTimesteps<casacore::Complex>(table, "DATA");
+}
+
+BOOST_AUTO_TEST_CASE( variable_rows_per_block )
+{
+	TestTableRemover remover;
+	// Timesteps with 3, 4 and 1 baselines. The second timestep has an antenna that is
+	// not in the first, and is split into two blocks, because it is longer than 3 rows.
+	const int antennas[][2] = { {0, 1}, {0, 2}, {1, 2}, {0, 1}, {0, 3}, {1, 3}, {2, 3}, {1, 2} };
+	const double times[] = { 10.0, 10.0, 10.0, 11.0, 11.0, 11.0, 11.0, 12.0 };
+	const size_t nRow = 8;
+	IPosition shape(2, 1, 1);
+	{
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+		casa::Record spec = GetDyscoSpec();
+		spec.define("variableRowsPerBlock", true);
+		spec.define("rowsPerBlock", 3);
+		spec.define("antennaCount", 4);
+		casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec));
+		
+		newTable.addRow(nRow);
+		casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+		for(size_t row=0; row!=nRow; ++row)
+		{
+			PutMetaData(newTable, row, antennas[row][0], antennas[row][1], times[row]);
+			dataCol.put(row, casacore::Array<casacore::Complex>(shape, casacore::Complex(row + 1, 1.0)));
+		}
+	}
+	
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK(dm->dataManagerSpec().asBool("variableRowsPerBlock"));
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	for(size_t i=nRow; i!=0; --i)
+		BOOST_CHECK_CLOSE_FRACTION((*dataCol(i - 1).cbegin()).real(), float(i), 1e-2);
+}
+
+BOOST_AUTO_TEST_CASE( variable_rows_per_block_order )
+{
+	TestTableRemover remover;
+	IPosition shape(2, 1, 1);
+	casacore::TableDesc dyscoColumns;
+	AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+	casa::Record spec = GetDyscoSpec();
+	spec.define("variableRowsPerBlock", true);
+	spec.define("rowsPerBlock", 3);
+	spec.define("antennaCount", 3);
+	casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec));
+	newTable.addRow(4);
+	casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+	const casacore::Array<casacore::Complex> data(shape, casacore::Complex(1.0, 1.0));
+	for(size_t row=0; row!=4; ++row)
+		PutMetaData(newTable, row, 0, 1 + row%2, row < 2 ? 10.0 : 0.0);
+	
+	// Rows are indexed in order
+	BOOST_CHECK_THROW(dataCol.put(1, data), DyscoStManError);
+	dataCol.put(0, data);
+	dataCol.put(1, data);
+	
+	// The time of row 2 is set after its data was written
+	dataCol.put(2, data);
+	PutMetaData(newTable, 2, 0, 1, 10.0);
+	PutMetaData(newTable, 3, 0, 2, 10.0);
+	BOOST_CHECK_THROW(dataCol.put(3, data), DyscoStManError);
+	BOOST_CHECK_THROW(dataCol.put(2, data), DyscoStManError);
+}
+
+BOOST_AUTO_TEST_CASE( channels_per_data_description )
+{
+	TestTableRemover remover;
+	// Two spectral windows with 2 and 3 channels, for two timesteps of three baselines
+	const size_t nPol = 2, nBaselines = 3, nRow = 4 * nBaselines;
+	const size_t channelCounts[] = { 2, 3 };
+	{
+		casacore::TableDesc dyscoColumns;
+		dyscoColumns.addColumn(casacore::ArrayColumnDesc<casacore::Complex>("DATA", "", "DyscoStMan", "", 2));
+		DyscoStMan dysco("DATA_dm", GetDyscoSpec());
+		dysco.SetMaximumShape(nPol, 3);
+		dysco.SetSkipFlaggedData(true);
+		casacore::Table newTable = CreateTable(dyscoColumns, dysco);
+		
+		newTable.addRow(nRow);
+		casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+		for(size_t row=0; row!=nRow; ++row)
+		{
+			const size_t baseline = row % nBaselines, dataDescId = (row / nBaselines) % 2;
+			PutMetaData(newTable, row, baseline == 2 ? 1 : 0, baseline == 0 ? 1 : 2, 10.0 + row / (2 * nBaselines), dataDescId);
+			casacore::Array<casacore::Complex> values(IPosition(2, nPol, channelCounts[dataDescId]));
+			for(size_t ch=0; ch!=channelCounts[dataDescId]; ++ch)
+			{
+				for(size_t p=0; p!=nPol; ++p)
+					values(IPosition(2, p, ch)) = casacore::Complex(row + 1, ch + 1);
+			}
+			dataCol.put(row, values);
+		}
+	}
+	
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("DATA", true);
+	BOOST_CHECK_EQUAL(casacore::Vector<casacore::Int>(dm->dataManagerSpec().asArrayInt("maximumShape"))[1], 3);
+	casacore::ArrayColumn<casacore::Complex> dataCol(table, "DATA");
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		const size_t nChannels = channelCounts[(row / nBaselines) % 2];
+		BOOST_CHECK_EQUAL(dataCol.shape(row)[1], long(nChannels));
+		casacore::Array<casacore::Complex> values = dataCol(row);
+		BOOST_CHECK_EQUAL(values.nelements(), nPol * nChannels);
+		BOOST_CHECK_CLOSE_FRACTION(values(IPosition(2, 1, nChannels - 1)).real(), float(row + 1), 1e-2);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( partial_blocks )
+{
+	TestTableRemover remover;
+	// Two time blocks of three rows, of which the second is not complete
+	const size_t nRow = 5;
+	IPosition shape(2, 1, 1);
+	for(bool isLayoutDeclared : { true, false })
+	{
+		{
+			casacore::TableDesc dyscoColumns;
+			AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+			casa::Record spec = GetDyscoSpec();
+			if(isLayoutDeclared)
+			{
+				spec.define("rowsPerBlock", 3);
+				spec.define("antennaCount", 3);
+			}
+			casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec));
+			
+			newTable.addRow(nRow);
+			for(size_t row=0; row!=nRow; ++row)
+				PutTimestepMetaData(newTable, row);
+			casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+			for(size_t row=0; row!=2; ++row)
+				dataCol.put(row, casacore::Array<casacore::Complex>(shape, casacore::Complex(row + 1, 1.0)));
+			// Rows of the first block can be read before the block is complete
+			BOOST_CHECK_EQUAL((*dataCol(1).cbegin()).real(), 2.0);
+			BOOST_CHECK_EQUAL((*dataCol(2).cbegin()).real(), 0.0);
+			
+			// A flush before the first block is complete writes the block with a declared
+			// layout, and otherwise keeps the rows in memory
+			newTable.flush();
+			for(size_t row=2; row!=nRow; ++row)
+				dataCol.put(row, casacore::Array<casacore::Complex>(shape, casacore::Complex(row + 1, 1.0)));
+		}
+		
+		CheckTimesteps<casacore::Complex>(casacore::Table("TestTable"), "DATA");
+	}
+}
+
+/**
+ * Flags of the flag column test: the blocks are unflagged, flagged, alternating
+ * (stored as a bitmap), flagged in one range of channels (stored as run lengths),
+ * and the last block is incomplete.
+ */
+bool TestFlag(size_t row, size_t polarization, size_t channel)
+{
+	switch(row / TimestepRows)
+	{
+		case 0: return false;
+		case 1: return true;
+		case 2: return (row + polarization + channel) % 2 == 1;
+		case 3: return channel >= 16 && channel < 48;
+		default: return channel == row;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( flag_column )
+{
+	TestTableRemover remover;
+	const size_t nPol = 4, nChannels = 64, nRow = 4 * TimestepRows + 2;
+	IPosition shape(2, nPol, nChannels);
+	{
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Bool>(dyscoColumns, "FLAG", shape);
+		casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", GetDyscoSpec()));
+		
+		newTable.addRow(nRow);
+		casacore::ArrayColumn<casacore::Bool> flagCol(newTable, "FLAG");
+		for(size_t row=0; row!=nRow; ++row)
+		{
+			PutTimestepMetaData(newTable, row);
+			casacore::Array<casacore::Bool> flags(shape);
+			for(size_t ch=0; ch!=nChannels; ++ch)
+			{
+				for(size_t p=0; p!=nPol; ++p)
+					flags(IPosition(2, p, ch)) = TestFlag(row, p, ch);
+			}
+			flagCol.put(row, flags);
+		}
+		BOOST_CHECK(newTable.isColumnWritable("FLAG"));
+	}
+	
+	casacore::Table table("TestTable");
+	casacore::ArrayColumn<casacore::Bool> flagCol(table, "FLAG");
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		const casacore::Array<casacore::Bool> flags = flagCol(row);
+		BOOST_CHECK_EQUAL(flags.nelements(), nPol * nChannels);
+		size_t mismatchCount = 0;
+		for(size_t ch=0; ch!=nChannels; ++ch)
+		{
+			for(size_t p=0; p!=nPol; ++p)
+			{
+				if(flags(IPosition(2, p, ch)) != TestFlag(row, p, ch))
+					++mismatchCount;
+			}
+		}
+		BOOST_CHECK_EQUAL(mismatchCount, 0u);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( derived_flags )
+{
+	TestTableRemover remover;
+	{
+		// Flags can not be derived from Stokes parameters
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", IPosition(2, 4, 1));
+		AddDyscoColumn<casacore::Bool>(dyscoColumns, "FLAG", IPosition(2, 4, 1));
+		casa::Record spec = GetDyscoSpec();
+		spec.define("deriveFlags", true);
+		spec.define("stokesTransform", true);
+		BOOST_CHECK_THROW(CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec)), DyscoStManError);
+		boost::filesystem::remove_all("TestTable");
+	}
+	
+	IPosition shape(2, 2, 1);
+	{
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+		AddDyscoColumn<casacore::Bool>(dyscoColumns, "FLAG", shape);
+		casa::Record spec = GetDyscoSpec();
+		spec.define("deriveFlags", true);
+		casacore::Table newTable = CreateTable(dyscoColumns, DyscoStMan("DATA_dm", spec));
+		
+		const size_t nRow = 6;
+		newTable.addRow(nRow);
+		casacore::ArrayColumn<casacore::Complex> dataCol(newTable, "DATA");
+		for(size_t i=0; i!=nRow; ++i)
+		{
+			PutTimestepMetaData(newTable, i);
+			casacore::Array<casacore::Complex> arr(shape, casacore::Complex(i, 1.0));
+			// Flag the second polarization of every other row
+			if(i%2 == 1)
+				arr(IPosition(2, 1, 0)) = casacore::Complex(std::numeric_limits<float>::quiet_NaN(), 0.0);
+			dataCol.put(i, arr);
+		}
+		BOOST_CHECK(!newTable.isColumnWritable("FLAG"));
+	}
+	
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("FLAG", true);
+	BOOST_CHECK(dm->dataManagerSpec().asBool("deriveFlags"));
+	casacore::ArrayColumn<casacore::Bool> flagCol(table, "FLAG");
+	for(size_t i=0; i!=table.nrow(); ++i)
+	{
+		casacore::Array<casacore::Bool> flags = flagCol(i);
+		BOOST_CHECK(!flags(IPosition(2, 0, 0)));
+		BOOST_CHECK_EQUAL(flags(IPosition(2, 1, 0)), i%2 == 1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( float_columns )
+{
+	TestTableRemover remover;
+	IPosition shape(2, 1, 1);
+	casacore::TableDesc dyscoColumns;
+	AddDyscoColumn<float>(dyscoColumns, "SIGMA_SPECTRUM", shape);
+	// Float columns other than WEIGHT_SPECTRUM need their own bit count
+	BOOST_CHECK_THROW(CreateTable(dyscoColumns, DyscoStMan(8, 12)), DyscoStManError);
+	
+	DyscoStMan dysco(8, 12);
+	dysco.SetFloatColumnBitCount("SIGMA_SPECTRUM", 10);
+	BOOST_CHECK_EQUAL(dysco.dataManagerSpec().subRecord("floatColumnBitCounts").asInt("SIGMA_SPECTRUM"), 10);
+	{
+		casacore::Table newTable = CreateTable(dyscoColumns, dysco);
+		WriteTimesteps<float>(newTable, "SIGMA_SPECTRUM", 2);
+		casacore::ArrayColumn<float> sigmaCol(newTable, "SIGMA_SPECTRUM");
+		// The weight encoder can not store negative or non-finite values
+		BOOST_CHECK_THROW(sigmaCol.put(0, casacore::Array<float>(shape, -1.0)), DyscoStManError);
+		BOOST_CHECK_THROW(sigmaCol.put(0, casacore::Array<float>(shape, std::numeric_limits<float>::quiet_NaN())), DyscoStManError);
+	}
+	
+	casacore::Table table("TestTable");
+	DataManager* dm = table.findDataManager("SIGMA_SPECTRUM", true);
+	BOOST_CHECK_EQUAL(dm->dataManagerSpec().subRecord("floatColumnBitCounts").asInt("SIGMA_SPECTRUM"), 10);
+	CheckTimesteps<float>(table, "SIGMA_SPECTRUM");
+}
+
 BOOST_AUTO_TEST_CASE( read_past_end )
 {
 	/**
@@ -197,4 +1077,57 @@ BOOST_AUTO_TEST_CASE( readonly )
 	}
 }
 
+BOOST_AUTO_TEST_CASE( add_column_with_data )
+{
+	TestTableRemover remover;
+	const size_t nRow = 2 * TimestepRows;
+	IPosition shape(2, 1, 1);
+	{
+		casacore::TableDesc dyscoColumns;
+		AddDyscoColumn<casacore::Complex>(dyscoColumns, "DATA", shape);
+		DyscoStMan dysco("DATA_dm", GetDyscoSpec());
+		dysco.SetFilePerColumn(true);
+		casacore::Table newTable = CreateTable(dyscoColumns, dysco);
+		WriteTimesteps<casacore::Complex>(newTable, "DATA", nRow / TimestepRows);
+	}
+	
+	// Add a compressed column after the data of the first column has been written
+	{
+		casacore::Table table("TestTable", casacore::Table::Update);
+		casacore::TableDesc modelColumns;
+		AddDyscoColumn<casacore::Complex>(modelColumns, "MODEL_DATA", shape);
+		table.addColumn(modelColumns[0], "DATA_dm", true);
+		casacore::ArrayColumn<casacore::Complex> modelCol(table, "MODEL_DATA");
+		for(size_t row=0; row!=nRow; ++row)
+			modelCol.put(row, casacore::Array<casacore::Complex>(shape, casacore::Complex(row + 11, 1.0)));
+	}
+	
+	{
+		casacore::Table table("TestTable");
+		DataManager* dm = table.findDataManager("DATA", true);
+		BOOST_CHECK(dm->dataManagerSpec().asBool("filePerColumn"));
+		CheckTimesteps<casacore::Complex>(table, "DATA");
+		casacore::ArrayColumn<casacore::Complex> modelCol(table, "MODEL_DATA");
+		for(size_t row=0; row!=nRow; ++row)
+			BOOST_CHECK_CLOSE_FRACTION((*modelCol(row).cbegin()).real(), float(row + 11), 1e-2);
+	}
+	
+	// Removing the column that was written last also removes its file
+	{
+		casacore::Table table("TestTable", casacore::Table::Update);
+		casacore::ArrayColumn<casacore::Complex> modelCol(table, "MODEL_DATA");
+		modelCol.put(0, casacore::Array<casacore::Complex>(shape, casacore::Complex(21.0, 1.0)));
+		table.removeColumn("MODEL_DATA");
+	}
+	
+	casacore::Table table("TestTable");
+	BOOST_CHECK(!table.tableDesc().isColumn("MODEL_DATA"));
+	for(boost::filesystem::directory_iterator file("TestTable"); file!=boost::filesystem::directory_iterator(); ++file)
+	{
+		const std::string filename = file->path().filename().string();
+		BOOST_CHECK(filename.find("_MODEL_DATA") == std::string::npos);
+	}
+	CheckTimesteps<casacore::Complex>(table, "DATA");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+#include "../flagblockencoder.h"
+
+#include <random>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(flagblock_encoder)
+
+typedef TimeBlockBuffer<bool> FlagBuffer;
+
+/**
+ * Encodes, packs, unpacks and decodes the buffer, checks the result against the input
+ * and returns the number of bytes that are stored for the block.
+ */
+static size_t RoundTrip(FlagBuffer& buffer, size_t nRow, size_t nPol, size_t nChan)
+{
+	FlagBlockEncoder encoder(nPol, nChan);
+	std::vector<float> meta(encoder.MetaDataFloatCount());
+	std::vector<FlagBlockEncoder::symbol_t> symbols(encoder.SymbolCount(nRow));
+	encoder.Encode(buffer, meta.data(), symbols.data());
+	
+	const size_t storedSize = encoder.StoredPackedSize(meta.data());
+	BOOST_CHECK_LE(storedSize, encoder.PackedSize(nRow));
+	std::vector<unsigned char> packed(encoder.PackedSize(nRow));
+	encoder.Pack(packed.data(), meta.data(), symbols.data(), nRow);
+	
+	std::vector<FlagBlockEncoder::symbol_t> unpacked(encoder.SymbolCount(nRow));
+	encoder.Unpack(unpacked.data(), meta.data(), packed.data(), nRow);
+	FlagBuffer decoded(nPol, nChan);
+	decoded.resize(nRow);
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		encoder.Decode(decoded, unpacked.data(), row);
+		for(size_t i=0; i!=nPol*nChan; ++i)
+			BOOST_CHECK_EQUAL(decoded[row].visibilities[i], buffer[row].visibilities[i]);
+	}
+	return storedSize;
+}
+
+static void FillBuffer(FlagBuffer& buffer, size_t nRow, size_t nPol, size_t nChan, bool (*flag)(size_t row, size_t index))
+{
+	ao::uvector<bool> values(nPol * nChan);
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		for(size_t i=0; i!=nPol*nChan; ++i)
+			values[i] = flag(row, i);
+		buffer.SetData(row, 0, 1, values.data());
+	}
+}
+
+static bool NoFlags(size_t, size_t) { return false; }
+static bool AllFlags(size_t, size_t) { return true; }
+static bool FlaggedRow(size_t row, size_t) { return row == 3; }
+static bool FirstFlagged(size_t row, size_t index) { return row == 0 && index == 0; }
+static bool RandomFlags(size_t, size_t)
+{
+	static std::mt19937 rnd;
+	return (rnd() & 1) != 0;
+}
+
+BOOST_AUTO_TEST_CASE( block_modes )
+{
+	const size_t nRow = 10, nPol = 4, nChan = 64;
+	FlagBuffer buffer(nPol, nChan);
+	
+	FillBuffer(buffer, nRow, nPol, nChan, NoFlags);
+	BOOST_CHECK_EQUAL(RoundTrip(buffer, nRow, nPol, nChan), 0u);
+	
+	FillBuffer(buffer, nRow, nPol, nChan, AllFlags);
+	BOOST_CHECK_EQUAL(RoundTrip(buffer, nRow, nPol, nChan), 0u);
+	
+	// A flagged row consists of three runs
+	FillBuffer(buffer, nRow, nPol, nChan, FlaggedRow);
+	BOOST_CHECK_EQUAL(RoundTrip(buffer, nRow, nPol, nChan), 3u*2u);
+	
+	// An empty first run is stored when the first value is flagged
+	FillBuffer(buffer, nRow, nPol, nChan, FirstFlagged);
+	BOOST_CHECK_EQUAL(RoundTrip(buffer, nRow, nPol, nChan), 3u*2u);
+	
+	FillBuffer(buffer, nRow, nPol, nChan, RandomFlags);
+	BOOST_CHECK_EQUAL(RoundTrip(buffer, nRow, nPol, nChan), nRow*nPol*nChan/8);
+}
+
+BOOST_AUTO_TEST_CASE( long_runs )
+{
+	// Runs longer than what fits in a run length symbol are split
+	const size_t nRow = 300, nPol = 4, nChan = 256;
+	FlagBuffer buffer(nPol, nChan);
+	FillBuffer(buffer, nRow, nPol, nChan, FlaggedRow);
+	BOOST_CHECK_GT(RoundTrip(buffer, nRow, nPol, nChan), 3u*2u);
+}
+
+BOOST_AUTO_TEST_CASE( partial_block )
+{
+	// The last block of a measurement set may have fewer rows than other blocks
+	const size_t nRow = 10, nPol = 2, nChan = 8;
+	FlagBuffer buffer(nPol, nChan);
+	FillBuffer(buffer, 6, nPol, nChan, FlaggedRow);
+	FlagBlockEncoder encoder(nPol, nChan);
+	std::vector<float> meta(encoder.MetaDataFloatCount());
+	std::vector<FlagBlockEncoder::symbol_t> symbols(encoder.SymbolCount(nRow), 1);
+	encoder.Encode(buffer, meta.data(), symbols.data());
+	std::vector<unsigned char> packed(encoder.PackedSize(nRow));
+	encoder.Pack(packed.data(), meta.data(), symbols.data(), nRow);
+	std::vector<FlagBlockEncoder::symbol_t> unpacked(encoder.SymbolCount(nRow));
+	encoder.Unpack(unpacked.data(), meta.data(), packed.data(), nRow);
+	for(size_t i=0; i!=6*nPol*nChan; ++i)
+		BOOST_CHECK_EQUAL(unpacked[i], (i/(nPol*nChan) == 3) ? 1 : 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,4 +1,5 @@
 #include "../aftimeblockencoder.h"
+#include "../autotimeblockencoder.h"
 #include "../dysconormalization.h"
 #include "../rftimeblockencoder.h"
 #include "../rowtimeblockencoder.h"
@@ -23,6 +24,8 @@ std::unique_ptr<TimeBlockEncoder> CreateEncoder(DyscoNormalization blockNormaliz
 			return std::unique_ptr<TimeBlockEncoder>(new AFTimeBlockEncoder(nPol, nChan, true));
 		case RowNormalization:
 			return std::unique_ptr<TimeBlockEncoder>(new RowTimeBlockEncoder(nPol, nChan));
+		case AutoNormalization:
+			return std::unique_ptr<TimeBlockEncoder>(new AutoTimeBlockEncoder(nPol, nChan));
 	}
 }
 
@@ -143,7 +146,7 @@ void TestTimeBlockEncoder(DyscoNormalization blockNormalization)
 
 	const size_t nIter = 25;
 	ao::uvector<float> metaBuffer(encoder->MetaDataCount(nRow, nPol, nChan, nAnt));
-	ao::uvector<unsigned> symbolBuffer(encoder->SymbolCount(nAnt*(nAnt+1)/2));
+	ao::uvector<TimeBlockEncoder::symbol_t> symbolBuffer(encoder->SymbolCount(nAnt*(nAnt+1)/2));
 	
 	for(size_t i=0; i!=nIter; ++i)
 		encoder->EncodeWithDithering(gausEncoder, buffer, metaBuffer.data(), symbolBuffer.data(), nAnt, rnd);
@@ -223,4 +226,119 @@ BOOST_AUTO_TEST_CASE( rf_normalization_global_rms_accuracy )
 	TestTimeBlockEncoder(RFNormalization);
 }
 
+BOOST_AUTO_TEST_CASE( auto_normalization_per_row_accuracy )
+{
+	TestSimpleExample(AutoNormalization);
+}
+
+BOOST_AUTO_TEST_CASE( auto_normalization_global_rms_accuracy )
+{
+	TestTimeBlockEncoder(AutoNormalization);
+}
+
+double EncodingError(DyscoNormalization blockNormalization, const TimeBlockBuffer<std::complex<float>>& input, size_t nAnt, size_t nPol, size_t nChan)
+{
+	const size_t nRow = input.NRows();
+	StochasticEncoder<float> gausEncoder(16, 1.0, false);
+	std::unique_ptr<TimeBlockEncoder> encoder = CreateEncoder(blockNormalization, nPol, nChan);
+	ao::uvector<float> metaBuffer(encoder->MetaDataCount(nRow, nPol, nChan, nAnt));
+	ao::uvector<TimeBlockEncoder::symbol_t> symbolBuffer(encoder->SymbolCount(nRow));
+	TimeBlockBuffer<std::complex<float>> buffer(input);
+	encoder->EncodeWithoutDithering(gausEncoder, buffer, metaBuffer.data(), symbolBuffer.data(), nAnt);
+	encoder->InitializeDecode(metaBuffer.data(), nRow, nAnt);
+	RMSMeasurement error;
+	const std::vector<TimeBlockBuffer<std::complex<float>>::DataRow>& rows = input.GetVector();
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		encoder->Decode(gausEncoder, buffer, symbolBuffer.data(), row, rows[row].antenna1, rows[row].antenna2);
+		for(size_t i=0; i!=nPol*nChan; ++i)
+			error.Include(std::complex<double>(buffer[row].visibilities[i]) - std::complex<double>(rows[row].visibilities[i]));
+	}
+	return error.RMS();
+}
+
+BOOST_AUTO_TEST_CASE( auto_normalization_selects_smallest_error )
+{
+	const size_t nAnt = 8, nChan = 16, nPol = 2;
+	TimeBlockBuffer<std::complex<float>> buffer(nPol, nChan);
+	std::mt19937 rnd;
+	std::normal_distribution<float> dist;
+	std::vector<std::complex<float>> data(nChan*nPol);
+	size_t row = 0;
+	for(size_t a1=0; a1!=nAnt; ++a1)
+	{
+		for(size_t a2=a1+1; a2!=nAnt; ++a2)
+		{
+			for(size_t i=0; i!=data.size(); ++i)
+			{
+				// Add a bright narrow-band spike to a single channel of a few baselines
+				const float f = (i/nPol == 3 && a1 == 0) ? 100.0 : 1.0;
+				data[i] = std::complex<float>(dist(rnd), dist(rnd)) * f;
+			}
+			buffer.SetData(row, a1, a2, data.data());
+			++row;
+		}
+	}
+	const double autoError = EncodingError(AutoNormalization, buffer, nAnt, nPol, nChan);
+	for(DyscoNormalization normalization : { AFNormalization, RFNormalization, RowNormalization })
+		BOOST_CHECK_LE(autoError, EncodingError(normalization, buffer, nAnt, nPol, nChan) * (1.0 + 1e-6));
+}
+
+BOOST_AUTO_TEST_CASE( polarization_quantizers )
+{
+	const size_t nAnt = 10, nChan = 16, nPol = 2, nRow = (nAnt*(nAnt-1)/2);
+	
+	TimeBlockBuffer<std::complex<float>> buffer(nPol, nChan);
+	std::mt19937 rnd;
+	std::normal_distribution<float> dist;
+	std::vector<std::complex<float>> data(nChan*nPol);
+	size_t rIndex = 0;
+	for(size_t ant1=0; ant1!=nAnt; ++ant1) {
+		for(size_t ant2=ant1+1; ant2!=nAnt; ++ant2) {
+			for(std::complex<float>& value : data)
+				value = std::complex<float>(dist(rnd), dist(rnd));
+			buffer.SetData(rIndex, ant1, ant2, data.data());
+			++rIndex;
+		}
+	}
+	const TimeBlockBuffer<std::complex<float>> input(buffer);
+	
+	// The 4-bit quantizer is scaled such that it has the same maximum as the 8-bit quantizer
+	StochasticEncoder<float> gausEncoder(256, 1.0, false), unitEncoder(16, 1.0, false);
+	StochasticEncoder<float> lowBitEncoder(16, gausEncoder.MaxQuantity() / unitEncoder.MaxQuantity(), false);
+	BOOST_CHECK_CLOSE_FRACTION(lowBitEncoder.MaxQuantity(), gausEncoder.MaxQuantity(), 1e-5);
+	std::vector<const StochasticEncoder<float>*> quantizers{ &gausEncoder, &lowBitEncoder };
+	
+	std::unique_ptr<TimeBlockEncoder> encoder = CreateEncoder(RFNormalization, nPol, nChan);
+	encoder->SetPolarizationQuantizers(quantizers);
+	ao::uvector<float> metaBuffer(encoder->MetaDataCount(nRow, nPol, nChan, nAnt));
+	ao::uvector<TimeBlockEncoder::symbol_t> symbolBuffer(encoder->SymbolCount(nRow));
+	encoder->EncodeWithoutDithering(gausEncoder, buffer, metaBuffer.data(), symbolBuffer.data(), nAnt);
+	for(size_t i=0; i!=symbolBuffer.size(); ++i)
+	{
+		if((i/2) % nPol == 1)
+			BOOST_CHECK_LT(symbolBuffer[i], 16u);
+	}
+	
+	std::unique_ptr<TimeBlockEncoder> decoder = CreateEncoder(RFNormalization, nPol, nChan);
+	decoder->SetPolarizationQuantizers(quantizers);
+	decoder->InitializeDecode(metaBuffer.data(), nRow, nAnt);
+	TimeBlockBuffer<std::complex<float>> out(nPol, nChan);
+	out.resize(nRow);
+	RMSMeasurement errors[nPol];
+	const std::vector<TimeBlockBuffer<std::complex<float>>::DataRow>& inputRows = input.GetVector();
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		decoder->Decode(gausEncoder, out, symbolBuffer.data(), row, inputRows[row].antenna1, inputRows[row].antenna2);
+		for(size_t i=0; i!=nChan*nPol; ++i)
+		{
+			std::complex<double> error = std::complex<double>(out[row].visibilities[i]) - std::complex<double>(inputRows[row].visibilities[i]);
+			errors[i%nPol].Include(error);
+		}
+	}
+	BOOST_CHECK_LT(errors[0].RMS(), 0.05);
+	BOOST_CHECK_LT(errors[1].RMS(), 0.5);
+	BOOST_CHECK_LT(errors[0].RMS()*4.0, errors[1].RMS());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
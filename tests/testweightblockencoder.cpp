@@ -0,0 +1,126 @@
+#include "../weightblockencoder.h"
+
+#include <limits>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(weightblock_encoder)
+
+typedef TimeBlockBuffer<float> WBuffer;
+
+static void FillBuffer(WBuffer& buffer, size_t nRow, size_t nPol, size_t nChan, float (*weight)(size_t row, size_t ch))
+{
+	std::vector<float> values(nPol * nChan);
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		for(size_t ch=0; ch!=nChan; ++ch)
+		{
+			for(size_t p=0; p!=nPol; ++p)
+				values[ch*nPol + p] = weight(row, ch);
+		}
+		buffer.SetData(row, 0, 1, values.data());
+	}
+}
+
+/**
+ * Encodes and decodes a buffer, checks the result against the input and returns
+ * the number of stored symbols.
+ */
+static size_t RoundTrip(WeightBlockEncoder& encoder, WBuffer& buffer, size_t nRow, size_t nPol, size_t nChan, double tolerance)
+{
+	std::vector<float> meta(encoder.MetaDataFloatCount());
+	std::vector<WeightBlockEncoder::symbol_t> symbols(encoder.SymbolCount(nRow));
+	encoder.Encode(buffer, meta.data(), symbols.data());
+
+	// Symbols that are not stored are not available while decoding
+	const size_t storedCount = encoder.StoredSymbolCount(meta.data(), nRow);
+	std::fill(symbols.begin() + storedCount, symbols.end(), 0);
+
+	WBuffer decoded(nPol, nChan);
+	decoded.resize(nRow);
+	encoder.InitializeDecode(meta.data());
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		encoder.Decode(decoded, symbols.data(), row);
+		for(size_t i=0; i!=nPol*nChan; ++i)
+			BOOST_CHECK_CLOSE_FRACTION(decoded[row].visibilities[i], buffer[row].visibilities[i], tolerance);
+	}
+	return storedCount;
+}
+
+static float ConstantWeight(size_t, size_t) { return 7.5; }
+static float RowWeight(size_t row, size_t) { return 1.0 + row; }
+static float ChannelWeight(size_t row, size_t ch) { return 1.0 + row + 0.5*ch; }
+
+BOOST_AUTO_TEST_CASE( block_modes )
+{
+	const size_t nRow = 6, nPol = 2, nChan = 4;
+	WeightBlockEncoder encoder(nPol, nChan, 1 << 12, true);
+	BOOST_CHECK_EQUAL(encoder.MetaDataFloatCount(), 2u);
+
+	WBuffer buffer(nPol, nChan);
+	FillBuffer(buffer, nRow, nPol, nChan, ConstantWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 1e-6), 0u);
+
+	FillBuffer(buffer, nRow, nPol, nChan, RowWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 1e-3), nRow);
+
+	FillBuffer(buffer, nRow, nPol, nChan, ChannelWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 1e-3), nRow*nChan);
+}
+
+BOOST_AUTO_TEST_CASE( without_block_modes )
+{
+	const size_t nRow = 6, nPol = 2, nChan = 4;
+	WeightBlockEncoder encoder(nPol, nChan, 1 << 12);
+	BOOST_CHECK_EQUAL(encoder.MetaDataFloatCount(), 1u);
+
+	WBuffer buffer(nPol, nChan);
+	FillBuffer(buffer, nRow, nPol, nChan, ConstantWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 1e-3), nRow*nChan);
+}
+
+static float LargeChannelWeight(size_t row, size_t ch) { return ch == 0 ? 1000.0 : 1.0 + 0.1*row; }
+
+BOOST_AUTO_TEST_CASE( channel_scales )
+{
+	const size_t nRow = 6, nPol = 2, nChan = 4;
+	WeightBlockEncoder encoder(nPol, nChan, 1 << 8, true, true);
+	BOOST_CHECK_EQUAL(encoder.MetaDataFloatCount(), 1u + nChan);
+
+	// With one maximum for the block, the small weights would be quantized with a step of 1000/255
+	WBuffer buffer(nPol, nChan);
+	FillBuffer(buffer, nRow, nPol, nChan, LargeChannelWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 0.02), nRow*nChan);
+
+	FillBuffer(buffer, nRow, nPol, nChan, RowWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 0.02), nRow);
+	
+	FillBuffer(buffer, nRow, nPol, nChan, ConstantWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 1e-6), 0u);
+}
+
+BOOST_AUTO_TEST_CASE( per_polarization )
+{
+	const size_t nRow = 6, nPol = 4, nChan = 3;
+	WeightBlockEncoder encoder(nPol, nChan, 1 << 12, true, true, true);
+	BOOST_CHECK_EQUAL(encoder.SymbolCount(nRow), nRow*nChan*nPol);
+
+	WBuffer buffer(nPol, nChan);
+	std::vector<float> values(nPol * nChan);
+	for(size_t row=0; row!=nRow; ++row)
+	{
+		for(size_t i=0; i!=nPol*nChan; ++i)
+			values[i] = 1.0 + row + 0.25*i;
+		// A flagged polarization
+		values[1] = 0.0;
+		buffer.SetData(row, 0, 1, values.data());
+	}
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 1e-3), nRow*nChan*nPol);
+	
+	FillBuffer(buffer, nRow, nPol, nChan, RowWeight);
+	BOOST_CHECK_EQUAL(RoundTrip(encoder, buffer, nRow, nPol, nChan, 1e-3), nRow);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,15 +10,17 @@
 #include <casacore/ms/MeasurementSets/MeasurementSet.h>
 
 #include <algorithm>
+#include <iostream>
 #include <limits>
+#include <sstream>
 
 using namespace altthread;
 
 namespace dyscostman {
 
 template<typename DataType>
-ThreadedDyscoColumn<DataType>::ThreadedDyscoColumn(DyscoStMan* parent, int dtype) :
-	DyscoStManColumn(parent, dtype),
+ThreadedDyscoColumn<DataType>::ThreadedDyscoColumn(DyscoStMan* parent, const std::string& name, int dtype) :
+	DyscoStManColumn(parent, name, dtype),
 	_bitsPerSymbol(0),
 	_ant1Col(),
 	_ant2Col(),
@@ -30,6 +32,11 @@ ThreadedDyscoColumn<DataType>::ThreadedDyscoColumn(DyscoStMan* parent, int dtype
 	_isCurrentBlockChanged(false),
 	_blockSize(0),
 	_antennaCount(0),
+	_userStageCounters(statistics().NewThreadCounters()),
+	_userTraceBuffer(newTraceBuffer(name + " reader/writer")),
+	_decodedBlockMemory(0),
+	_packedReadBufferMemory(0),
+	_unpackedReadBufferMemory(0),
 	_timeBlockBuffer()
 {
 }
@@ -41,17 +48,50 @@ template<typename DataType>
 void ThreadedDyscoColumn<DataType>::shutdown()
 {
 	if(_isCurrentBlockChanged)
-		storeBlock();
+	{
+		// This is called from the destructor, so errors are reported instead of thrown
+		try {
+			if(!areOffsetsInitialized())
+				initializeRowsPerBlockFromTable();
+			storeBlock();
+		} catch(std::exception& e) {
+			std::cerr << e.what() << '\n';
+			_isCurrentBlockChanged = false;
+		}
+	}
 	
 	stopThreads();
 }
 
+template<typename DataType>
+bool ThreadedDyscoColumn<DataType>::Flush()
+{
+	// The rows per block are determined from the first complete time block, or from
+	// the table when the column is closed, so until then the rows stay in memory
+	const bool isCurrentBlockStored = _isCurrentBlockChanged && areOffsetsInitialized();
+	if(isCurrentBlockStored)
+		storeBlock(true);
+	
+	mutex::scoped_lock lock(_mutex);
+	const bool isWritten = isCurrentBlockStored || !_cache.empty();
+	while(!_cache.empty())
+		_cacheChangedCondition.wait(lock);
+	return isWritten;
+}
+
 template<typename DataType>
 ThreadedDyscoColumn<DataType>::~ThreadedDyscoColumn()
 {
 	shutdown();
 }
 
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::updateDecodedBlockMemory()
+{
+	const uint64_t bytes = _timeBlockBuffer ? _timeBlockBuffer->MemoryUsage() : 0;
+	statistics().Memory().Resize(DecodedBlockMemory, _decodedBlockMemory, bytes);
+}
+
 template<typename DataType>
 void ThreadedDyscoColumn<DataType>::stopThreads()
 {
@@ -59,8 +99,9 @@ void ThreadedDyscoColumn<DataType>::stopThreads()
 	
 	if(_threadGroup.empty())
 	{
+		// Blocks are only stored once the rows per block are known, which starts the threads
 		if(!_cache.empty())
-			throw DyscoStManError("DyscoStMan is flushed before at least two timeblocks were stored. DyscoStMan can not handle this situation.");
+			throw DyscoStManError("Internal error in DyscoStMan: blocks were stored before the encoding threads were started");
 	}
 	else {
 		// Don't stop threads before cache is empty
@@ -83,41 +124,115 @@ void ThreadedDyscoColumn<DataType>::setShapeColumn(const casacore::IPosition& sh
 	_shape = shape;
 }
 
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::setShape(casacore::uInt rownr, const casacore::IPosition& shape)
+{
+	if(shape.size() != 2 || shape[0] != _shape[0] || shape[1] <= 0 || shape[1] > _shape[1])
+	{
+		std::ostringstream s;
+		s << "Invalid shape for row " << rownr << " of column " << Name() << ": rows should have " << _shape[0] << " polarizations and at most " << _shape[1] << " channels";
+		throw DyscoStManError(s.str());
+	}
+	setDataDescChannelCount((*_dataDescIdCol)(rownr), shape[1]);
+}
+
+template<typename DataType>
+casacore::IPosition ThreadedDyscoColumn<DataType>::shape(casacore::uInt rownr)
+{
+	if(IsVariableShape())
+	{
+		const size_t nChannels = dataDescChannelCount((*_dataDescIdCol)(rownr));
+		if(nChannels != 0)
+			return casacore::IPosition(2, _shape[0], nChannels);
+	}
+	return _shape;
+}
+
+template<typename DataType>
+casacore::Bool ThreadedDyscoColumn<DataType>::isShapeDefined(casacore::uInt rownr)
+{
+	return !IsVariableShape() || dataDescChannelCount((*_dataDescIdCol)(rownr)) != 0;
+}
+
 template<typename DataType>
 void ThreadedDyscoColumn<DataType>::loadBlock(size_t blockIndex)
 {
+	// A version of the block that is still in the write cache is written first
+	waitUntilWritten(blockIndex);
 	if(blockIndex < nBlocksInFile())
 	{
-		readCompressedData(blockIndex, _packedBlockReadBuffer.data(), _blockSize);
-		const size_t nPolarizations = _shape[0], nChannels = _shape[1],
-			nRows = nRowsInBlock(),
-			nMetaFloats = metaDataFloatCount(nRows, nPolarizations, nChannels, _antennaCount);
-		unsigned char* symbolStart = _packedBlockReadBuffer.data() + nMetaFloats*sizeof(float);
-		BytePacker::unpack(_bitsPerSymbol, _unpackedSymbolReadBuffer.data(), symbolStart, symbolCount(nRows, nPolarizations, nChannels));
-		float* metaData = reinterpret_cast<float*>(_packedBlockReadBuffer.data());
-		initializeDecode(_timeBlockBuffer.get(), metaData, nRows, _antennaCount);
-		uint64_t startRow = getRowIndex(blockIndex);
-		_timeBlockBuffer->resize(nRows);
-		for(size_t blockRow=0; blockRow!=nRows; ++blockRow)
-		{
-			int a1 = (*_ant1Col)(startRow + blockRow), a2 = (*_ant2Col)(startRow + blockRow);
-			decode(_timeBlockBuffer.get(), _unpackedSymbolReadBuffer.data(), blockRow, a1, a2);
-		}
+		TraceScope traceScope(_userTraceBuffer, "load block", blockIndex);
+		prepareLoadBlock(blockIndex);
+		readBlock(blockIndex, *_timeBlockBuffer);
+		updateDecodedBlockMemory();
 	}
 	_currentBlock = blockIndex;
 	_isCurrentBlockChanged = false;
 }
 
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::readBlock(size_t blockIndex, TimeBlockBuffer<data_t>& buffer)
+{
+	StageTimer timer(_userStageCounters, ReadIOStage);
+	const size_t nPolarizations = _shape[0], nChannels = _shape[1],
+		nRows = nRowsInBlock(),
+		metaDataSize = sizeof(float) * metaDataFloatCount(nRows, nPolarizations, nChannels, _antennaCount);
+	float* metaData = reinterpret_cast<float*>(_packedBlockReadBuffer.data());
+	unsigned char* symbolStart = _packedBlockReadBuffer.data() + metaDataSize;
+	if(isStoredSizeVariable())
+	{
+		// The metadata determines how many of the reserved bytes are in use
+		readCompressedData(blockIndex, _packedBlockReadBuffer.data(), metaDataSize);
+		readCompressedData(blockIndex, symbolStart, storedPackedSize(metaData, nRows), metaDataSize);
+	}
+	else {
+		readCompressedData(blockIndex, _packedBlockReadBuffer.data(), metaDataSize + packedSymbolSize(nRows));
+	}
+	timer.Switch(UnpackingStage);
+	unpackSymbols(_unpackedSymbolReadBuffer.data(), metaData, symbolStart, nRows);
+	timer.Switch(DecodeStage);
+	initializeDecode(&buffer, metaData, nRows, _antennaCount);
+	uint64_t startRow = getRowIndex(blockIndex);
+	// The rows of the last block that are not in the table are padding
+	const size_t nRowsInTable = rowsInTable(blockIndex);
+	buffer.resize(nRowsInTable);
+	for(size_t blockRow=0; blockRow!=nRowsInTable; ++blockRow)
+	{
+		int a1 = (*_ant1Col)(startRow + blockRow), a2 = (*_ant2Col)(startRow + blockRow);
+		decode(&buffer, _unpackedSymbolReadBuffer.data(), blockRow, a1, a2);
+	}
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::waitUntilWritten(size_t blockIndex)
+{
+	mutex::scoped_lock lock(_mutex);
+	typename cache_t::const_iterator cacheItemPtr = _cache.find(blockIndex);
+	if(cacheItemPtr != _cache.end())
+	{
+		StageTimer timer(_userStageCounters, ReaderWaitStage);
+		TraceScope traceScope(_userTraceBuffer, "reader wait", blockIndex);
+		do {
+			_cacheChangedCondition.wait(lock);
+			cacheItemPtr = _cache.find(blockIndex);
+		} while(cacheItemPtr != _cache.end());
+	}
+}
+
 template<typename DataType>
 void ThreadedDyscoColumn<DataType>::getValues(casacore::uInt rowNr, casacore::Array<DataType>* dataPtr)
 {
 	if(!areOffsetsInitialized())
 	{
-		// Trying to read before first block was written -- return zero
-		// TODO if a few rows were written of the first block, those are
-		// incorrectly returned. This is a rare case but can be fixed.
-		for(typename casacore::Array<DataType>::contiter i=dataPtr->cbegin(); i!=dataPtr->cend(); ++i)
-			*i = DataType();
+		// Trying to read before first block was written -- return the row
+		// when it was written already, zero otherwise
+		const size_t nValues = _shape[0] * _shape[1];
+		if(rowNr < _timeBlockBuffer->NRows() && _timeBlockBuffer->GetVector()[rowNr].visibilities.size() == nValues)
+			getRow(rowNr, dataPtr);
+		else {
+			for(typename casacore::Array<DataType>::contiter i=dataPtr->cbegin(); i!=dataPtr->cend(); ++i)
+				*i = DataType();
+		}
 	}
 	else {
 		size_t blockIndex = getBlockIndex(rowNr);
@@ -128,15 +243,8 @@ void ThreadedDyscoColumn<DataType>::getValues(casacore::uInt rowNr, casacore::Ar
 				*i = DataType();
 		}
 		else {
-			mutex::scoped_lock lock(_mutex);
 			// Wait until the block to be read is not in the write cache
-			typename cache_t::const_iterator cacheItemPtr = _cache.find(blockIndex);
-			while(cacheItemPtr != _cache.end())
-			{
-				_cacheChangedCondition.wait(lock);
-				cacheItemPtr = _cache.find(blockIndex);
-			}
-			lock.unlock();
+			waitUntilWritten(blockIndex);
 			
 			if(_currentBlock != blockIndex)
 			{
@@ -146,32 +254,164 @@ void ThreadedDyscoColumn<DataType>::getValues(casacore::uInt rowNr, casacore::Ar
 			}
 			
 			// The time block encoder is now initialized and contains the unpacked block.
-			_timeBlockBuffer->GetData(getRowWithinBlock(rowNr), dataPtr->data());
+			// Rows that were added to the table after the block was read are not stored yet.
+			const size_t blockRow = getRowWithinBlock(rowNr);
+			if(blockRow < _timeBlockBuffer->NRows())
+				getRow(blockRow, dataPtr);
+			else {
+				for(typename casacore::Array<DataType>::contiter i=dataPtr->cbegin(); i!=dataPtr->cend(); ++i)
+					*i = DataType();
+			}
 		}
 	}
 }
 
 template<typename DataType>
-void ThreadedDyscoColumn<DataType>::storeBlock()
+void ThreadedDyscoColumn<DataType>::getRow(size_t blockRow, casacore::Array<DataType>* dataPtr)
 {
-	// Put the data of the current block into the cache so that the parallell threads can write them
+	const size_t nValues = _shape[0] * _shape[1];
+	if(dataPtr->nelements() == nValues)
+		_timeBlockBuffer->GetData(blockRow, dataPtr->data());
+	else {
+		// The values are ordered by channel, so the first channels come first
+		_paddedRowBuffer.resize(nValues);
+		_timeBlockBuffer->GetData(blockRow, _paddedRowBuffer.data());
+		std::copy_n(_paddedRowBuffer.data(), std::min<size_t>(nValues, dataPtr->nelements()), dataPtr->data());
+	}
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::setRow(size_t blockRow, int antenna1, int antenna2, const casacore::Array<DataType>* dataPtr)
+{
+	const size_t nValues = _shape[0] * _shape[1];
+	if(dataPtr->nelements() == nValues)
+		_timeBlockBuffer->SetData(blockRow, antenna1, antenna2, dataPtr->data());
+	else {
+		_paddedRowBuffer.assign(nValues, paddingValue());
+		std::copy_n(dataPtr->data(), std::min<size_t>(nValues, dataPtr->nelements()), _paddedRowBuffer.data());
+		_timeBlockBuffer->SetData(blockRow, antenna1, antenna2, _paddedRowBuffer.data());
+	}
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::storeBlock(bool keepCurrentBlock)
+{
+	// A previous version of the block should be written before it is prepared again
+	waitUntilWritten(_currentBlock);
+	padBlock(_currentBlock, *_timeBlockBuffer);
+	prepareStoreBlock(_currentBlock);
+	
+	// The memory of the block moves from the decoded block to the write cache, unless it is kept
+	std::unique_ptr<TimeBlockBuffer<data_t>> storedBlock;
+	if(keepCurrentBlock)
+	{
+		storedBlock.reset(new TimeBlockBuffer<data_t>(*_timeBlockBuffer));
+		updateDecodedBlockMemory();
+	}
+	else {
+		storedBlock = std::move(_timeBlockBuffer);
+		statistics().Memory().Resize(DecodedBlockMemory, _decodedBlockMemory, 0);
+	}
+	submitBlock(_currentBlock, std::move(storedBlock));
+	afterStoreBlock(_currentBlock);
+	
+	_isCurrentBlockChanged = false;
+	if(!keepCurrentBlock)
+	{
+		const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+		_timeBlockBuffer.reset(new TimeBlockBuffer<data_t>(nPolarizations, nChannels));
+		updateDecodedBlockMemory();
+	}
+	//_timeBlockBuffer->SetNAntennae(_antennaCount);
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::submitBlock(size_t blockIndex, std::unique_ptr<TimeBlockBuffer<data_t>> block)
+{
+	// Put the data of the block into the cache so that the parallell threads can write them
+	const uint64_t blockMemory = block->MemoryUsage();
+	statistics().Memory().Allocate(WriteCacheMemory, blockMemory);
 	mutex::scoped_lock lock(_mutex);
-	CacheItem *item = new CacheItem(std::move(_timeBlockBuffer));
+	CacheItem *item = new CacheItem(std::move(block), blockMemory);
 	// Wait until there is space available AND the row to be written is not in the cache
-	typename cache_t::iterator cacheItemPtr = _cache.find(_currentBlock);
-	while(_cache.size() >= maxCacheSize() || cacheItemPtr != _cache.end())
+	typename cache_t::iterator cacheItemPtr = _cache.find(blockIndex);
+	if(_cache.size() >= maxCacheSize() || cacheItemPtr != _cache.end())
 	{
-		_cacheChangedCondition.wait(lock);
-		cacheItemPtr = _cache.find(_currentBlock);
+		StageTimer timer(_userStageCounters, CacheWaitStage);
+		TraceScope traceScope(_userTraceBuffer, "cache full wait", blockIndex);
+		do {
+			_cacheChangedCondition.wait(lock);
+			cacheItemPtr = _cache.find(blockIndex);
+		} while(_cache.size() >= maxCacheSize() || cacheItemPtr != _cache.end());
 	}
-	_cache.insert(typename cache_t::value_type(_currentBlock, item));
+	_cache.insert(typename cache_t::value_type(blockIndex, item));
+	statistics().AddCacheOccupancy(_cache.size(), maxCacheSize());
 	_cacheChangedCondition.notify_all();
 	lock.unlock();
-	
-	_isCurrentBlockChanged = false;
-	const size_t nPolarizations = _shape[0], nChannels = _shape[1];
-	_timeBlockBuffer.reset(new TimeBlockBuffer<data_t>(nPolarizations, nChannels));
-	//_timeBlockBuffer->SetNAntennae(_antennaCount);
+	if(_userTraceBuffer)
+		_userTraceBuffer->AddInstant("block submit", blockIndex);
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::padBlock(size_t blockIndex, TimeBlockBuffer<data_t>& buffer) const
+{
+	const size_t nValues = _shape[0] * _shape[1], nRowsInTable = rowsInTable(blockIndex);
+	const uint64_t startRow = getRowIndex(blockIndex);
+	std::vector<typename TimeBlockBuffer<data_t>::DataRow>& rows = buffer.GetVector();
+	if(rows.size() < nRowsInBlock())
+		rows.resize(nRowsInBlock());
+	for(size_t blockRow=0; blockRow!=rows.size(); ++blockRow)
+	{
+		typename TimeBlockBuffer<data_t>::DataRow& row = rows[blockRow];
+		if(row.visibilities.size() != nValues)
+		{
+			// Rows beyond the end of the table are not associated with a baseline,
+			// and are stored as autocorrelations of the first antenna.
+			if(blockRow < nRowsInTable)
+			{
+				row.antenna1 = (*_ant1Col)(startRow + blockRow);
+				row.antenna2 = (*_ant2Col)(startRow + blockRow);
+			}
+			else {
+				row.antenna1 = 0;
+				row.antenna2 = 0;
+			}
+			row.visibilities.assign(nValues, data_t());
+		}
+	}
+}
+
+template<typename DataType>
+size_t ThreadedDyscoColumn<DataType>::rowsInTable(size_t blockIndex) const
+{
+	const uint64_t startRow = getRowIndex(blockIndex), nRow = storageManager().getNRow();
+	if(startRow >= nRow)
+		return 0;
+	else
+		return std::min<uint64_t>(rowsInBlock(blockIndex), nRow - startRow);
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::initializeRowsPerBlockFromTable()
+{
+	// The first time block consists of the rows with the same time, field and spw as
+	// the first row. It should hold at least the rows that were written.
+	const uint64_t nRow = storageManager().getNRow();
+	size_t rowsPerBlock = 0, maxAntennaIndex = _timeBlockBuffer->MaxAntennaIndex();
+	if(nRow != 0)
+	{
+		const double time = (*_timeCol)(0);
+		const int fieldId = (*_fieldCol)(0), dataDescId = (*_dataDescIdCol)(0);
+		while(rowsPerBlock != nRow && (*_timeCol)(rowsPerBlock) == time &&
+			(*_fieldCol)(rowsPerBlock) == fieldId && (*_dataDescIdCol)(rowsPerBlock) == dataDescId)
+		{
+			const size_t ant1 = (*_ant1Col)(rowsPerBlock), ant2 = (*_ant2Col)(rowsPerBlock);
+			maxAntennaIndex = std::max(maxAntennaIndex, std::max(ant1, ant2));
+			++rowsPerBlock;
+		}
+	}
+	rowsPerBlock = std::max(rowsPerBlock, _timeBlockBuffer->NRows());
+	initializeRowsPerBlock(rowsPerBlock, maxAntennaIndex + 1);
 }
 
 template<typename DataType>
@@ -188,7 +428,7 @@ void ThreadedDyscoColumn<DataType>::putValues(casacore::uInt rowNr, const casaco
 		// then the offsets will be read from the headers.
 		//
 		// A consequence of this is that the first blocks in a new measurement set are required to
-		// be written consecutively.
+		// be written consecutively, unless the layout was declared with DyscoStMan::SetBlockLayout().
 		double time = (*_timeCol)(rowNr);
 		int fieldId = (*_fieldCol)(rowNr);
 		int dataDescId = (*_dataDescIdCol)(rowNr);
@@ -209,6 +449,13 @@ void ThreadedDyscoColumn<DataType>::putValues(casacore::uInt rowNr, const casaco
 	const int ant1 = (*_ant1Col)(rowNr), ant2 = (*_ant2Col)(rowNr);
 	if(areOffsetsInitialized())
 	{
+		if(size_t(std::max(ant1, ant2)) >= nAntennae())
+		{
+			std::ostringstream s;
+			s << "Row " << rowNr << " has antenna index " << std::max(ant1, ant2) << ", but the blocks of the DyscoStMan only hold " << nAntennae() << " antennae";
+			throw DyscoStManError(s.str());
+		}
+		indexRows(rowNr);
 		const size_t
 			blockIndex = getBlockIndex(rowNr),
 			blockRow = getRowWithinBlock(rowNr);
@@ -222,10 +469,10 @@ void ThreadedDyscoColumn<DataType>::putValues(casacore::uInt rowNr, const casaco
 			// Load new block
 			loadBlock(blockIndex);
 		}
-		_timeBlockBuffer->SetData(blockRow, ant1, ant2, dataPtr->data());
+		setRow(blockRow, ant1, ant2, dataPtr);
 	}
 	else {
-		_timeBlockBuffer->SetData(rowNr, ant1, ant2, dataPtr->data());
+		setRow(rowNr, ant1, ant2, dataPtr);
 	}
 	_isCurrentBlockChanged = true;
 }
@@ -243,6 +490,7 @@ void ThreadedDyscoColumn<DataType>::Prepare(DyscoDistribution distribution, Dysc
 	
 	size_t nPolarizations = _shape[0], nChannels = _shape[1];
 	_timeBlockBuffer.reset(new TimeBlockBuffer<data_t>(nPolarizations, nChannels));
+	updateDecodedBlockMemory();
 	if(_antennaCount != 0)
 	{
 		//TODO _timeBlockEncoder->SetNAntennae(_antennaCount);
@@ -269,6 +517,8 @@ void ThreadedDyscoColumn<DataType>::InitializeAfterNRowsPerBlockIsKnown()
 	_packedBlockReadBuffer.resize(_blockSize);
 	const size_t nPolarizations = _shape[0], nChannels = _shape[1];
 	_unpackedSymbolReadBuffer.resize(symbolCount(nRowsInBlock(), nPolarizations, nChannels));
+	statistics().Memory().Resize(PackedReadBufferMemory, _packedReadBufferMemory, _packedBlockReadBuffer.capacity());
+	statistics().Memory().Resize(UnpackedReadBufferMemory, _unpackedReadBufferMemory, _unpackedSymbolReadBuffer.capacity() * sizeof(symbol_t));
 	//TODO _timeBlockEncoder->SetNAntennae(_antennaCount);
 	
 	// start the threads
@@ -277,24 +527,38 @@ void ThreadedDyscoColumn<DataType>::InitializeAfterNRowsPerBlockIsKnown()
 	functor.parent = this;
 	_stopThreads = false;
 	for(size_t i=0;i!=threadCount;++i)
+	{
+		functor.threadIndex = i;
 		_threadGroup.create_thread(functor);
+	}
 }
 
 template<typename DataType>
-void ThreadedDyscoColumn<DataType>::encodeAndWrite(size_t blockIndex, const CacheItem &item, unsigned char* packedSymbolBuffer, unsigned int* unpackedSymbolBuffer, void* threadUserData)
+void ThreadedDyscoColumn<DataType>::encodeAndWrite(size_t blockIndex, const CacheItem &item, unsigned char* packedSymbolBuffer, symbol_t* unpackedSymbolBuffer, void* threadUserData, StageCounters* stageCounters, TraceBuffer* traceBuffer)
 {
 	const size_t nPolarizations = _shape[0], nChannels = _shape[1];
 	const size_t metaDataSize = sizeof(float) * metaDataFloatCount(nRowsInBlock(), nPolarizations, nChannels, _antennaCount);
-	const size_t nSymbols = symbolCount(nRowsInBlock(), nPolarizations, nChannels);
 	
 	float* metaBuffer = reinterpret_cast<float*>(packedSymbolBuffer);
 	unsigned char* binaryBuffer = packedSymbolBuffer + metaDataSize;
 	
-	encode(threadUserData, item.encoder.get(), metaBuffer, unpackedSymbolBuffer, _antennaCount);
-	
-	BytePacker::pack(_bitsPerSymbol, binaryBuffer, unpackedSymbolBuffer, nSymbols);
+	{
+		TraceScope traceScope(traceBuffer, "encode", blockIndex);
+		encode(threadUserData, blockIndex, item.encoder.get(), metaBuffer, unpackedSymbolBuffer, _antennaCount);
+		
+		StageTimer timer(stageCounters, PackingStage);
+		packSymbols(binaryBuffer, metaBuffer, unpackedSymbolBuffer, nRowsInBlock());
+	}
 	
-	const size_t binarySize = BytePacker::bufferSize(nSymbols, _bitsPerSymbol);
+	TraceScope traceScope(traceBuffer, "write", blockIndex);
+	StageTimer timer(stageCounters, WriteIOStage);
+	// The last block of the file is written completely, such that the file
+	// always covers whole blocks.
+	size_t binarySize;
+	if(blockIndex+1 < nBlocksInFile())
+		binarySize = storedPackedSize(metaBuffer, nRowsInBlock());
+	else
+		binarySize = packedSymbolSize(nRowsInBlock());
 	writeCompressedData(blockIndex, packedSymbolBuffer, metaDataSize + binarySize);
 }
 
@@ -308,20 +572,27 @@ void ThreadedDyscoColumn<DataType>::EncodingThreadFunctor::operator()()
 	
 	mutex::scoped_lock lock(parent->_mutex);
 	ao::uvector<unsigned char> packedSymbolBuffer(parent->_blockSize);
-	ao::uvector<unsigned> unpackedSymbolBuffer(nSymbols);
+	ao::uvector<symbol_t> unpackedSymbolBuffer(nSymbols);
 	cache_t &cache = parent->_cache;
 	
+	const uint64_t bufferMemory = packedSymbolBuffer.capacity() + unpackedSymbolBuffer.capacity() * sizeof(symbol_t);
+	parent->statistics().Memory().Allocate(EncodeBufferMemory, bufferMemory);
+	StageCounters* stageCounters = parent->statistics().NewThreadCounters();
+	TraceBuffer* traceBuffer = parent->newTraceBuffer(parent->Name() + " encoder " + std::to_string(threadIndex));
 	void* threadUserData;
-	parent->initializeEncodeThread(&threadUserData);
+	parent->initializeEncodeThread(&threadUserData, stageCounters);
 	
 	while(!parent->_stopThreads)
 	{
 		typename cache_t::iterator i;
 		bool isItemAvailable = parent->isWriteItemAvailable(i);
-		while(!isItemAvailable && !parent->_stopThreads)
+		if(!isItemAvailable && !parent->_stopThreads)
 		{
-			parent->_cacheChangedCondition.wait(lock);
-			isItemAvailable = parent->isWriteItemAvailable(i);
+			StageTimer timer(stageCounters, EncoderIdleStage);
+			do {
+				parent->_cacheChangedCondition.wait(lock);
+				isItemAvailable = parent->isWriteItemAvailable(i);
+			} while(!isItemAvailable && !parent->_stopThreads);
 		}
 		
 		if(isItemAvailable)
@@ -331,15 +602,17 @@ void ThreadedDyscoColumn<DataType>::EncodingThreadFunctor::operator()()
 			item.isBeingWritten = true;
 			
 			lock.unlock();
-			parent->encodeAndWrite(blockIndex, item, &packedSymbolBuffer[0], &unpackedSymbolBuffer[0], threadUserData);
+			parent->encodeAndWrite(blockIndex, item, &packedSymbolBuffer[0], &unpackedSymbolBuffer[0], threadUserData, stageCounters, traceBuffer);
 			
 			lock.lock();
+			parent->statistics().Memory().Free(WriteCacheMemory, item.memoryUsage);
 			delete &item;
 			cache.erase(i);
 			parent->_cacheChangedCondition.notify_all();
 		}
 	}
 	parent->destructEncodeThread(threadUserData);
+	parent->statistics().Memory().Free(EncodeBufferMemory, bufferMemory);
 }
 
 // This function should only be called with a locked mutex
@@ -357,9 +630,28 @@ size_t ThreadedDyscoColumn<DataType>::CalculateBlockSize(size_t nRowsInBlock, si
 {
 	size_t nPolarizations = _shape[0], nChannels = _shape[1];
 	const size_t metaDataSize = sizeof(float) * metaDataFloatCount(nRowsInBlock, nPolarizations, nChannels, nAntennae);
-	const size_t nSymbols = symbolCount(nRowsInBlock, nPolarizations, nChannels);
-	const size_t binarySize = BytePacker::bufferSize(nSymbols, _bitsPerSymbol);
-	return metaDataSize + binarySize;
+	return metaDataSize + packedSymbolSize(nRowsInBlock);
+}
+
+template<typename DataType>
+size_t ThreadedDyscoColumn<DataType>::packedSymbolSize(size_t nRowsInBlock) const
+{
+	const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+	return BytePacker::bufferSize(symbolCount(nRowsInBlock, nPolarizations, nChannels), _bitsPerSymbol);
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const
+{
+	const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+	BytePacker::pack(_bitsPerSymbol, dest, symbols, symbolCount(nRowsInBlock, nPolarizations, nChannels));
+}
+
+template<typename DataType>
+void ThreadedDyscoColumn<DataType>::unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const
+{
+	const size_t nPolarizations = _shape[0], nChannels = _shape[1];
+	BytePacker::unpack(_bitsPerSymbol, symbols, packed, symbolCount(nRowsInBlock, nPolarizations, nChannels));
 }
 
 template<typename DataType>
@@ -382,5 +674,6 @@ void ThreadedDyscoColumn<DataType>::UnserializeExtraHeader(std::istream& stream)
 
 template class ThreadedDyscoColumn<std::complex<float>>;
 template class ThreadedDyscoColumn<float>;
+template class ThreadedDyscoColumn<bool>;
 
 } // end of namespace
@@ -23,7 +23,7 @@ class DyscoStMan;
 
 /**
  * A column for storing compressed values in a threaded way, tailered for the
- * data and weight columns that use a threaded approach for encoding.
+ * data, weight and flag columns that use a threaded approach for encoding.
  * @author André Offringa
  */
 template<typename DataType>
@@ -36,7 +36,7 @@ public:
 	 * Create a new column. Internally called by DyscoStMan when creating a
 	 * new column.
 	 */
-  ThreadedDyscoColumn(DyscoStMan* parent, int dtype);
+  ThreadedDyscoColumn(DyscoStMan* parent, const std::string& name, int dtype);
   
 	ThreadedDyscoColumn(const ThreadedDyscoColumn &source) = delete;
 	
@@ -48,9 +48,21 @@ public:
 	/** Set the dimensions of values in this column. */
   virtual void setShapeColumn(const casacore::IPosition& shape) override;
 	
+	/**
+	 * Set the dimensions of the values in a particular row of a column without a fixed
+	 * shape. This sets the channel count of the data description of the row.
+	 * @param rownr The row to set the shape for.
+	 * @param shape The shape, with the polarizations of the column and at most its channels.
+	 */
+	virtual void setShape(casacore::uInt rownr, const casacore::IPosition& shape) override;
+	
 	/** Get the dimensions of the values in a particular row.
 	 * @param rownr The row to get the shape for. */
-	virtual casacore::IPosition shape(casacore::uInt rownr) override { return _shape; }
+	virtual casacore::IPosition shape(casacore::uInt rownr) override;
+	
+	/** Whether the shape of a row is known, i.e. whether the channel count of
+	 * its data description is known for a column without a fixed shape. */
+	virtual casacore::Bool isShapeDefined(casacore::uInt rownr) override;
 	
 	/**
 	 * Read the values for a particular row. This will read the required
@@ -68,6 +80,11 @@ public:
 		// Note that this method is specialized for float -- the generic method won't do anything
 		return DyscoStManColumn::getArrayfloatV(rowNr, dataPtr);
 	}
+	virtual void getArrayBoolV(casacore::uInt rowNr, casacore::Array<casacore::Bool>* dataPtr) override
+	{
+		// Note that this method is specialized for bool -- the generic method won't do anything
+		return DyscoStManColumn::getArrayBoolV(rowNr, dataPtr);
+	}
 	
 	/**
 	 * Write values into a particular row. This will add the values into the cache
@@ -86,6 +103,11 @@ public:
 		// Note that this method is specialized for float -- the generic method won't do anything
 		return DyscoStManColumn::putArrayfloatV(rowNr, dataPtr);
 	}
+	virtual void putArrayBoolV(casacore::uInt rowNr, const casacore::Array<casacore::Bool>* dataPtr) override
+	{
+		// Note that this method is specialized for bool -- the generic method won't do anything
+		return DyscoStManColumn::putArrayBoolV(rowNr, dataPtr);
+	}
 	
 	virtual void Prepare(DyscoDistribution distribution, DyscoNormalization normalization, double studentsTNu, double distributionTruncation) override;
 	
@@ -114,39 +136,126 @@ protected:
 	
 	virtual void decode(TimeBlockBuffer<data_t>* buffer, const symbol_t* data, size_t blockRow, size_t a1, size_t a2) = 0;
 	
-	virtual void initializeEncodeThread(void** threadData) = 0;
+	/**
+	 * Called by every encoding thread when it starts.
+	 * @param threadData Receives data that is passed to encode() and destructEncodeThread().
+	 * @param stageCounters Counters of the encoding thread that receive the time spent in encoding stages.
+	 */
+	virtual void initializeEncodeThread(void** threadData, StageCounters* stageCounters) = 0;
 	
 	virtual void destructEncodeThread(void* threadData) = 0;
 	
-	virtual void encode(void* threadData, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae) = 0;
+	virtual void encode(void* threadData, size_t blockIndex, TimeBlockBuffer<data_t>* buffer, float* metaBuffer, symbol_t* symbolBuffer, size_t nAntennae) = 0;
+	
+	/**
+	 * Called before a block is read from the file and decoded into the current block.
+	 * Always called from the reading or writing thread.
+	 */
+	virtual void prepareLoadBlock(size_t blockIndex) { }
+	
+	/**
+	 * Called before a block is handed over to the encoding threads.
+	 * Always called from the reading or writing thread.
+	 */
+	virtual void prepareStoreBlock(size_t blockIndex) { }
+	
+	/**
+	 * Called after a block was handed over to the encoding threads, such that blocks
+	 * that depend on it can be handed over after it with submitBlock().
+	 * Always called from the reading or writing thread.
+	 */
+	virtual void afterStoreBlock(size_t blockIndex) { }
+	
+	/**
+	 * Read a block from the file and decode it into the given buffer. Uses the
+	 * read buffers of the column, and should therefore not be called while
+	 * another block is being read.
+	 */
+	void readBlock(size_t blockIndex, TimeBlockBuffer<data_t>& buffer);
+	
+	/**
+	 * Put a block in the write cache, such that the encoding threads encode and
+	 * write it. The block should be complete, see padBlock().
+	 */
+	void submitBlock(size_t blockIndex, std::unique_ptr<TimeBlockBuffer<data_t>> block);
+	
+	/**
+	 * Complete a block with zeros for the rows that were not written,
+	 * such that every row of the block is encoded.
+	 */
+	void padBlock(size_t blockIndex, TimeBlockBuffer<data_t>& buffer) const;
+	
+	/** Wait until the given block is no longer in the write cache. */
+	void waitUntilWritten(size_t blockIndex);
 	
 	virtual size_t metaDataFloatCount(size_t nRow, size_t nPolarizations, size_t nChannels, size_t nAntennae) const = 0;
 	
 	virtual size_t symbolCount(size_t nRowsInBlock, size_t nPolarizations, size_t nChannels) const = 0;
 	
+	/**
+	 * Number of bytes taken by the packed symbols of a block. By default, all
+	 * symbols are packed consecutively with getBitsPerSymbol() bits each.
+	 * Columns that change the layout should also override packSymbols() and
+	 * unpackSymbols().
+	 */
+	virtual size_t packedSymbolSize(size_t nRowsInBlock) const;
+	
+	/**
+	 * Number of bytes of packed symbols that are actually stored for the block with
+	 * the given metadata. This is at most packedSymbolSize(), which is the space
+	 * that is reserved for every block in the file. Only the stored bytes are read
+	 * and written.
+	 */
+	virtual size_t storedPackedSize(const float* metaBuffer, size_t nRowsInBlock) const
+	{
+		return packedSymbolSize(nRowsInBlock);
+	}
+	
+	/**
+	 * Whether storedPackedSize() depends on the metadata of the block. If not, a
+	 * block is read with a single read of the metadata and the packed symbols.
+	 */
+	virtual bool isStoredSizeVariable() const { return false; }
+	
+	virtual void packSymbols(unsigned char* dest, const float* metaBuffer, const symbol_t* symbols, size_t nRowsInBlock) const;
+	
+	virtual void unpackSymbols(symbol_t* symbols, const float* metaBuffer, unsigned char* packed, size_t nRowsInBlock) const;
+	
 	virtual void shutdown() override final;
 	
+	virtual bool Flush() override final;
+	
+	virtual bool HasUnflushedRows() const override final { return _isCurrentBlockChanged && !areOffsetsInitialized(); }
+	
 	virtual size_t defaultThreadCount() const;
 	
 	size_t getBitsPerSymbol() const { return _bitsPerSymbol; }
 	
 	const casacore::IPosition& shape() const { return _shape; }
 	
+	/**
+	 * Value with which the channels are padded that rows of a column without
+	 * a fixed shape do not have.
+	 */
+	virtual data_t paddingValue() const { return data_t(); }
+	
 private:
 	struct CacheItem
 	{
-		CacheItem(std::unique_ptr<TimeBlockBuffer<data_t>>&& encoder_) :
-			encoder(std::move(encoder_)), isBeingWritten(false)
+		CacheItem(std::unique_ptr<TimeBlockBuffer<data_t>>&& encoder_, uint64_t memoryUsage_) :
+			encoder(std::move(encoder_)), isBeingWritten(false), memoryUsage(memoryUsage_)
 		{ }
 		
 		std::unique_ptr<TimeBlockBuffer<data_t>> encoder;
 		bool isBeingWritten;
+		uint64_t memoryUsage;
 	};
 	
 	struct EncodingThreadFunctor
 	{
 		void operator()();
 		ThreadedDyscoColumn *parent;
+		size_t threadIndex;
 	};
 	struct Header : public Serializable
 	{
@@ -172,12 +281,39 @@ private:
 	
 	void getValues(casacore::uInt rowNr, casacore::Array<data_t>* dataPtr);
 	void putValues(casacore::uInt rowNr, const casacore::Array<data_t>* dataPtr);
+	/**
+	 * Copy a row of the current block to the given array. Rows with fewer
+	 * channels than the column receive the first channels.
+	 */
+	void getRow(size_t blockRow, casacore::Array<data_t>* dataPtr);
+	/**
+	 * Set a row of the current block. Rows with fewer channels than the
+	 * column are padded with paddingValue().
+	 */
+	void setRow(size_t blockRow, int antenna1, int antenna2, const casacore::Array<data_t>* dataPtr);
 	
 	void stopThreads();
-	void encodeAndWrite(size_t blockIndex, const CacheItem &item, unsigned char* packedSymbolBuffer, unsigned int* unpackedSymbolBuffer, void* threadUserData);
+	void updateDecodedBlockMemory();
+	void encodeAndWrite(size_t blockIndex, const CacheItem &item, unsigned char* packedSymbolBuffer, symbol_t* unpackedSymbolBuffer, void* threadUserData, StageCounters* stageCounters, TraceBuffer* traceBuffer);
 	bool isWriteItemAvailable(typename cache_t::iterator &i);
 	void loadBlock(size_t blockIndex);
-	void storeBlock();
+	/**
+	 * Hand the current block over to the encoding threads.
+	 * @param keepCurrentBlock Whether a copy is handed over, such that the current
+	 * block remains available. Otherwise, the current block is emptied.
+	 */
+	void storeBlock(bool keepCurrentBlock = false);
+	/**
+	 * Number of rows of the block that exist in the table. Only the last block of
+	 * the table can have fewer rows than rowsInBlock().
+	 */
+	size_t rowsInTable(size_t blockIndex) const;
+	/**
+	 * Determine the number of rows per block and the number of antennae from the
+	 * metadata columns of the first time block of the table. Used when the column is
+	 * closed or flushed before a second time block is written.
+	 */
+	void initializeRowsPerBlockFromTable();
 	size_t maxCacheSize() const { return ThreadedDyscoColumn::defaultThreadCount()*12/10+1; }
 	
 	unsigned _bitsPerSymbol;
@@ -187,7 +323,8 @@ private:
 	double _lastWrittenTime;
 	int _lastWrittenField, _lastWrittenDataDescId;
 	ao::uvector<unsigned char> _packedBlockReadBuffer;
-	ao::uvector<unsigned int> _unpackedSymbolReadBuffer;
+	ao::uvector<symbol_t> _unpackedSymbolReadBuffer;
+	ao::uvector<data_t> _paddedRowBuffer;
 	cache_t _cache;
 	bool _stopThreads;
 	altthread::mutex _mutex;
@@ -197,6 +334,12 @@ private:
 	bool _isCurrentBlockChanged;
 	size_t _blockSize;
 	size_t _antennaCount;
+	// Counters for the thread(s) that read and write the column through casacore
+	StageCounters* _userStageCounters;
+	// Trace events of the reading and writing thread(s); nullptr when not tracing
+	TraceBuffer* _userTraceBuffer;
+	// Registered sizes of the buffers that are accounted in the memory counters
+	uint64_t _decodedBlockMemory, _packedReadBufferMemory, _unpackedReadBufferMemory;
 	
 	std::unique_ptr<TimeBlockBuffer<data_t>> _timeBlockBuffer;
 };
@@ -217,9 +360,18 @@ template<> inline void ThreadedDyscoColumn<float>::putArrayfloatV(casacore::uInt
 {
 	putValues(rowNr, dataPtr);
 }
+template<> inline void ThreadedDyscoColumn<bool>::getArrayBoolV(casacore::uInt rowNr, casacore::Array<casacore::Bool>* dataPtr)
+{
+	getValues(rowNr, dataPtr);
+}
+template<> inline void ThreadedDyscoColumn<bool>::putArrayBoolV(casacore::uInt rowNr, const casacore::Array<casacore::Bool>* dataPtr)
+{
+	putValues(rowNr, dataPtr);
+}
 
 extern template class ThreadedDyscoColumn<std::complex<float>>;
 extern template class ThreadedDyscoColumn<float>;
+extern template class ThreadedDyscoColumn<bool>;
 
 } // end of namespace
 
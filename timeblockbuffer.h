@@ -4,13 +4,25 @@
 #include "uvector.h"
 
 #include <complex>
+#include <cstring>
 #include <vector>
 
+#include <stdint.h>
+
+/**
+ * Container type for the values of a row. std::vector<bool> is bit-packed
+ * and does not provide data(), so flags are stored in a uvector.
+ */
+template<typename data_t>
+struct TimeBlockRowStorage { typedef std::vector<data_t> type; };
+template<>
+struct TimeBlockRowStorage<bool> { typedef ao::uvector<bool> type; };
+
 template<typename data_t>
 class TimeBlockBuffer
 {
 public:
-	typedef unsigned symbol_t;
+	typedef uint16_t symbol_t;
 	
 	TimeBlockBuffer(size_t nPol, size_t nChannels) :
 		_nPol(nPol), _nChannels(nChannels)
@@ -23,7 +35,7 @@ public:
 	struct DataRow
 	{
 		size_t antenna1, antenna2;
-		std::vector<data_t> visibilities;
+		typename TimeBlockRowStorage<data_t>::type visibilities;
 	};
 	
 	DataRow& operator[](size_t rowIndex) { return _data[rowIndex]; }
@@ -53,6 +65,15 @@ public:
 	
 	size_t NRows() const { return _data.size(); }
 	
+	/** Number of bytes allocated by this buffer. */
+	size_t MemoryUsage() const
+	{
+		size_t bytes = sizeof(TimeBlockBuffer) + _data.capacity() * sizeof(DataRow);
+		for(const DataRow& row : _data)
+			bytes += row.visibilities.capacity() * sizeof(data_t);
+		return bytes;
+	}
+	
 	size_t MaxAntennaIndex() const
 	{
 		size_t maxAntennaIndex = 0;
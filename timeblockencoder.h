@@ -1,6 +1,7 @@
 #ifndef TIME_BLOCK_ENCODER_H
 #define TIME_BLOCK_ENCODER_H
 
+#include "dyscostatistics.h"
 #include "stochasticencoder.h"
 #include "timeblockbuffer.h"
 #include "uvector.h"
@@ -42,7 +43,7 @@ public:
 	typedef TimeBlockBuffer<std::complex<double>> DBuffer;
 	typedef typename TimeBlockBuffer<std::complex<double>>::DataRow DBufferRow;
 		
-	typedef unsigned symbol_t;
+	typedef TimeBlockBuffer<std::complex<float>>::symbol_t symbol_t;
 	
 	virtual ~TimeBlockEncoder() { }
 	
@@ -61,9 +62,64 @@ public:
 	virtual size_t SymbolsPerRow() const = 0;
 	
 	virtual size_t MetaDataCount(size_t nRow, size_t nPol, size_t nChannels, size_t nAntennae) const = 0;
+	
+	/**
+	 * Set the counters that receive the time spent in the encoding stages. The
+	 * counters should belong to the thread that uses this encoder. Timing
+	 * is disabled when set to null, which is the default.
+	 */
+	virtual void SetStageCounters(dyscostman::StageCounters* stageCounters) { _stageCounters = stageCounters; }
+
+	/**
+	 * Quantize every polarization with its own quantizer, e.g. to store the
+	 * cross-hand polarizations with fewer bits. The quantizer that is passed to
+	 * the encode and decode methods is still used for normalization, so all
+	 * quantizers should have the same MaxQuantity() as that one. The quantizers
+	 * are not owned by the encoder.
+	 * @param quantizers One quantizer per polarization, or an empty vector
+	 * to use the passed quantizer for all polarizations (the default).
+	 */
+	virtual void SetPolarizationQuantizers(const std::vector<const dyscostman::StochasticEncoder<float>*>& quantizers)
+	{
+		_polarizationQuantizers = quantizers;
+	}
+	
+	/**
+	 * Like SetPolarizationQuantizers(), but with one quantizer per row of the
+	 * block. Row quantizers take precedence over polarization quantizers.
+	 */
+	virtual void SetRowQuantizers(const std::vector<const dyscostman::StochasticEncoder<float>*>& quantizers)
+	{
+		_rowQuantizers = quantizers;
+	}
 
 protected:
-	TimeBlockEncoder() { }
+	TimeBlockEncoder() : _stageCounters(nullptr) { }
+
+	const dyscostman::StochasticEncoder<float>& quantizer(const dyscostman::StochasticEncoder<float>& gausEncoder, size_t blockRow, size_t polarization) const
+	{
+		if(!_rowQuantizers.empty())
+			return *_rowQuantizers[blockRow];
+		else if(!_polarizationQuantizers.empty())
+			return *_polarizationQuantizers[polarization];
+		else
+			return gausEncoder;
+	}
+	
+	/**
+	 * Select the quantizer() of every polarization of a block row, so that loops over
+	 * the values of a row do not have to select a quantizer per value.
+	 * @param quantizers Receives one quantizer per polarization; its size should be
+	 * the number of polarizations.
+	 */
+	void selectQuantizers(const dyscostman::StochasticEncoder<float>& gausEncoder, size_t blockRow, ao::uvector<const dyscostman::StochasticEncoder<float>*>& quantizers) const
+	{
+		for(size_t p=0; p!=quantizers.size(); ++p)
+			quantizers[p] = &quantizer(gausEncoder, blockRow, p);
+	}
+
+	dyscostman::StageCounters* _stageCounters;
+	std::vector<const dyscostman::StochasticEncoder<float>*> _polarizationQuantizers, _rowQuantizers;
 };
 
 #endif
@@ -1,91 +1,238 @@
 #ifndef WEIGHT_BLOCK_ENCODER_H
 #define WEIGHT_BLOCK_ENCODER_H
 
+#include <algorithm>
 #include <cstring>
 #include <cmath>
+#include <vector>
 
 #include "timeblockbuffer.h"
+#include "cpudispatch.h"
 
+/**
+ * Encodes the weights of a block by quantizing them linearly between zero and
+ * the maximum weight of the block. It is also used for other float columns, such
+ * as SIGMA_SPECTRUM. All values should be finite and non-negative. By default, a single weight is stored for
+ * all polarizations, which is the minimum of the weights of the polarizations.
+ * With per-polarization storage enabled, the weight of every polarization is
+ * stored.
+ * 
+ * With channel scales enabled, the maximum is determined and stored for every
+ * channel, so that a channel with large weights does not reduce the accuracy of
+ * the other channels.
+ * 
+ * With block modes enabled, blocks in which all weights are equal are stored as
+ * a single value, and blocks in which each row has a single weight are stored
+ * with one symbol per row. The first metadata value then holds the mode.
+ */
 class WeightBlockEncoder
 {
 public:
-	WeightBlockEncoder(size_t nPolarizations, size_t nChannels, size_t quantCount) :
-		_nPolarizations(nPolarizations), _nChannels(nChannels), _quantCount(quantCount)
+	typedef TimeBlockBuffer<float>::symbol_t symbol_t;
+	
+	enum BlockMode {
+		/** Every channel of every row is quantized */
+		QuantizedMode = 0,
+		/** All weights of the block are equal and stored in the metadata */
+		ConstantMode = 1,
+		/** Each row has one weight, which is quantized */
+		RowConstantMode = 2
+	};
+	
+	WeightBlockEncoder(size_t nPolarizations, size_t nChannels, size_t quantCount, bool useBlockModes = false, bool useChannelScales = false, bool perPolarization = false) :
+		_nPolarizations(nPolarizations), _nChannels(nChannels), _quantCount(quantCount),
+		_useBlockModes(useBlockModes),
+		_useChannelScales(useChannelScales),
+		_valuesPerChannel(perPolarization ? nPolarizations : 1),
+		_valuesPerRow(nChannels * _valuesPerChannel),
+		_decodeMode(QuantizedMode),
+		_decodeFactors(_valuesPerRow)
 	{ }
 	
 	size_t MetaDataFloatCount() const
 	{
-		return 1.0;
+		return (_useBlockModes ? 1 : 0) + scaleCount();
 	}
 	
+	/**
+	 * Maximum number of symbols of a block.
+	 */
 	size_t SymbolCount(size_t nRowsInBlock) const
 	{
-		return nRowsInBlock * _nChannels;
+		return nRowsInBlock * _valuesPerRow;
+	}
+	
+	/**
+	 * Number of symbols that were stored for a block, which depends on its mode.
+	 */
+	size_t StoredSymbolCount(const float* metaBuffer, size_t nRowsInBlock) const
+	{
+		switch(mode(metaBuffer))
+		{
+			case ConstantMode: return 0;
+			case RowConstantMode: return nRowsInBlock;
+			default: return SymbolCount(nRowsInBlock);
+		}
 	}
 	
 	void InitializeDecode(const float* metaBuffer)
 	{
-		_decodeMaxValue = metaBuffer[0];
+		_decodeMode = mode(metaBuffer);
+		const float* scales = metaBuffer + (_useBlockModes ? 1 : 0);
+		_decodeConstant = scales[0];
+		for(size_t i=0; i!=_valuesPerRow; ++i)
+			_decodeFactors[i] = scales[_useChannelScales ? i/_valuesPerChannel : 0] / float(_quantCount-1);
 	}
 	
-	void Decode(TimeBlockBuffer<float>& buffer, const unsigned int* symbolBuffer, size_t blockRow) const
+	DYSCO_TARGET_CLONES
+	void Decode(TimeBlockBuffer<float>& buffer, const symbol_t* symbolBuffer, size_t blockRow) const
 	{
-		double scaleValue = _decodeMaxValue / (double(_quantCount-1));
 		TimeBlockBuffer<float>::DataRow& row = buffer[blockRow];
-		const unsigned int* rowBuffer = &symbolBuffer[blockRow * _nChannels];
-		for(size_t ch=0; ch!=_nChannels; ++ch)
+		row.visibilities.resize(_nChannels*_nPolarizations);
+		if(_decodeMode != QuantizedMode)
 		{
-			float value = *rowBuffer * scaleValue;
-			row.visibilities.resize(_nChannels*_nPolarizations);
-			float* chPtr = &row.visibilities[ch*_nPolarizations];
-			for(size_t p=0; p!=_nPolarizations; ++p)
-				chPtr[p] = value;
-			++rowBuffer;
+			const float value = (_decodeMode == ConstantMode) ? _decodeConstant : symbolBuffer[blockRow] * _decodeFactors[0];
+			std::fill(row.visibilities.begin(), row.visibilities.end(), value);
+			return;
+		}
+		const symbol_t* rowBuffer = &symbolBuffer[blockRow * _valuesPerRow];
+		const float* factors = _decodeFactors.data();
+		float* visibilities = row.visibilities.data();
+		if(_valuesPerChannel == _nPolarizations)
+		{
+			for(size_t i=0; i!=_valuesPerRow; ++i)
+				visibilities[i] = rowBuffer[i] * factors[i];
+		}
+		else {
+			for(size_t ch=0; ch!=_nChannels; ++ch)
+			{
+				const float value = rowBuffer[ch] * factors[ch];
+				float* chPtr = &visibilities[ch*_nPolarizations];
+				for(size_t p=0; p!=_nPolarizations; ++p)
+					chPtr[p] = value;
+			}
 		}
 	}
 	
-	void Encode(TimeBlockBuffer<float>& buffer, float* metaBuffer, unsigned int* symbolBuffer) const
+	DYSCO_TARGET_CLONES
+	void Encode(TimeBlockBuffer<float>& buffer, float* metaBuffer, symbol_t* symbolBuffer) const
 	{
-		float maxValue = 0.0;
-		for(const TimeBlockBuffer<float>::DataRow& row : buffer.GetVector())
+		const std::vector<TimeBlockBuffer<float>::DataRow>& rows = buffer.GetVector();
+		// The values to be stored per row
+		std::vector<float> weights(rows.size() * _valuesPerRow);
+		std::vector<float> channelMax(_nChannels, 0.0);
+		bool isRowConstant = true;
+		for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
 		{
-			for(size_t ch=0; ch!=_nChannels; ++ch)
+			float* rowWeights = &weights[rowIndex * _valuesPerRow];
+			rowValues(rows[rowIndex], rowWeights);
+			for(size_t i=0; i!=_valuesPerRow; ++i)
 			{
-				const float* visPtr = &row.visibilities[ch*_nPolarizations];
-				float weight = *visPtr;
-				for(size_t p=1; p!=_nPolarizations; ++p)
-					if(visPtr[p] < weight) weight = visPtr[p];
-				if(weight > maxValue)
-					maxValue = weight;
+				float& max = channelMax[i / _valuesPerChannel];
+				max = std::max(max, rowWeights[i]);
+				isRowConstant = isRowConstant && (rowWeights[i] == rowWeights[0]);
 			}
 		}
-		if(maxValue == 0.0)
-			maxValue = 1.0;
-		metaBuffer[0] = maxValue;
+		bool isConstant = isRowConstant;
+		for(size_t rowIndex=1; rowIndex<rows.size() && isConstant; ++rowIndex)
+			isConstant = (weights[rowIndex * _valuesPerRow] == weights[0]);
 		
-		double scaleValue = double(_quantCount-1) / maxValue;
+		BlockMode mode = QuantizedMode;
+		if(_useBlockModes && !rows.empty() && isRowConstant)
+			mode = isConstant ? ConstantMode : RowConstantMode;
 		
-		for(const TimeBlockBuffer<float>::DataRow& row : buffer.GetVector())
+		const float maxValue = channelMax.empty() ? 0.0 : *std::max_element(channelMax.begin(), channelMax.end());
+		if(_useBlockModes)
 		{
-			for(size_t ch=0; ch!=_nChannels; ++ch)
+			metaBuffer[0] = mode;
+			++metaBuffer;
+		}
+		if(mode == ConstantMode)
+		{
+			std::fill(metaBuffer, metaBuffer + scaleCount(), weights[0]);
+			return;
+		}
+		
+		std::vector<float> factors(_valuesPerRow);
+		for(size_t ch=0; ch!=_nChannels; ++ch)
+		{
+			float scale = _useChannelScales ? channelMax[ch] : maxValue;
+			if(scale == 0.0)
+				scale = 1.0;
+			if(ch < scaleCount())
+				metaBuffer[ch] = scale;
+			for(size_t i=0; i!=_valuesPerChannel; ++i)
+				factors[ch*_valuesPerChannel + i] = float(_quantCount-1) / scale;
+		}
+		
+		if(mode == RowConstantMode)
+		{
+			for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
+				symbolBuffer[rowIndex] = quantize(weights[rowIndex * _valuesPerRow], factors[0]);
+		}
+		else {
+			for(size_t rowIndex=0; rowIndex!=rows.size(); ++rowIndex)
 			{
-				const float* visPtr = &row.visibilities[ch*_nPolarizations];
-				float weight = *visPtr;
-				for(size_t p=1; p!=_nPolarizations; ++p)
-					if(visPtr[p] < weight) weight = visPtr[p];
-					
-				*symbolBuffer = roundf(double(weight) * scaleValue);
-				++symbolBuffer;
+				const float* rowWeights = &weights[rowIndex * _valuesPerRow];
+				symbol_t* rowSymbols = &symbolBuffer[rowIndex * _valuesPerRow];
+				for(size_t i=0; i!=_valuesPerRow; ++i)
+					rowSymbols[i] = quantize(rowWeights[i], factors[i]);
 			}
 		}
 	}
 	
 private:
+	BlockMode mode(const float* metaBuffer) const
+	{
+		if(_useBlockModes && (metaBuffer[0] == ConstantMode || metaBuffer[0] == RowConstantMode))
+			return BlockMode(int(metaBuffer[0]));
+		else
+			return QuantizedMode;
+	}
+	
+	static symbol_t quantize(float value, float factor)
+	{
+		return roundf(value * factor);
+	}
+	
+	size_t scaleCount() const
+	{
+		return _useChannelScales ? _nChannels : 1;
+	}
+	
+	/**
+	 * Collect the values of a row that are stored. Without per-polarization storage,
+	 * the weight of a channel is the smallest weight of its polarizations.
+	 */
+	void rowValues(const TimeBlockBuffer<float>::DataRow& row, float* values) const
+	{
+		const float* visPtr = row.visibilities.data();
+		if(_valuesPerChannel == _nPolarizations)
+		{
+			std::copy(visPtr, visPtr + _valuesPerRow, values);
+			return;
+		}
+		for(size_t ch=0; ch!=_nChannels; ++ch)
+		{
+			float weight = visPtr[0];
+			for(size_t p=1; p!=_nPolarizations; ++p)
+				weight = std::min(weight, visPtr[p]);
+			values[ch] = weight;
+			visPtr += _nPolarizations;
+		}
+	}
 	
 	const size_t _nPolarizations;
 	const size_t _nChannels;
 	const size_t _quantCount;
-	float _decodeMaxValue;
+	const bool _useBlockModes;
+	const bool _useChannelScales;
+	// Number of stored values per channel and per row
+	const size_t _valuesPerChannel, _valuesPerRow;
+	BlockMode _decodeMode;
+	float _decodeConstant;
+	// Factor that converts each symbol of a row to a weight
+	std::vector<float> _decodeFactors;
 };
 
 #endif